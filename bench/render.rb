@@ -0,0 +1,198 @@
+#
+# Headless throughput benchmarks for the rendering bindings.
+#
+#   SDL_VIDEODRIVER=dummy mruby bench/render.rb [--time=SECONDS] [NAME_FILTER...]
+#
+# Everything draws into an offscreen Surface through the software renderer,
+# so no window or GPU is needed. The result is printed as a single JSON
+# object on stdout; see run_bench.rb for building and running it.
+#
+
+W = 640
+H = 480
+
+min_time = 0.5
+filters  = []
+ARGV.each do |arg|
+  if arg.start_with?('--time=')
+    min_time = arg[7..-1].to_f
+  else
+    filters << arg
+  end
+end
+
+FREQ = SDL2::Timer.perf_freq.to_f
+
+def now
+  SDL2::Timer.perf_counter.to_f / FREQ
+end
+
+# Runs the block with growing iteration counts until one batch takes at
+# least min_time, and reports operations per second for that batch.
+# `ops` is the number of primitives one iteration submits.
+def measure(name, ops, min_time)
+  yield 1
+  n = 1
+  loop do
+    t0 = now
+    yield n
+    elapsed = now - t0
+    if elapsed >= min_time || n >= 0x10000000
+      return { :name => name, :iterations => n, :ops => n * ops, :seconds => elapsed,
+               :ops_per_sec => (elapsed > 0) ? (n * ops) / elapsed : 0.0 }
+    end
+    n *= (elapsed > 0.01) ? [(min_time / elapsed * 1.2).ceil, 2].max : 10
+  end
+end
+
+def json_value(v)
+  case v
+  when String then '"' + v.gsub('\\', '\\\\').gsub('"', '\\"') + '"'
+  when Float  then (v.nan? || v.infinite?) ? 'null' : v.to_s
+  when nil    then 'null'
+  when Array  then '[' + v.map { |e| json_value(e) }.join(',') + ']'
+  when Hash   then '{' + v.map { |k, e| json_value(k.to_s) + ':' + json_value(e) }.join(',') + '}'
+  else v.to_s
+  end
+end
+
+SDL2::init(SDL2::SDL_INIT_VIDEO | SDL2::SDL_INIT_TIMER | SDL2::SDL_INIT_EVENTS)
+SDL2::Video::init
+
+ARGB8888  = SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888
+STREAMING = SDL2::Video::Texture::SDL_TEXTUREACCESS_STREAMING
+
+target   = SDL2::Video::Surface.new(W, H, 32, ARGB8888)
+renderer = SDL2::Video::Renderer.new(target)
+sprite_surface = SDL2::Video::Surface.new(32, 32, 32, ARGB8888)
+sprite_surface.fill_rect(0, 255, 0, 255)
+sprite  = SDL2::Video::Texture.new(renderer, sprite_surface)
+stream  = SDL2::Video::Texture.new(renderer, ARGB8888, STREAMING, 256, 256)
+upload  = SDL2::Video::Surface.new(256, 256, 32, ARGB8888)
+blit_dst = SDL2::Video::Surface.new(W, H, 32, ARGB8888)
+
+rects  = (0...256).map { |i| SDL2::Rect.new((i * 37) % W, (i * 91) % H, 16, 16) }
+points = (0...1024).map { |i| SDL2::Point.new((i * 37) % W, (i * 91) % H) }
+rect_array  = SDL2::RectArray.new
+point_array = SDL2::PointArray.new
+rects.each  { |r| rect_array.push(r) }
+points.each { |p| point_array.push(p) }
+src    = SDL2::Rect.new(0, 0, 32, 32)
+dsts   = (0...256).map { |i| SDL2::Rect.new((i * 37) % W, (i * 91) % H, 32, 32) }
+center = SDL2::Point.new(16, 16)
+
+benchmarks = []
+benchmarks << ['renderer.fill_rect', 256, lambda { |n|
+  n.times { rects.each { |r| renderer.fill_rect(r) } }
+}]
+benchmarks << ['renderer.fill_rect.set_draw_color', 256, lambda { |n|
+  n.times { rects.each { |r| renderer.set_draw_color(255, 0, 0); renderer.fill_rect(r) } }
+}]
+benchmarks << ['renderer.fill_rects.array', 256, lambda { |n|
+  n.times { renderer.fill_rects(*rects) }
+}]
+benchmarks << ['renderer.fill_rects.rect_array', 256, lambda { |n|
+  n.times { renderer.fill_rects(rect_array) }
+}]
+benchmarks << ['renderer.draw_points.array', 1024, lambda { |n|
+  n.times { renderer.draw_points(*points) }
+}]
+benchmarks << ['renderer.draw_points.point_array', 1024, lambda { |n|
+  n.times { renderer.draw_points(point_array) }
+}]
+benchmarks << ['renderer.copy', 256, lambda { |n|
+  n.times { dsts.each { |d| renderer.copy(sprite, src, d) } }
+}]
+benchmarks << ['renderer.copy.deferred', 256, lambda { |n|
+  renderer.deferred = true
+  n.times { dsts.each { |d| renderer.copy(sprite, src, d) }; renderer.flush }
+  renderer.deferred = false
+}]
+display_list = renderer.record { |r| dsts.each { |d| r.copy(sprite, src, d) } }
+benchmarks << ['renderer.copy.display_list', 256, lambda { |n|
+  n.times { display_list.replay(renderer, 1, 1) }
+}]
+benchmarks << ['renderer.copy_ex', 256, lambda { |n|
+  n.times { dsts.each_with_index { |d, i| renderer.copy_ex(sprite, src, d, i.to_f, center, 0) } }
+}]
+if [].respond_to?(:pack)
+  batch = dsts.map { |d| [0, 0, 32, 32, d.x, d.y, d.w, d.h] }.flatten.pack('l*')
+  benchmarks << ['renderer.copy_batch', 256, lambda { |n|
+    n.times { renderer.copy_batch(sprite, batch) }
+  }]
+  ex_batch = (0...dsts.size).map { |i|
+    d = dsts[i]
+    [0, 0, 32, 32, d.x, d.y, d.w, d.h, i.to_f, 16, 16, 0, 255, (i * 7) & 255, 128, 255]
+  }.flatten.pack('f*')
+  benchmarks << ['renderer.copy_ex_batch', 256, lambda { |n|
+    n.times { renderer.copy_ex_batch(sprite, ex_batch) }
+  }]
+end
+render_queue = SDL2::Video::RenderQueue.new(256)
+benchmarks << ['render_queue.push_draw', 256, lambda { |n|
+  n.times {
+    dsts.each_with_index { |d, i| render_queue.push(i & 3, sprite, src, d) }
+    render_queue.draw(renderer)
+  }
+}]
+benchmarks << ['texture.update', 1, lambda { |n|
+  n.times { stream.update(upload) }
+}]
+benchmarks << ['texture.update_locked', 1, lambda { |n|
+  n.times { stream.update_locked(upload) }
+}]
+benchmarks << ['surface.blit', 1, lambda { |n|
+  n.times { upload.blit(blit_dst, 10, 10) }
+}]
+gradient_rect = SDL2::Rect.new(0, 0, W, H)
+benchmarks << ['surface.apply.grayscale', 1, lambda { |n|
+  n.times { blit_dst.apply!(:grayscale) }
+}]
+benchmarks << ['surface.apply.tint', 1, lambda { |n|
+  n.times { blit_dst.apply!(:tint, 255, 200, 160) }
+}]
+benchmarks << ['surface.gaussian_blur', 1, lambda { |n|
+  n.times { blit_dst.gaussian_blur!(3.0) }
+}]
+benchmarks << ['surface.box_blur', 1, lambda { |n|
+  n.times { blit_dst.box_blur!(4) }
+}]
+benchmarks << ['surface.scale.bilinear', 1, lambda { |n|
+  n.times { blit_dst.scale(W * 3 / 2, H * 3 / 2) }
+}]
+benchmarks << ['surface.scale.bicubic', 1, lambda { |n|
+  n.times { blit_dst.scale(W * 3 / 2, H * 3 / 2, :bicubic) }
+}]
+benchmarks << ['surface.scale.box', 1, lambda { |n|
+  n.times { blit_dst.scale(W / 3, H / 3, :box) }
+}]
+benchmarks << ['surface.gradient_fill_rect.vertical', 1, lambda { |n|
+  n.times { blit_dst.gradient_fill_rect(0, 0, 64, 255, 255, 128, 0, 255, gradient_rect, true) }
+}]
+benchmarks << ['surface.gradient_fill_rect.horizontal', 1, lambda { |n|
+  n.times { blit_dst.gradient_fill_rect(0, 0, 64, 255, 255, 128, 0, 255, gradient_rect, false) }
+}]
+emitter = SDL2::Video::ParticleEmitter.new(50000)
+emitter.set_position(W / 2, H / 2)
+emitter.set_velocity(-200, 200, -200, 200)
+emitter.set_lifetime(1.0, 2.0)
+emitter.set_gravity(0, 100)
+emitter.size = 2
+benchmarks << ['particles.update_render', 50000, lambda { |n|
+  n.times { emitter.emit(emitter.capacity); emitter.update(1.0 / 60); emitter.render(renderer) }
+}]
+benchmarks << ['input.poll', 1, lambda { |n|
+  n.times { SDL2::Input.poll }
+}]
+
+results = []
+benchmarks.each do |name, ops, body|
+  next unless filters.empty? || filters.any? { |f| name.include?(f) }
+  results << measure(name, ops, min_time) { |n| body.call(n) }
+end
+
+puts json_value({ :driver => 'software', :width => W, :height => H, :min_time => min_time, :benchmarks => results })
+
+renderer.destroy
+SDL2::Video::quit
+SDL2::quit
@@ -10,6 +10,50 @@ extern "C" {
 extern void mruby_sdl2_misc_init(mrb_state *mrb);
 extern void mruby_sdl2_misc_final(mrb_state *mrb);
 
+extern void *mrb_sdl2_misc_buffer_get_ptr(mrb_state *mrb, mrb_value buffer, size_t *size);
+/* String or SDL2::Buffer contents */
+extern void *mrb_sdl2_misc_bytes_get_ptr(mrb_state *mrb, mrb_value bytes, size_t *size);
+/* non-owning ByteBuffer over `ptr`; detach it before the memory is freed */
+extern mrb_value mrb_sdl2_misc_buffer_view(mrb_state *mrb, void *ptr, size_t size);
+extern void mrb_sdl2_misc_buffer_detach(mrb_state *mrb, mrb_value view);
+
+/* copies `rows` rows of `row_bytes` bytes between images of any pitch */
+extern void mrb_sdl2_misc_copy_rows(void *dst, int dst_pitch, void const *src, int src_pitch, size_t row_bytes, int rows);
+
+/*
+ * AVX2 kernels are compiled with __attribute__((target("avx2"))) where the
+ * compiler supports it and only called when the CPU has AVX2.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MRB_SDL2_HAVE_AVX2_TARGET 1
+#endif
+
+extern bool mrb_sdl2_misc_has_avx2(void);
+
+/*
+ * scratch arena for per-call / per-frame temporary arrays; process-global,
+ * so main thread and a single mrb_state only
+ */
+typedef struct mrb_sdl2_scratch_mark_t {
+  void  *block;
+  size_t used;
+} mrb_sdl2_scratch_mark_t;
+
+extern void *mrb_sdl2_scratch_alloc(mrb_state *mrb, size_t size);
+extern mrb_sdl2_scratch_mark_t mrb_sdl2_scratch_mark(void);
+extern void mrb_sdl2_scratch_release(mrb_sdl2_scratch_mark_t mark);
+extern void mrb_sdl2_scratch_reset(void);
+
+/*
+ * fork/join over [0, count): fn gets chunks of at least `grain` items on
+ * the worker pool and the calling thread; `worker` indexes per-thread
+ * scratch in [0, mrb_sdl2_parallel_workers()). Main thread only.
+ */
+typedef void (*mrb_sdl2_parallel_fn_t)(void *ctx, int begin, int end, int worker);
+
+extern int  mrb_sdl2_parallel_workers(void);
+extern void mrb_sdl2_parallel_for(int count, int grain, mrb_sdl2_parallel_fn_t fn, void *ctx);
+
 #ifdef __cplusplu
 }
 #endif
@@ -22,6 +22,11 @@ extern mrb_value mrb_sdl2_point(mrb_state *mrb, int x, int y);
 extern SDL_Rect    *mrb_sdl2_rect_get_ptr(mrb_state *mrb, mrb_value rect);
 extern SDL_Point   *mrb_sdl2_point_get_ptr(mrb_state *mrb, mrb_value point);
 
+extern mrb_bool     mrb_sdl2_rectarray_p(mrb_state *mrb, mrb_value value);
+extern mrb_bool     mrb_sdl2_pointarray_p(mrb_state *mrb, mrb_value value);
+extern SDL_Rect    *mrb_sdl2_rectarray_get_ptr(mrb_state *mrb, mrb_value array, mrb_int *size);
+extern SDL_Point   *mrb_sdl2_pointarray_get_ptr(mrb_state *mrb, mrb_value array, mrb_int *size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,16 +12,28 @@
 
 typedef struct pixelbuf_data_t {
   SDL_Rect rect;
-  void    *pixels;
+  void    *pixels; /* NULL once the texture is unlocked */
   int      pitch;
+  int      bytes_per_pixel;
 } pixelbuf_data_t;
 
 extern SDL_Renderer *mrb_sdl2_video_renderer_get_ptr(mrb_state *mrb, mrb_value renderer);
+/* same as get_ptr, but first submits draw calls queued in deferred mode */
+extern SDL_Renderer *mrb_sdl2_video_renderer_get_flushed_ptr(mrb_state *mrb, mrb_value renderer);
+/* same, for direct SDL draws; raises `message` while the renderer is recording */
+extern SDL_Renderer *mrb_sdl2_video_renderer_get_draw_ptr(mrb_state *mrb, mrb_value renderer, char const *message);
+/* forget cached draw state after calling SDL_SetRender* directly */
+extern void mrb_sdl2_video_renderer_invalidate_state(mrb_state *mrb, mrb_value renderer);
+/* same, and re-applies the draw color and blend mode set through the bindings */
+extern void mrb_sdl2_video_renderer_restore_state(mrb_state *mrb, mrb_value renderer);
 
 extern mrb_value mrb_sdl2_video_renderer(mrb_state *mrb, SDL_Renderer *renderer);
 extern mrb_value mrb_sdl2_video_texture(mrb_state *mrb, SDL_Texture *texture);
+/* same, for a texture of `renderer`; destroying it flushes the renderer first */
+extern mrb_value mrb_sdl2_video_renderer_texture(mrb_state *mrb, mrb_value renderer, SDL_Texture *texture);
 
 extern SDL_Texture *mrb_sdl2_video_texture_get_ptr(mrb_state *mrb, mrb_value texture);
+extern pixelbuf_data_t *mrb_sdl2_video_pixelbuf_get_ptr(mrb_state *mrb, mrb_value pbuf);
 
 extern void mruby_sdl2_video_renderer_init(mrb_state *mrb, struct RClass *mod_Video);
 extern void mruby_sdl2_video_renderer_final(mrb_state *mrb, struct RClass *mod_Video);
@@ -0,0 +1,17 @@
+#ifndef MRUBY_SDL2_VIDEO_ATLAS_H
+#define MRUBY_SDL2_VIDEO_ATLAS_H
+
+#include "mruby.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void mruby_sdl2_video_atlas_init(mrb_state *mrb);
+extern void mruby_sdl2_video_atlas_final(mrb_state *mrb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of MRUBY_SDL2_VIDEO_ATLAS_H */
@@ -0,0 +1,43 @@
+#!/usr/bin/env ruby
+#
+# mrbgems benchmark runner
+#
+#   ruby run_bench.rb [--time=SECONDS] [NAME_FILTER...] > result.json
+#
+
+if __FILE__ == $0
+  repository, dir = 'https://github.com/mruby/mruby.git', 'tmp/mruby'
+
+  Dir.mkdir 'tmp'  unless File.exist?('tmp')
+  unless File.exist?(dir)
+    system "git clone -b 1.4.0 #{repository} #{dir}"
+  end
+
+  # build output goes to stderr so that stdout only carries the JSON result
+  exit false unless system(%Q[cd #{dir}; MRUBY_CONFIG=#{File.expand_path __FILE__} ruby minirake all 1>&2])
+
+  mruby = File.expand_path('tmp/bench/bin/mruby', File.dirname(__FILE__))
+  bench = File.expand_path('bench/render.rb', File.dirname(__FILE__))
+  env = { 'SDL_VIDEODRIVER' => ENV['SDL_VIDEODRIVER'] || 'dummy',
+          'SDL_AUDIODRIVER' => ENV['SDL_AUDIODRIVER'] || 'dummy' }
+  exit system(env, mruby, bench, *ARGV)
+end
+
+MRuby::Build.new do |conf|
+  if ENV['CC'].to_s.start_with? "clang"
+    toolchain :clang
+  else
+    toolchain :gcc
+  end
+
+  conf.build_dir = File.expand_path('tmp/bench', File.dirname(__FILE__))
+
+  conf.cc.command = ENV['CC'] || 'gcc'
+  conf.gembox 'default'
+  conf.gem File.expand_path(File.dirname(__FILE__))
+
+  conf.cc.defines += %w(MRB_UTF8_STRING)
+  conf.cc.defines += %w(MRB_32BIT)
+  conf.cc.defines += %w(MRB_METHOD_TABLE_INLINE MRB_METHOD_CACHE) # for 1.4.0
+  conf.cc.flags = %w(-O2 -std=gnu99 -Wall -Werror-implicit-function-declaration -Wwrite-strings)
+end
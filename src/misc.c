@@ -3,14 +3,35 @@
 #include "mruby/value.h"
 #include "mruby/data.h"
 #include "mruby/array.h"
+#include "mruby/hash.h"
+#include "mruby/string.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_stdinc.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_cpuinfo.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_version.h>
+#else
+#include <SDL_stdinc.h>
+#include <SDL_atomic.h>
+#include <SDL_cpuinfo.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <SDL_version.h>
+#endif
 
 static struct RClass *class_Buffer = NULL;
 static struct RClass *class_FloatBuffer = NULL;
 static struct RClass *class_ByteBuffer = NULL;
 
+/* set once at init, read by kernels on any thread */
+static bool has_avx2 = false;
+
 typedef struct mrb_sdl2_misc_buffer_data_t {
   void  *buffer;
   size_t size;
+  bool   owned; /* false for views of memory owned elsewhere */
 } mrb_sdl2_misc_buffer_data_t;
 
 static void
@@ -19,7 +40,9 @@ mrb_sdl2_misc_buffer_data_free(mrb_state *mrb, void *p)
   mrb_sdl2_misc_buffer_data_t *data =
     (mrb_sdl2_misc_buffer_data_t*)p;
   if (NULL != data) {
-    mrb_free(mrb, data->buffer);
+    if (data->owned) {
+      mrb_free(mrb, data->buffer);
+    }
     mrb_free(mrb, p);
   }
 }
@@ -28,6 +51,85 @@ static struct mrb_data_type const mrb_sdl2_misc_buffer_data_type = {
   "Buffer", &mrb_sdl2_misc_buffer_data_free
 };
 
+void *
+mrb_sdl2_misc_buffer_get_ptr(mrb_state *mrb, mrb_value buffer, size_t *size)
+{
+  mrb_sdl2_misc_buffer_data_t *data =
+    (mrb_sdl2_misc_buffer_data_t*)mrb_data_get_ptr(mrb, buffer, &mrb_sdl2_misc_buffer_data_type);
+  if (NULL != size) {
+    *size = data->size;
+  }
+  return data->buffer;
+}
+
+/*
+ * Wraps memory owned by someone else in a ByteBuffer without copying. The
+ * caller keeps the owner alive from the view and detaches the view before
+ * the memory goes away.
+ */
+mrb_value
+mrb_sdl2_misc_buffer_view(mrb_state *mrb, void *ptr, size_t size)
+{
+  mrb_sdl2_misc_buffer_data_t *data =
+    (mrb_sdl2_misc_buffer_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_misc_buffer_data_t));
+  if (NULL == data) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+  data->buffer = ptr;
+  data->size   = size;
+  data->owned  = false;
+  return mrb_obj_value(Data_Wrap_Struct(mrb, class_ByteBuffer, &mrb_sdl2_misc_buffer_data_type, data));
+}
+
+/* empties a view so that later accesses see a zero-sized buffer */
+void
+mrb_sdl2_misc_buffer_detach(mrb_state *mrb, mrb_value view)
+{
+  mrb_sdl2_misc_buffer_data_t *data =
+    (mrb_sdl2_misc_buffer_data_t*)mrb_data_get_ptr(mrb, view, &mrb_sdl2_misc_buffer_data_type);
+  if (!data->owned) {
+    data->buffer = NULL;
+    data->size   = 0;
+  }
+}
+
+void *
+mrb_sdl2_misc_bytes_get_ptr(mrb_state *mrb, mrb_value bytes, size_t *size)
+{
+  if (mrb_string_p(bytes)) {
+    if (NULL != size) {
+      *size = (size_t)RSTRING_LEN(bytes);
+    }
+    return RSTRING_PTR(bytes);
+  }
+  return mrb_sdl2_misc_buffer_get_ptr(mrb, bytes, size);
+}
+
+void
+mrb_sdl2_misc_copy_rows(void *dst, int dst_pitch, void const *src, int src_pitch, size_t row_bytes, int rows)
+{
+  uint8_t *d = (uint8_t*)dst;
+  uint8_t const *s = (uint8_t const*)src;
+  if (rows <= 0) {
+    return;
+  }
+  if ((dst_pitch == src_pitch) && ((size_t)dst_pitch == row_bytes)) {
+    SDL_memcpy(d, s, row_bytes * rows);
+    return;
+  }
+  while (0 < rows--) {
+    SDL_memcpy(d, s, row_bytes);
+    d += dst_pitch;
+    s += src_pitch;
+  }
+}
+
+bool
+mrb_sdl2_misc_has_avx2(void)
+{
+  return has_avx2;
+}
+
 static mrb_value
 mrb_sdl2_misc_buffer_initialize(mrb_state *mrb, mrb_value self)
 {
@@ -166,6 +268,7 @@ mrb_sdl2_misc_buffer_initialize(mrb_state *mrb, mrb_value self)
     }
   }
 
+  data->owned = true;
   DATA_PTR(self) = data;
   DATA_TYPE(self) = &mrb_sdl2_misc_buffer_data_type;
 
@@ -289,6 +392,7 @@ mrb_sdl2_misc_floatbuffer_initialize(mrb_state *mrb, mrb_value self)
     }
   }
 
+  data->owned = true;
   DATA_PTR(self) = data;
   DATA_TYPE(self) = &mrb_sdl2_misc_buffer_data_type;
 
@@ -426,6 +530,7 @@ mrb_sdl2_misc_bytebuffer_initialize(mrb_state *mrb, mrb_value self)
     }
   }
 
+  data->owned = true;
   DATA_PTR(self) = data;
   DATA_TYPE(self) = &mrb_sdl2_misc_buffer_data_type;
 
@@ -462,9 +567,335 @@ mrb_sdl2_misc_bytebuffer_set_at(mrb_state *mrb, mrb_value self)
   return self;
 }
 
+/***************************************************************************
+*
+* scratch arena
+*
+* Bump-pointer allocator for temporary native arrays. Blocks added after a
+* mark are freed again when the mark is released, so a one-off large
+* request (a readback, a blur of a big surface) does not stay resident.
+* mrb_sdl2_scratch_reset() keeps a single block as large as the frame's
+* peak, capped at MRB_SDL2_SCRATCH_RETAIN_MAX, so a steady state frame of
+* small arrays does not touch the heap at all.
+*
+* The arena is process-global: it is shared by every mrb_state and freed
+* by mruby_sdl2_misc_final(), so only one interpreter may use the SDL2
+* bindings at a time. Main thread only.
+*
+***************************************************************************/
+
+#define MRB_SDL2_SCRATCH_ALIGN      16
+#define MRB_SDL2_SCRATCH_BLOCK_SIZE (64 * 1024)
+#define MRB_SDL2_SCRATCH_RETAIN_MAX (1024 * 1024)
+
+typedef struct mrb_sdl2_scratch_block_t {
+  struct mrb_sdl2_scratch_block_t *prev;
+  size_t size;
+  size_t used;
+} mrb_sdl2_scratch_block_t;
+
+#define MRB_SDL2_SCRATCH_HEADER_SIZE \
+  ((sizeof(mrb_sdl2_scratch_block_t) + MRB_SDL2_SCRATCH_ALIGN - 1) & ~(size_t)(MRB_SDL2_SCRATCH_ALIGN - 1))
+
+static struct {
+  mrb_sdl2_scratch_block_t *head;
+  size_t capacity;
+  size_t used;
+  size_t high_water;
+  size_t frame_peak;
+  size_t block_allocations;
+} scratch = { NULL, 0, 0, 0, 0, 0 };
+
+static mrb_sdl2_scratch_block_t *
+mrb_sdl2_scratch_new_block(size_t size)
+{
+  mrb_sdl2_scratch_block_t *block =
+    (mrb_sdl2_scratch_block_t*)SDL_malloc(MRB_SDL2_SCRATCH_HEADER_SIZE + size);
+  if (NULL == block) {
+    return NULL;
+  }
+  block->prev = scratch.head;
+  block->size = size;
+  block->used = 0;
+  scratch.head = block;
+  scratch.capacity += size;
+  scratch.block_allocations++;
+  return block;
+}
+
+static void
+mrb_sdl2_scratch_free_blocks(void)
+{
+  while (NULL != scratch.head) {
+    mrb_sdl2_scratch_block_t *prev = scratch.head->prev;
+    SDL_free(scratch.head);
+    scratch.head = prev;
+  }
+  scratch.capacity = 0;
+  scratch.used = 0;
+}
+
+void *
+mrb_sdl2_scratch_alloc(mrb_state *mrb, size_t size)
+{
+  mrb_sdl2_scratch_block_t *block = scratch.head;
+  uint8_t *ptr;
+  size = (size + MRB_SDL2_SCRATCH_ALIGN - 1) & ~(size_t)(MRB_SDL2_SCRATCH_ALIGN - 1);
+  if ((NULL == block) || (block->size - block->used < size)) {
+    size_t block_size = MRB_SDL2_SCRATCH_BLOCK_SIZE;
+    if ((NULL != block) && (block_size < block->size * 2)) {
+      block_size = block->size * 2;
+    }
+    if (block_size < size) {
+      block_size = size;
+    }
+    block = mrb_sdl2_scratch_new_block(block_size);
+    if (NULL == block) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+  }
+  ptr = (uint8_t*)block + MRB_SDL2_SCRATCH_HEADER_SIZE + block->used;
+  block->used  += size;
+  scratch.used += size;
+  if (scratch.high_water < scratch.used) {
+    scratch.high_water = scratch.used;
+  }
+  if (scratch.frame_peak < scratch.used) {
+    scratch.frame_peak = scratch.used;
+  }
+  return ptr;
+}
+
+mrb_sdl2_scratch_mark_t
+mrb_sdl2_scratch_mark(void)
+{
+  mrb_sdl2_scratch_mark_t mark;
+  mark.block = scratch.head;
+  mark.used  = (NULL != scratch.head) ? scratch.head->used : 0;
+  return mark;
+}
+
+void
+mrb_sdl2_scratch_release(mrb_sdl2_scratch_mark_t mark)
+{
+  /* blocks added after the mark only hold memory taken since then */
+  while ((NULL != scratch.head) && (mark.block != scratch.head)) {
+    mrb_sdl2_scratch_block_t *prev = scratch.head->prev;
+    scratch.used     -= scratch.head->used;
+    scratch.capacity -= scratch.head->size;
+    SDL_free(scratch.head);
+    scratch.head = prev;
+  }
+  if ((NULL != scratch.head) && (mark.used <= scratch.head->used)) {
+    scratch.used -= scratch.head->used - mark.used;
+    scratch.head->used = mark.used;
+  }
+}
+
+void
+mrb_sdl2_scratch_reset(void)
+{
+  size_t const size = SDL_min(scratch.frame_peak, (size_t)MRB_SDL2_SCRATCH_RETAIN_MAX);
+  mrb_sdl2_scratch_block_t *head = scratch.head;
+  if ((NULL != head) && (NULL == head->prev) && (size <= head->size) &&
+      (head->size <= MRB_SDL2_SCRATCH_RETAIN_MAX)) {
+    head->used = 0;
+  } else {
+    mrb_sdl2_scratch_free_blocks();
+    if (0 < size) {
+      mrb_sdl2_scratch_new_block(SDL_max(size, (size_t)MRB_SDL2_SCRATCH_BLOCK_SIZE));
+    }
+  }
+  scratch.used       = 0;
+  scratch.frame_peak = 0;
+}
+
+static mrb_value
+mrb_sdl2_misc_scratch_reset(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_scratch_reset();
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_misc_scratch_stats(mrb_state *mrb, mrb_value self)
+{
+  mrb_value hash = mrb_hash_new(mrb);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "capacity")),          mrb_fixnum_value((mrb_int)scratch.capacity));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "used")),              mrb_fixnum_value((mrb_int)scratch.used));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "high_water")),        mrb_fixnum_value((mrb_int)scratch.high_water));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "block_allocations")), mrb_fixnum_value((mrb_int)scratch.block_allocations));
+  return hash;
+}
+
+/***************************************************************************
+*
+* worker pool
+*
+* Fork/join helper for pixel kernels. The threads are started on first use
+* (SDL_GetCPUCount() - 1 of them) and sleep on `wakeup` between jobs. A job
+* is published under the mutex by bumping `generation`; everyone, including
+* the calling thread, then claims chunks through the atomic `next` counter
+* and the caller waits on `done` until every worker has checked back in.
+* Like the scratch arena the pool is process-global and is stopped by
+* mruby_sdl2_misc_final().
+*
+***************************************************************************/
+
+#define MRB_SDL2_PARALLEL_MAX_THREADS 31
+
+static struct {
+  bool                   started;
+  bool                   quit;
+  int                    nthreads;
+  SDL_Thread            *threads[MRB_SDL2_PARALLEL_MAX_THREADS];
+  SDL_mutex             *mutex;
+  SDL_cond              *wakeup;
+  SDL_cond              *done;
+  unsigned               generation;
+  int                    busy;
+  /* current job */
+  mrb_sdl2_parallel_fn_t fn;
+  void                  *ctx;
+  int                    count;
+  int                    chunk;
+  SDL_atomic_t           next;
+} pool;
+
+static void
+mrb_sdl2_parallel_run(int worker)
+{
+  for (;;) {
+    int const begin = SDL_AtomicAdd(&pool.next, pool.chunk);
+    if (begin >= pool.count) {
+      break;
+    }
+    pool.fn(pool.ctx, begin, SDL_min(begin + pool.chunk, pool.count), worker);
+  }
+}
+
+static int
+mrb_sdl2_parallel_thread(void *arg)
+{
+  int const worker = (int)(intptr_t)arg;
+  unsigned seen = 0;
+  SDL_LockMutex(pool.mutex);
+  for (;;) {
+    while (!pool.quit && (seen == pool.generation)) {
+      SDL_CondWait(pool.wakeup, pool.mutex);
+    }
+    if (pool.quit) {
+      break;
+    }
+    seen = pool.generation;
+    SDL_UnlockMutex(pool.mutex);
+    mrb_sdl2_parallel_run(worker);
+    SDL_LockMutex(pool.mutex);
+    if (0 == --pool.busy) {
+      SDL_CondSignal(pool.done);
+    }
+  }
+  SDL_UnlockMutex(pool.mutex);
+  return 0;
+}
+
+static void
+mrb_sdl2_parallel_start(void)
+{
+  int n = SDL_min(SDL_GetCPUCount() - 1, MRB_SDL2_PARALLEL_MAX_THREADS);
+  int i;
+  pool.started = true;
+  if (n <= 0) {
+    return;
+  }
+  pool.mutex  = SDL_CreateMutex();
+  pool.wakeup = SDL_CreateCond();
+  pool.done   = SDL_CreateCond();
+  if ((NULL == pool.mutex) || (NULL == pool.wakeup) || (NULL == pool.done)) {
+    return; /* everything runs on the calling thread */
+  }
+  for (i = 0; i < n; ++i) {
+    pool.threads[i] = SDL_CreateThread(mrb_sdl2_parallel_thread, "mrb-sdl2-pool", (void*)(intptr_t)(i + 1));
+    if (NULL == pool.threads[i]) {
+      break;
+    }
+  }
+  pool.nthreads = i;
+}
+
+static void
+mrb_sdl2_parallel_stop(void)
+{
+  int i;
+  if (0 < pool.nthreads) {
+    SDL_LockMutex(pool.mutex);
+    pool.quit = true;
+    SDL_CondBroadcast(pool.wakeup);
+    SDL_UnlockMutex(pool.mutex);
+    for (i = 0; i < pool.nthreads; ++i) {
+      SDL_WaitThread(pool.threads[i], NULL);
+    }
+  }
+  if (NULL != pool.done) {
+    SDL_DestroyCond(pool.done);
+  }
+  if (NULL != pool.wakeup) {
+    SDL_DestroyCond(pool.wakeup);
+  }
+  if (NULL != pool.mutex) {
+    SDL_DestroyMutex(pool.mutex);
+  }
+  SDL_memset(&pool, 0, sizeof(pool));
+}
+
+int
+mrb_sdl2_parallel_workers(void)
+{
+  if (!pool.started) {
+    mrb_sdl2_parallel_start();
+  }
+  return pool.nthreads + 1;
+}
+
+void
+mrb_sdl2_parallel_for(int count, int grain, mrb_sdl2_parallel_fn_t fn, void *ctx)
+{
+  int const workers = mrb_sdl2_parallel_workers();
+  if (count <= 0) {
+    return;
+  }
+  if (grain < 1) {
+    grain = 1;
+  }
+  if ((1 == workers) || (count <= grain)) {
+    fn(ctx, 0, count, 0);
+    return;
+  }
+  SDL_LockMutex(pool.mutex);
+  pool.fn    = fn;
+  pool.ctx   = ctx;
+  pool.count = count;
+  /* about four chunks per thread keeps uneven rows balanced */
+  pool.chunk = SDL_max(grain, count / (workers * 4));
+  SDL_AtomicSet(&pool.next, 0);
+  pool.busy  = pool.nthreads;
+  pool.generation++;
+  SDL_CondBroadcast(pool.wakeup);
+  SDL_UnlockMutex(pool.mutex);
+  mrb_sdl2_parallel_run(0);
+  SDL_LockMutex(pool.mutex);
+  while (0 < pool.busy) {
+    SDL_CondWait(pool.done, pool.mutex);
+  }
+  SDL_UnlockMutex(pool.mutex);
+}
+
 void
 mruby_sdl2_misc_init(mrb_state *mrb)
 {
+#if defined(MRB_SDL2_HAVE_AVX2_TARGET) && SDL_VERSION_ATLEAST(2, 0, 4)
+  has_avx2 = (SDL_HasAVX2() == SDL_TRUE);
+#endif
   class_Buffer      = mrb_define_class_under(mrb, mod_SDL2, "Buffer",      mrb->object_class);
   class_FloatBuffer = mrb_define_class_under(mrb, mod_SDL2, "FloatBuffer", class_Buffer);
   class_ByteBuffer  = mrb_define_class_under(mrb, mod_SDL2, "ByteBuffer",  class_Buffer);
@@ -486,10 +917,15 @@ mruby_sdl2_misc_init(mrb_state *mrb)
   mrb_define_method(mrb, class_ByteBuffer, "initialize", mrb_sdl2_misc_bytebuffer_initialize, MRB_ARGS_REQ(1));
   mrb_define_method(mrb, class_ByteBuffer, "[]",         mrb_sdl2_misc_bytebuffer_get_at,     MRB_ARGS_REQ(1));
   mrb_define_method(mrb, class_ByteBuffer, "[]=",        mrb_sdl2_misc_bytebuffer_set_at,     MRB_ARGS_REQ(2));
+
+  mrb_define_module_function(mrb, mod_SDL2, "scratch_reset", mrb_sdl2_misc_scratch_reset, MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, mod_SDL2, "scratch_stats", mrb_sdl2_misc_scratch_stats, MRB_ARGS_NONE());
 }
 
 void
 mruby_sdl2_misc_final(mrb_state *mrb)
 {
+  mrb_sdl2_parallel_stop();
+  mrb_sdl2_scratch_free_blocks();
 }
 
@@ -1,4 +1,5 @@
 #include "sdl2_rect.h"
+#include "misc.h"
 #include "mruby/data.h"
 #include "mruby/class.h"
 #include "mruby/variable.h"
@@ -6,6 +7,8 @@
 
 static struct RClass *class_Rect = NULL;
 static struct RClass *class_Point = NULL;
+static struct RClass *class_RectArray = NULL;
+static struct RClass *class_PointArray = NULL;
 
 typedef struct mrb_sdl2_rect_rect_data_t {
   SDL_Rect rect;
@@ -15,6 +18,18 @@ typedef struct mrb_sdl2_rect_point_data_t {
   SDL_Point point;
 } mrb_sdl2_rect_point_data_t;
 
+typedef struct mrb_sdl2_rect_rectarray_data_t {
+  SDL_Rect *rects;
+  mrb_int   size;
+  mrb_int   capa;
+} mrb_sdl2_rect_rectarray_data_t;
+
+typedef struct mrb_sdl2_rect_pointarray_data_t {
+  SDL_Point *points;
+  mrb_int    size;
+  mrb_int    capa;
+} mrb_sdl2_rect_pointarray_data_t;
+
 static void
 mrb_sdl2_rect_rect_data_free(mrb_state *mrb, void *p)
 {
@@ -35,6 +50,28 @@ mrb_sdl2_rect_point_data_free(mrb_state *mrb, void *p)
   }
 }
 
+static void
+mrb_sdl2_rect_rectarray_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_rect_rectarray_data_t *data =
+    (mrb_sdl2_rect_rectarray_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->rects);
+    mrb_free(mrb, data);
+  }
+}
+
+static void
+mrb_sdl2_rect_pointarray_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_rect_pointarray_data_t *data =
+    (mrb_sdl2_rect_pointarray_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->points);
+    mrb_free(mrb, data);
+  }
+}
+
 static struct mrb_data_type const mrb_sdl2_rect_rect_data_type = {
   "Rect", mrb_sdl2_rect_rect_data_free
 };
@@ -43,6 +80,14 @@ static struct mrb_data_type const mrb_sdl2_rect_point_data_type = {
   "Point", mrb_sdl2_rect_point_data_free
 };
 
+static struct mrb_data_type const mrb_sdl2_rect_rectarray_data_type = {
+  "RectArray", mrb_sdl2_rect_rectarray_data_free
+};
+
+static struct mrb_data_type const mrb_sdl2_rect_pointarray_data_type = {
+  "PointArray", mrb_sdl2_rect_pointarray_data_free
+};
+
 mrb_value
 mrb_sdl2_rect(mrb_state *mrb, int x, int y, int w, int h)
 {
@@ -117,6 +162,40 @@ mrb_sdl2_point_get_ptr(mrb_state *mrb, mrb_value point)
   return &data->point;
 }
 
+mrb_bool
+mrb_sdl2_rectarray_p(mrb_state *mrb, mrb_value value)
+{
+  return (mrb_type(value) == MRB_TT_DATA) && (DATA_TYPE(value) == &mrb_sdl2_rect_rectarray_data_type);
+}
+
+mrb_bool
+mrb_sdl2_pointarray_p(mrb_state *mrb, mrb_value value)
+{
+  return (mrb_type(value) == MRB_TT_DATA) && (DATA_TYPE(value) == &mrb_sdl2_rect_pointarray_data_type);
+}
+
+SDL_Rect *
+mrb_sdl2_rectarray_get_ptr(mrb_state *mrb, mrb_value array, mrb_int *size)
+{
+  mrb_sdl2_rect_rectarray_data_t *data =
+    (mrb_sdl2_rect_rectarray_data_t*)mrb_data_get_ptr(mrb, array, &mrb_sdl2_rect_rectarray_data_type);
+  if (NULL != size) {
+    *size = data->size;
+  }
+  return data->rects;
+}
+
+SDL_Point *
+mrb_sdl2_pointarray_get_ptr(mrb_state *mrb, mrb_value array, mrb_int *size)
+{
+  mrb_sdl2_rect_pointarray_data_t *data =
+    (mrb_sdl2_rect_pointarray_data_t*)mrb_data_get_ptr(mrb, array, &mrb_sdl2_rect_pointarray_data_type);
+  if (NULL != size) {
+    *size = data->size;
+  }
+  return data->points;
+}
+
 /***************************************************************************
 *
 * module SDL2::Rect
@@ -381,15 +460,27 @@ mrb_sdl2_rect_rect_enclose_points(mrb_state *mrb, mrb_value self)
   SDL_Rect * c;
   mrb_int i;
   SDL_Point * points;
+  SDL_bool enclosed;
+  mrb_sdl2_scratch_mark_t mark;
   mrb_get_args(mrb, "o*", &clip, &argv, &argc);
   c = mrb_sdl2_rect_get_ptr(mrb, clip);
-  points = (SDL_Point *) SDL_malloc(sizeof(SDL_Point) * argc);
-  //SDL_Point points[argc];
-  for (i = 0; i < argc; ++i) {
-    SDL_Point const * const p = mrb_sdl2_point_get_ptr(mrb, argv[i]);
-    points[i] = *p;
+  mark = mrb_sdl2_scratch_mark();
+  if ((1 == argc) && mrb_sdl2_pointarray_p(mrb, argv[0])) {
+    points = mrb_sdl2_pointarray_get_ptr(mrb, argv[0], &argc);
+  } else {
+    /* type check every argument before taking scratch memory */
+    for (i = 0; i < argc; ++i) {
+      mrb_sdl2_point_get_ptr(mrb, argv[i]);
+    }
+    points = (SDL_Point *) mrb_sdl2_scratch_alloc(mrb, sizeof(SDL_Point) * argc);
+    for (i = 0; i < argc; ++i) {
+      SDL_Point const * const p = mrb_sdl2_point_get_ptr(mrb, argv[i]);
+      points[i] = *p;
+    }
   }
-  return (SDL_FALSE == SDL_EnclosePoints(points, argc, c, &result)) ?
+  enclosed = SDL_EnclosePoints(points, argc, c, &result);
+  mrb_sdl2_scratch_release(mark);
+  return (SDL_FALSE == enclosed) ?
     mrb_nil_value() : mrb_sdl2_rect_direct(mrb, &result);
 }
 
@@ -465,14 +556,322 @@ mrb_sdl2_rect_point_set_y(mrb_state *mrb, mrb_value self)
   return self;
 }
 
+/***************************************************************************
+*
+* class SDL2::RectArray
+*
+***************************************************************************/
+
+static void
+mrb_sdl2_rect_rectarray_reserve(mrb_state *mrb, mrb_sdl2_rect_rectarray_data_t *data, mrb_int capa)
+{
+  if (capa > data->capa) {
+    mrb_int n = (0 < data->capa) ? data->capa : 16;
+    while (n < capa) {
+      n *= 2;
+    }
+    data->rects = (SDL_Rect*)mrb_realloc(mrb, data->rects, sizeof(SDL_Rect) * n);
+    data->capa  = n;
+  }
+}
+
+static void
+mrb_sdl2_rect_rectarray_resize(mrb_state *mrb, mrb_sdl2_rect_rectarray_data_t *data, mrb_int size)
+{
+  if (0 > size) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size.");
+  }
+  mrb_sdl2_rect_rectarray_reserve(mrb, data, size);
+  if (size > data->size) {
+    SDL_memset(data->rects + data->size, 0, sizeof(SDL_Rect) * (size - data->size));
+  }
+  data->size = size;
+}
+
+static mrb_sdl2_rect_rectarray_data_t *
+mrb_sdl2_rect_rectarray_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_rect_rectarray_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_rect_rectarray_data_type);
+}
+
+static SDL_Rect *
+mrb_sdl2_rect_rectarray_at(mrb_state *mrb, mrb_sdl2_rect_rectarray_data_t *data, mrb_int index)
+{
+  if (0 > index) {
+    index += data->size;
+  }
+  if ((0 > index) || (index >= data->size)) {
+    mrb_raise(mrb, E_INDEX_ERROR, "index out of bounds.");
+  }
+  return &data->rects[index];
+}
+
+/*
+ * Reads a rect from either (SDL2::Rect) or (x, y, w, h) arguments.
+ */
+static void
+mrb_sdl2_rect_rect_from_args(mrb_state *mrb, mrb_value *argv, mrb_int argc, SDL_Rect *rect)
+{
+  if (1 == argc) {
+    SDL_Rect const * const r = mrb_sdl2_rect_get_ptr(mrb, argv[0]);
+    if (NULL == r) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "cannot accept nil.");
+    }
+    *rect = *r;
+  } else if (4 == argc) {
+    rect->x = mrb_fixnum(mrb_Integer(mrb, argv[0]));
+    rect->y = mrb_fixnum(mrb_Integer(mrb, argv[1]));
+    rect->w = mrb_fixnum(mrb_Integer(mrb, argv[2]));
+    rect->h = mrb_fixnum(mrb_Integer(mrb, argv[3]));
+  } else {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments.");
+  }
+}
+
+static mrb_value
+mrb_sdl2_rect_rectarray_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_int size = 0;
+  mrb_sdl2_rect_rectarray_data_t *data =
+    (mrb_sdl2_rect_rectarray_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "|i", &size);
+  if (NULL == data) {
+    data = (mrb_sdl2_rect_rectarray_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_rect_rectarray_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+    data->rects = NULL;
+    data->size  = 0;
+    data->capa  = 0;
+  }
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_rect_rectarray_data_type;
+  mrb_sdl2_rect_rectarray_resize(mrb, data, size);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_rectarray_get_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_rect_rectarray_get_data(mrb, self)->size);
+}
+
+static mrb_value
+mrb_sdl2_rect_rectarray_set_size(mrb_state *mrb, mrb_value self)
+{
+  mrb_int size;
+  mrb_get_args(mrb, "i", &size);
+  mrb_sdl2_rect_rectarray_resize(mrb, mrb_sdl2_rect_rectarray_get_data(mrb, self), size);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_rectarray_clear(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_rect_rectarray_get_data(mrb, self)->size = 0;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_rectarray_push(mrb_state *mrb, mrb_value self)
+{
+  mrb_value *argv;
+  mrb_int argc;
+  SDL_Rect rect;
+  mrb_sdl2_rect_rectarray_data_t *data = mrb_sdl2_rect_rectarray_get_data(mrb, self);
+  mrb_get_args(mrb, "*", &argv, &argc);
+  mrb_sdl2_rect_rect_from_args(mrb, argv, argc, &rect);
+  mrb_sdl2_rect_rectarray_reserve(mrb, data, data->size + 1);
+  data->rects[data->size++] = rect;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_rectarray_get_at(mrb_state *mrb, mrb_value self)
+{
+  mrb_int index;
+  mrb_get_args(mrb, "i", &index);
+  return mrb_sdl2_rect_direct(mrb, mrb_sdl2_rect_rectarray_at(mrb, mrb_sdl2_rect_rectarray_get_data(mrb, self), index));
+}
+
+static mrb_value
+mrb_sdl2_rect_rectarray_set_at(mrb_state *mrb, mrb_value self)
+{
+  mrb_value *argv;
+  mrb_int argc;
+  mrb_int index;
+  SDL_Rect rect;
+  mrb_sdl2_rect_rectarray_data_t *data = mrb_sdl2_rect_rectarray_get_data(mrb, self);
+  mrb_get_args(mrb, "i*", &index, &argv, &argc);
+  mrb_sdl2_rect_rect_from_args(mrb, argv, argc, &rect);
+  *mrb_sdl2_rect_rectarray_at(mrb, data, index) = rect;
+  return self;
+}
+
+/***************************************************************************
+*
+* class SDL2::PointArray
+*
+***************************************************************************/
+
+static void
+mrb_sdl2_rect_pointarray_reserve(mrb_state *mrb, mrb_sdl2_rect_pointarray_data_t *data, mrb_int capa)
+{
+  if (capa > data->capa) {
+    mrb_int n = (0 < data->capa) ? data->capa : 16;
+    while (n < capa) {
+      n *= 2;
+    }
+    data->points = (SDL_Point*)mrb_realloc(mrb, data->points, sizeof(SDL_Point) * n);
+    data->capa   = n;
+  }
+}
+
+static void
+mrb_sdl2_rect_pointarray_resize(mrb_state *mrb, mrb_sdl2_rect_pointarray_data_t *data, mrb_int size)
+{
+  if (0 > size) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size.");
+  }
+  mrb_sdl2_rect_pointarray_reserve(mrb, data, size);
+  if (size > data->size) {
+    SDL_memset(data->points + data->size, 0, sizeof(SDL_Point) * (size - data->size));
+  }
+  data->size = size;
+}
+
+static mrb_sdl2_rect_pointarray_data_t *
+mrb_sdl2_rect_pointarray_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_rect_pointarray_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_rect_pointarray_data_type);
+}
+
+static SDL_Point *
+mrb_sdl2_rect_pointarray_at(mrb_state *mrb, mrb_sdl2_rect_pointarray_data_t *data, mrb_int index)
+{
+  if (0 > index) {
+    index += data->size;
+  }
+  if ((0 > index) || (index >= data->size)) {
+    mrb_raise(mrb, E_INDEX_ERROR, "index out of bounds.");
+  }
+  return &data->points[index];
+}
+
+/*
+ * Reads a point from either (SDL2::Point) or (x, y) arguments.
+ */
+static void
+mrb_sdl2_rect_point_from_args(mrb_state *mrb, mrb_value *argv, mrb_int argc, SDL_Point *point)
+{
+  if (1 == argc) {
+    SDL_Point const * const p = mrb_sdl2_point_get_ptr(mrb, argv[0]);
+    if (NULL == p) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "cannot accept nil.");
+    }
+    *point = *p;
+  } else if (2 == argc) {
+    point->x = mrb_fixnum(mrb_Integer(mrb, argv[0]));
+    point->y = mrb_fixnum(mrb_Integer(mrb, argv[1]));
+  } else {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments.");
+  }
+}
+
+static mrb_value
+mrb_sdl2_rect_pointarray_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_int size = 0;
+  mrb_sdl2_rect_pointarray_data_t *data =
+    (mrb_sdl2_rect_pointarray_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "|i", &size);
+  if (NULL == data) {
+    data = (mrb_sdl2_rect_pointarray_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_rect_pointarray_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+    data->points = NULL;
+    data->size   = 0;
+    data->capa   = 0;
+  }
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_rect_pointarray_data_type;
+  mrb_sdl2_rect_pointarray_resize(mrb, data, size);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_pointarray_get_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_rect_pointarray_get_data(mrb, self)->size);
+}
+
+static mrb_value
+mrb_sdl2_rect_pointarray_set_size(mrb_state *mrb, mrb_value self)
+{
+  mrb_int size;
+  mrb_get_args(mrb, "i", &size);
+  mrb_sdl2_rect_pointarray_resize(mrb, mrb_sdl2_rect_pointarray_get_data(mrb, self), size);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_pointarray_clear(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_rect_pointarray_get_data(mrb, self)->size = 0;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_pointarray_push(mrb_state *mrb, mrb_value self)
+{
+  mrb_value *argv;
+  mrb_int argc;
+  SDL_Point point;
+  mrb_sdl2_rect_pointarray_data_t *data = mrb_sdl2_rect_pointarray_get_data(mrb, self);
+  mrb_get_args(mrb, "*", &argv, &argc);
+  mrb_sdl2_rect_point_from_args(mrb, argv, argc, &point);
+  mrb_sdl2_rect_pointarray_reserve(mrb, data, data->size + 1);
+  data->points[data->size++] = point;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_rect_pointarray_get_at(mrb_state *mrb, mrb_value self)
+{
+  mrb_int index;
+  SDL_Point const *p;
+  mrb_get_args(mrb, "i", &index);
+  p = mrb_sdl2_rect_pointarray_at(mrb, mrb_sdl2_rect_pointarray_get_data(mrb, self), index);
+  return mrb_sdl2_point(mrb, p->x, p->y);
+}
+
+static mrb_value
+mrb_sdl2_rect_pointarray_set_at(mrb_state *mrb, mrb_value self)
+{
+  mrb_value *argv;
+  mrb_int argc;
+  mrb_int index;
+  SDL_Point point;
+  mrb_sdl2_rect_pointarray_data_t *data = mrb_sdl2_rect_pointarray_get_data(mrb, self);
+  mrb_get_args(mrb, "i*", &index, &argv, &argc);
+  mrb_sdl2_rect_point_from_args(mrb, argv, argc, &point);
+  *mrb_sdl2_rect_pointarray_at(mrb, data, index) = point;
+  return self;
+}
+
 void
 mruby_sdl2_rect_init(mrb_state *mrb)
 {
   class_Rect  = mrb_define_class_under(mrb, mod_SDL2, "Rect", mrb->object_class);
   class_Point = mrb_define_class_under(mrb, mod_SDL2, "Point", mrb->object_class);
+  class_RectArray  = mrb_define_class_under(mrb, mod_SDL2, "RectArray",  mrb->object_class);
+  class_PointArray = mrb_define_class_under(mrb, mod_SDL2, "PointArray", mrb->object_class);
 
   MRB_SET_INSTANCE_TT(class_Rect,  MRB_TT_DATA);
   MRB_SET_INSTANCE_TT(class_Point, MRB_TT_DATA);
+  MRB_SET_INSTANCE_TT(class_RectArray,  MRB_TT_DATA);
+  MRB_SET_INSTANCE_TT(class_PointArray, MRB_TT_DATA);
 
   mrb_define_method(mrb, class_Rect, "initialize",         mrb_sdl2_rect_rect_initialize,        MRB_ARGS_OPT(4));
   mrb_define_method(mrb, class_Rect, "x",                  mrb_sdl2_rect_rect_get_x,             MRB_ARGS_NONE());
@@ -499,6 +898,26 @@ mruby_sdl2_rect_init(mrb_state *mrb)
   mrb_define_method(mrb, class_Point, "x=",         mrb_sdl2_rect_point_set_x,      MRB_ARGS_REQ(1));
   mrb_define_method(mrb, class_Point, "y",          mrb_sdl2_rect_point_get_y,      MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Point, "y=",         mrb_sdl2_rect_point_set_y,      MRB_ARGS_REQ(1));
+
+  mrb_define_method(mrb, class_RectArray, "initialize", mrb_sdl2_rect_rectarray_initialize, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_RectArray, "size",       mrb_sdl2_rect_rectarray_get_size,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RectArray, "length",     mrb_sdl2_rect_rectarray_get_size,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RectArray, "resize",     mrb_sdl2_rect_rectarray_set_size,   MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_RectArray, "clear",      mrb_sdl2_rect_rectarray_clear,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RectArray, "push",       mrb_sdl2_rect_rectarray_push,       MRB_ARGS_REQ(1) | MRB_ARGS_OPT(3));
+  mrb_define_method(mrb, class_RectArray, "[]",         mrb_sdl2_rect_rectarray_get_at,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_RectArray, "[]=",        mrb_sdl2_rect_rectarray_set_at,     MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_RectArray, "set",        mrb_sdl2_rect_rectarray_set_at,     MRB_ARGS_REQ(2) | MRB_ARGS_OPT(3));
+
+  mrb_define_method(mrb, class_PointArray, "initialize", mrb_sdl2_rect_pointarray_initialize, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_PointArray, "size",       mrb_sdl2_rect_pointarray_get_size,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PointArray, "length",     mrb_sdl2_rect_pointarray_get_size,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PointArray, "resize",     mrb_sdl2_rect_pointarray_set_size,   MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_PointArray, "clear",      mrb_sdl2_rect_pointarray_clear,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PointArray, "push",       mrb_sdl2_rect_pointarray_push,       MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_PointArray, "[]",         mrb_sdl2_rect_pointarray_get_at,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_PointArray, "[]=",        mrb_sdl2_rect_pointarray_set_at,     MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_PointArray, "set",        mrb_sdl2_rect_pointarray_set_at,     MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
 }
 
 void
@@ -2,19 +2,139 @@
 #include "sdl2_video.h"
 #include "sdl2_rect.h"
 #include "sdl2_surface.h"
+#include "misc.h"
 #include "mruby/data.h"
 #include "mruby/class.h"
 #include "mruby/array.h"
 #include "mruby/string.h"
+#include "mruby/hash.h"
+#include "mruby/variable.h"
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
 
 static struct RClass *class_Renderer     = NULL;
 static struct RClass *class_Texture      = NULL;
 static struct RClass *class_PixelBuffer  = NULL;
 static struct RClass *class_RendererInfo = NULL;
+static struct RClass *class_DisplayList  = NULL;
+
+/*
+ * A recorded draw call. Rect fields are reused per kind: lines keep their
+ * end points in dst (x1, y1, w = x2, h = y2), points use dst.x/dst.y.
+ */
+typedef enum mrb_sdl2_video_render_cmd_kind_t {
+  MRB_SDL2_RENDER_CMD_COPY,
+  MRB_SDL2_RENDER_CMD_COPY_EX,
+  MRB_SDL2_RENDER_CMD_DRAW_LINE,
+  MRB_SDL2_RENDER_CMD_DRAW_POINT,
+  MRB_SDL2_RENDER_CMD_DRAW_RECT,
+  MRB_SDL2_RENDER_CMD_FILL_RECT
+} mrb_sdl2_video_render_cmd_kind_t;
+
+#define MRB_SDL2_RENDER_CMD_HAS_SRC    0x01
+#define MRB_SDL2_RENDER_CMD_HAS_DST    0x02
+#define MRB_SDL2_RENDER_CMD_HAS_CENTER 0x04
+
+typedef struct mrb_sdl2_video_render_cmd_t {
+  int32_t       layer;
+  uint32_t      seq;
+  SDL_Texture  *texture;
+  uint32_t      ref;   /* display lists: index of the Texture in __textures__ */
+  uint8_t       kind;
+  uint8_t       flags;
+  uint8_t       flip;
+  SDL_Color     color;
+  SDL_BlendMode blend;
+  SDL_Rect      src;
+  SDL_Rect      dst;
+  double        angle;
+  SDL_Point     center;
+} mrb_sdl2_video_render_cmd_t;
+
+typedef struct mrb_sdl2_video_render_cmdbuf_t {
+  mrb_sdl2_video_render_cmd_t *cmds;
+  mrb_int size;
+  mrb_int capa;
+} mrb_sdl2_video_render_cmdbuf_t;
+
+enum {
+  MRB_SDL2_RENDER_STATE_DRAW_COLOR = 0,
+  MRB_SDL2_RENDER_STATE_DRAW_BLEND,
+  MRB_SDL2_RENDER_STATE_TARGET,
+  MRB_SDL2_RENDER_STATE_CLIP_RECT,
+  MRB_SDL2_RENDER_STATE_VIEW_PORT,
+  MRB_SDL2_RENDER_STATE_COUNT
+};
+
+#define MRB_SDL2_RENDER_STATE_BIT(s) (1u << (s))
+#define MRB_SDL2_RENDER_STATE_ALL    (MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_COUNT) - 1u)
+
+/*
+ * Last state handed to SDL. A field is only trusted while its bit is set
+ * in `valid`; setters skip the SDL call when the new value matches.
+ */
+typedef struct mrb_sdl2_video_render_state_t {
+  uint32_t      valid;
+  SDL_Color     color;
+  SDL_BlendMode blend;
+  SDL_Texture  *target;
+  bool          has_clip_rect;
+  SDL_Rect      clip_rect;
+  bool          has_view_port;
+  SDL_Rect      view_port;
+  uint32_t      elided[MRB_SDL2_RENDER_STATE_COUNT];
+} mrb_sdl2_video_render_state_t;
+
+/* draw calls by kind, for Renderer#stats */
+enum {
+  MRB_SDL2_RENDER_CALL_CLEAR,
+  MRB_SDL2_RENDER_CALL_COPY,
+  MRB_SDL2_RENDER_CALL_COPY_EX,
+  MRB_SDL2_RENDER_CALL_DRAW_LINES,
+  MRB_SDL2_RENDER_CALL_DRAW_POINTS,
+  MRB_SDL2_RENDER_CALL_DRAW_RECTS,
+  MRB_SDL2_RENDER_CALL_FILL_RECTS,
+  MRB_SDL2_RENDER_CALL_COUNT
+};
+
+/*
+ * Per-frame counters of the SDL calls issued by the bindings, reset at
+ * present. `ticks` is performance counter time spent inside those calls.
+ */
+typedef struct mrb_sdl2_video_render_stats_t {
+  uint32_t     calls[MRB_SDL2_RENDER_CALL_COUNT];
+  uint32_t     primitives;
+  uint32_t     texture_binds;
+  uint32_t     state_calls;
+  uint32_t     texture_updates;
+  uint64_t     bytes_uploaded;
+  uint64_t     ticks;
+  SDL_Texture *last_texture;
+} mrb_sdl2_video_render_stats_t;
 
 typedef struct mrb_sdl2_video_renderer_data_t {
   SDL_Renderer *renderer;
+  mrb_sdl2_video_render_state_t state;
+  mrb_sdl2_video_render_stats_t stats;
+  mrb_sdl2_video_render_stats_t frame_stats; /* as of the last present */
+  /* deferred mode: draw calls are queued and sorted at flush/present */
+  bool          is_deferred;
+  int32_t       layer;
+  SDL_Color     draw_color;
+  SDL_BlendMode draw_blend;
+  SDL_Texture  *last_deferred_texture;
+  uint32_t      last_deferred_ref;
+  mrb_sdl2_video_render_cmdbuf_t deferred;
+  /* Renderer#record: draw calls go to `recording`, `saved` is put back */
+  mrb_sdl2_video_render_cmdbuf_t *recording;
+  struct {
+    bool          is_deferred;
+    int32_t       layer;
+    SDL_Color     draw_color;
+    SDL_BlendMode draw_blend;
+    SDL_Texture  *last_deferred_texture;
+  } saved;
 } mrb_sdl2_video_renderer_data_t;
 
 typedef struct mrb_sdl2_video_texture_data_t {
@@ -29,6 +149,11 @@ typedef struct mrb_sdl2_video_rendererinfo_data_t {
   SDL_RendererInfo info;
 } mrb_sdl2_video_rendererinfo_data_t;
 
+typedef struct mrb_sdl2_video_displaylist_data_t {
+  SDL_Renderer *renderer; /* the one it was recorded on */
+  mrb_sdl2_video_render_cmdbuf_t cmds;
+} mrb_sdl2_video_displaylist_data_t;
+
 static void
 mrb_sdl2_video_renderer_data_free(mrb_state *mrb, void *p)
 {
@@ -38,6 +163,7 @@ mrb_sdl2_video_renderer_data_free(mrb_state *mrb, void *p)
     if (NULL != data->renderer) {
       SDL_DestroyRenderer(data->renderer);
     }
+    mrb_free(mrb, data->deferred.cmds);
     mrb_free(mrb, data);
   }
 }
@@ -75,6 +201,17 @@ mrb_sdl2_video_rendererinfo_data_free(mrb_state *mrb, void *p)
   }
 }
 
+static void
+mrb_sdl2_video_displaylist_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_displaylist_data_t *data =
+    (mrb_sdl2_video_displaylist_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->cmds.cmds);
+    mrb_free(mrb, data);
+  }
+}
+
 static struct mrb_data_type const mrb_sdl2_video_renderer_data_type = {
   "Renderer", mrb_sdl2_video_renderer_data_free
 };
@@ -91,6 +228,208 @@ static struct mrb_data_type const mrb_sdl2_video_rendererinfo_data_type = {
   "RendererInfo", mrb_sdl2_video_rendererinfo_data_free
 };
 
+static struct mrb_data_type const mrb_sdl2_video_displaylist_data_type = {
+  "DisplayList", mrb_sdl2_video_displaylist_data_free
+};
+
+static void
+mrb_sdl2_video_renderer_data_init(mrb_sdl2_video_renderer_data_t *data, SDL_Renderer *renderer)
+{
+  data->renderer              = renderer;
+  SDL_memset(&data->state, 0, sizeof(data->state));
+  SDL_memset(&data->stats, 0, sizeof(data->stats));
+  SDL_memset(&data->frame_stats, 0, sizeof(data->frame_stats));
+  data->is_deferred           = false;
+  data->layer                 = 0;
+  data->draw_color            = (SDL_Color){ 0, 0, 0, SDL_ALPHA_OPAQUE };
+  data->draw_blend            = SDL_BLENDMODE_NONE;
+  data->last_deferred_texture = NULL;
+  data->last_deferred_ref     = 0;
+  data->deferred.cmds         = NULL;
+  data->deferred.size         = 0;
+  data->deferred.capa         = 0;
+  data->recording             = NULL;
+}
+
+static mrb_sdl2_video_renderer_data_t *
+mrb_sdl2_video_renderer_get_data(mrb_state *mrb, mrb_value renderer)
+{
+  return (mrb_sdl2_video_renderer_data_t*)mrb_data_get_ptr(mrb, renderer, &mrb_sdl2_video_renderer_data_type);
+}
+
+/*
+ * State setters: each one compares against the cached value and only calls
+ * into SDL when it differs, counting the calls it skipped.
+ */
+static inline bool
+mrb_sdl2_video_render_state_elide(mrb_sdl2_video_render_state_t *state, int which, bool same)
+{
+  if (same && (state->valid & MRB_SDL2_RENDER_STATE_BIT(which))) {
+    ++state->elided[which];
+    return true;
+  }
+  return false;
+}
+
+/* true when the cached value of `which` is known and equal to the new one */
+static inline bool
+mrb_sdl2_video_render_state_same(mrb_sdl2_video_render_state_t const *state, int which, bool same)
+{
+  return same && (state->valid & MRB_SDL2_RENDER_STATE_BIT(which));
+}
+
+static inline bool
+mrb_sdl2_video_render_state_rect_equal(bool has_lhs, SDL_Rect const *lhs, SDL_Rect const *rhs)
+{
+  if (NULL == rhs) {
+    return !has_lhs;
+  }
+  return has_lhs && SDL_RectEquals(lhs, rhs);
+}
+
+static inline Uint64
+mrb_sdl2_video_render_stats_begin(void)
+{
+  return SDL_GetPerformanceCounter();
+}
+
+static inline void
+mrb_sdl2_video_render_stats_state(mrb_sdl2_video_renderer_data_t *data, Uint64 begin)
+{
+  data->stats.ticks += SDL_GetPerformanceCounter() - begin;
+  ++data->stats.state_calls;
+}
+
+static inline void
+mrb_sdl2_video_render_stats_draw(mrb_sdl2_video_renderer_data_t *data, int call, mrb_int primitives, SDL_Texture *texture, Uint64 begin)
+{
+  mrb_sdl2_video_render_stats_t *stats = &data->stats;
+  stats->ticks += SDL_GetPerformanceCounter() - begin;
+  ++stats->calls[call];
+  stats->primitives += (uint32_t)primitives;
+  if ((NULL != texture) && (texture != stats->last_texture)) {
+    ++stats->texture_binds;
+    stats->last_texture = texture;
+  }
+}
+
+static int
+mrb_sdl2_video_renderer_apply_draw_color(mrb_sdl2_video_renderer_data_t *data, SDL_Color color)
+{
+  mrb_sdl2_video_render_state_t *state = &data->state;
+  Uint64 begin;
+  int result;
+  bool const same = (0 == SDL_memcmp(&state->color, &color, sizeof(color)));
+  if (mrb_sdl2_video_render_state_elide(state, MRB_SDL2_RENDER_STATE_DRAW_COLOR, same)) {
+    return 0;
+  }
+  state->valid &= ~MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_DRAW_COLOR);
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_SetRenderDrawColor(data->renderer, color.r, color.g, color.b, color.a);
+  mrb_sdl2_video_render_stats_state(data, begin);
+  if (0 != result) {
+    return -1;
+  }
+  state->color  = color;
+  state->valid |= MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_DRAW_COLOR);
+  return 0;
+}
+
+static int
+mrb_sdl2_video_renderer_apply_draw_blend(mrb_sdl2_video_renderer_data_t *data, SDL_BlendMode blend)
+{
+  mrb_sdl2_video_render_state_t *state = &data->state;
+  Uint64 begin;
+  int result;
+  if (mrb_sdl2_video_render_state_elide(state, MRB_SDL2_RENDER_STATE_DRAW_BLEND, state->blend == blend)) {
+    return 0;
+  }
+  state->valid &= ~MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_DRAW_BLEND);
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_SetRenderDrawBlendMode(data->renderer, blend);
+  mrb_sdl2_video_render_stats_state(data, begin);
+  if (0 != result) {
+    return -1;
+  }
+  state->blend  = blend;
+  state->valid |= MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_DRAW_BLEND);
+  return 0;
+}
+
+static int
+mrb_sdl2_video_renderer_apply_target(mrb_sdl2_video_renderer_data_t *data, SDL_Texture *target)
+{
+  mrb_sdl2_video_render_state_t *state = &data->state;
+  Uint64 begin;
+  int result;
+  if (mrb_sdl2_video_render_state_elide(state, MRB_SDL2_RENDER_STATE_TARGET, state->target == target)) {
+    return 0;
+  }
+  /* SDL swaps in the view port and clip rect of the new target. */
+  state->valid &= ~(MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_TARGET) |
+                    MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_CLIP_RECT) |
+                    MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_VIEW_PORT));
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_SetRenderTarget(data->renderer, target);
+  mrb_sdl2_video_render_stats_state(data, begin);
+  if (0 != result) {
+    return -1;
+  }
+  state->target = target;
+  state->valid |= MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_TARGET);
+  return 0;
+}
+
+static int
+mrb_sdl2_video_renderer_apply_clip_rect(mrb_sdl2_video_renderer_data_t *data, SDL_Rect const *rect)
+{
+  mrb_sdl2_video_render_state_t *state = &data->state;
+  Uint64 begin;
+  int result;
+  bool const same = mrb_sdl2_video_render_state_rect_equal(state->has_clip_rect, &state->clip_rect, rect);
+  if (mrb_sdl2_video_render_state_elide(state, MRB_SDL2_RENDER_STATE_CLIP_RECT, same)) {
+    return 0;
+  }
+  state->valid &= ~MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_CLIP_RECT);
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderSetClipRect(data->renderer, rect);
+  mrb_sdl2_video_render_stats_state(data, begin);
+  if (0 != result) {
+    return -1;
+  }
+  state->has_clip_rect = (NULL != rect);
+  if (NULL != rect) {
+    state->clip_rect = *rect;
+  }
+  state->valid |= MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_CLIP_RECT);
+  return 0;
+}
+
+static int
+mrb_sdl2_video_renderer_apply_view_port(mrb_sdl2_video_renderer_data_t *data, SDL_Rect const *rect)
+{
+  mrb_sdl2_video_render_state_t *state = &data->state;
+  Uint64 begin;
+  int result;
+  bool const same = mrb_sdl2_video_render_state_rect_equal(state->has_view_port, &state->view_port, rect);
+  if (mrb_sdl2_video_render_state_elide(state, MRB_SDL2_RENDER_STATE_VIEW_PORT, same)) {
+    return 0;
+  }
+  state->valid &= ~MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_VIEW_PORT);
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderSetViewport(data->renderer, rect);
+  mrb_sdl2_video_render_stats_state(data, begin);
+  if (0 != result) {
+    return -1;
+  }
+  state->has_view_port = (NULL != rect);
+  if (NULL != rect) {
+    state->view_port = *rect;
+  }
+  state->valid |= MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_VIEW_PORT);
+  return 0;
+}
+
 SDL_Renderer *
 mrb_sdl2_video_renderer_get_ptr(mrb_state *mrb, mrb_value renderer)
 {
@@ -147,7 +486,7 @@ mrb_sdl2_video_renderer(mrb_state *mrb, SDL_Renderer *renderer)
   if (NULL == data) {
     mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
   }
-  data->renderer = renderer;
+  mrb_sdl2_video_renderer_data_init(data, renderer);
   return mrb_obj_value(Data_Wrap_Struct(mrb, class_Renderer, &mrb_sdl2_video_renderer_data_type, data));
 }
 
@@ -163,6 +502,18 @@ mrb_sdl2_video_texture(mrb_state *mrb, SDL_Texture *texture)
   return mrb_obj_value(Data_Wrap_Struct(mrb, class_Texture, &mrb_sdl2_video_texture_data_type, data));
 }
 
+/*
+ * Wraps a texture created on `renderer`. Destroying it then flushes the
+ * draws the renderer still has queued, as for Texture.new.
+ */
+mrb_value
+mrb_sdl2_video_renderer_texture(mrb_state *mrb, mrb_value renderer, SDL_Texture *texture)
+{
+  mrb_value const obj = mrb_sdl2_video_texture(mrb, texture);
+  mrb_iv_set(mrb, obj, mrb_intern_lit(mrb, "__renderer__"), renderer);
+  return obj;
+}
+
 mrb_value
 mrb_sdl2_video_rendererinfo(mrb_state *mrb, SDL_RendererInfo *info)
 {
@@ -183,6 +534,309 @@ mrb_sdl2_video_rendererinfo(mrb_state *mrb, SDL_RendererInfo *info)
 *
 ***************************************************************************/
 
+/*
+ * Grows the buffer to hold n more commands, so callers holding a scratch
+ * mark can push that many without raising.
+ */
+static void
+mrb_sdl2_video_render_cmdbuf_reserve(mrb_state *mrb, mrb_sdl2_video_render_cmdbuf_t *buf, mrb_int n)
+{
+  mrb_int capa = (0 < buf->capa) ? buf->capa : 256;
+  if (buf->size + n <= buf->capa) {
+    return;
+  }
+  while (capa < buf->size + n) {
+    capa *= 2;
+  }
+  buf->cmds = (mrb_sdl2_video_render_cmd_t*)mrb_realloc(mrb, buf->cmds, sizeof(mrb_sdl2_video_render_cmd_t) * capa);
+  buf->capa = capa;
+}
+
+static mrb_sdl2_video_render_cmd_t *
+mrb_sdl2_video_render_cmdbuf_push(mrb_state *mrb, mrb_sdl2_video_render_cmdbuf_t *buf)
+{
+  mrb_sdl2_video_render_cmd_t *cmd;
+  mrb_sdl2_video_render_cmdbuf_reserve(mrb, buf, 1);
+  cmd = &buf->cmds[buf->size];
+  SDL_memset(cmd, 0, sizeof(*cmd));
+  cmd->seq = (uint32_t)buf->size++;
+  return cmd;
+}
+
+static void
+mrb_sdl2_video_render_cmd_set_rects(mrb_sdl2_video_render_cmd_t *cmd, SDL_Rect const *sr, SDL_Rect const *dr)
+{
+  if (NULL != sr) {
+    cmd->flags |= MRB_SDL2_RENDER_CMD_HAS_SRC;
+    cmd->src = *sr;
+  }
+  if (NULL != dr) {
+    cmd->flags |= MRB_SDL2_RENDER_CMD_HAS_DST;
+    cmd->dst = *dr;
+  }
+}
+
+static int
+mrb_sdl2_video_render_cmd_compare(void const *lhs, void const *rhs)
+{
+  mrb_sdl2_video_render_cmd_t const *a = (mrb_sdl2_video_render_cmd_t const *)lhs;
+  mrb_sdl2_video_render_cmd_t const *b = (mrb_sdl2_video_render_cmd_t const *)rhs;
+  if (a->layer != b->layer) {
+    return (a->layer < b->layer) ? -1 : 1;
+  }
+  if (a->texture != b->texture) {
+    return ((uintptr_t)a->texture < (uintptr_t)b->texture) ? -1 : 1;
+  }
+  if (a->blend != b->blend) {
+    return (a->blend < b->blend) ? -1 : 1;
+  }
+  return (a->seq < b->seq) ? -1 : (a->seq > b->seq);
+}
+
+/*
+ * Issues recorded commands in order, translated by (dx, dy). Draw color and
+ * blend mode go through the state cache, and runs of filled rects sharing
+ * a color are merged into one SDL_RenderFillRects.
+ */
+static int
+mrb_sdl2_video_render_cmds_submit(mrb_state *mrb, mrb_sdl2_video_renderer_data_t *data, mrb_sdl2_video_render_cmd_t const *cmds, mrb_int n, int dx, int dy)
+{
+  mrb_int i, j;
+  SDL_Renderer *renderer = data->renderer;
+  int result = 0;
+  for (i = 0; (0 == result) && (i < n); ++i) {
+    mrb_sdl2_video_render_cmd_t const *cmd = &cmds[i];
+    SDL_Rect dst = cmd->dst;
+    Uint64 begin;
+    mrb_int primitives = 1;
+    int call;
+    dst.x += dx;
+    dst.y += dy;
+    if ((MRB_SDL2_RENDER_CMD_COPY != cmd->kind) && (MRB_SDL2_RENDER_CMD_COPY_EX != cmd->kind)) {
+      result = mrb_sdl2_video_renderer_apply_draw_blend(data, cmd->blend);
+      if (0 == result) {
+        result = mrb_sdl2_video_renderer_apply_draw_color(data, cmd->color);
+      }
+      if (0 != result) {
+        break;
+      }
+    }
+    begin = mrb_sdl2_video_render_stats_begin();
+    switch (cmd->kind) {
+    case MRB_SDL2_RENDER_CMD_COPY:
+      call = MRB_SDL2_RENDER_CALL_COPY;
+      result = SDL_RenderCopy(renderer, cmd->texture,
+                              (cmd->flags & MRB_SDL2_RENDER_CMD_HAS_SRC) ? &cmd->src : NULL,
+                              (cmd->flags & MRB_SDL2_RENDER_CMD_HAS_DST) ? &dst : NULL);
+      break;
+    case MRB_SDL2_RENDER_CMD_COPY_EX:
+      call = MRB_SDL2_RENDER_CALL_COPY_EX;
+      result = SDL_RenderCopyEx(renderer, cmd->texture,
+                                (cmd->flags & MRB_SDL2_RENDER_CMD_HAS_SRC) ? &cmd->src : NULL,
+                                (cmd->flags & MRB_SDL2_RENDER_CMD_HAS_DST) ? &dst : NULL,
+                                cmd->angle,
+                                (cmd->flags & MRB_SDL2_RENDER_CMD_HAS_CENTER) ? &cmd->center : NULL,
+                                (SDL_RendererFlip)cmd->flip);
+      break;
+    case MRB_SDL2_RENDER_CMD_DRAW_LINE:
+      call = MRB_SDL2_RENDER_CALL_DRAW_LINES;
+      result = SDL_RenderDrawLine(renderer, dst.x, dst.y, cmd->dst.w + dx, cmd->dst.h + dy);
+      break;
+    case MRB_SDL2_RENDER_CMD_DRAW_POINT:
+      call = MRB_SDL2_RENDER_CALL_DRAW_POINTS;
+      result = SDL_RenderDrawPoint(renderer, dst.x, dst.y);
+      break;
+    case MRB_SDL2_RENDER_CMD_DRAW_RECT:
+      call = MRB_SDL2_RENDER_CALL_DRAW_RECTS;
+      result = SDL_RenderDrawRect(renderer, (cmd->flags & MRB_SDL2_RENDER_CMD_HAS_DST) ? &dst : NULL);
+      break;
+    case MRB_SDL2_RENDER_CMD_FILL_RECT:
+      call = MRB_SDL2_RENDER_CALL_FILL_RECTS;
+      if (!(cmd->flags & MRB_SDL2_RENDER_CMD_HAS_DST)) {
+        result = SDL_RenderFillRect(renderer, NULL);
+        break;
+      }
+      for (j = i + 1; j < n; ++j) {
+        mrb_sdl2_video_render_cmd_t const *next = &cmds[j];
+        if ((MRB_SDL2_RENDER_CMD_FILL_RECT != next->kind) ||
+            !(next->flags & MRB_SDL2_RENDER_CMD_HAS_DST) ||
+            (next->blend != cmd->blend) ||
+            (0 != SDL_memcmp(&next->color, &cmd->color, sizeof(SDL_Color)))) {
+          break;
+        }
+      }
+      if (j - i > 1) {
+        /* scoped to the run, so nothing is held when the next one raises */
+        mrb_sdl2_scratch_mark_t const mark = mrb_sdl2_scratch_mark();
+        mrb_int k;
+        SDL_Rect *rects = (SDL_Rect*)mrb_sdl2_scratch_alloc(mrb, sizeof(SDL_Rect) * (j - i));
+        for (k = i; k < j; ++k) {
+          rects[k - i] = cmds[k].dst;
+          rects[k - i].x += dx;
+          rects[k - i].y += dy;
+        }
+        result = SDL_RenderFillRects(renderer, rects, (int)(j - i));
+        mrb_sdl2_scratch_release(mark);
+        primitives = j - i;
+        i = j - 1;
+      } else {
+        result = SDL_RenderFillRect(renderer, &dst);
+      }
+      break;
+    default:
+      continue;
+    }
+    mrb_sdl2_video_render_stats_draw(data, call, primitives, cmd->texture, begin);
+  }
+  return result;
+}
+
+/*
+ * The array keeping objects used by queued commands referenced: the
+ * renderer's until the flush, or the display list's being recorded. A
+ * display list's array only holds Textures, indexed by the commands' `ref`.
+ */
+static mrb_value
+mrb_sdl2_video_renderer_kept(mrb_state *mrb, mrb_value self, mrb_sdl2_video_renderer_data_t *data)
+{
+  mrb_value owner = self;
+  mrb_sym key = mrb_intern_lit(mrb, "__deferred_textures__");
+  mrb_value textures;
+  if (NULL != data->recording) {
+    owner = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__recording__"));
+    key   = mrb_intern_lit(mrb, "__textures__");
+  }
+  textures = mrb_iv_get(mrb, owner, key);
+  if (mrb_nil_p(textures)) {
+    textures = mrb_ary_new(mrb);
+    mrb_iv_set(mrb, owner, key, textures);
+  }
+  return textures;
+}
+
+/* keeps `obj` referenced for as long as the queued commands; returns its index */
+static uint32_t
+mrb_sdl2_video_renderer_keep(mrb_state *mrb, mrb_value self, mrb_sdl2_video_renderer_data_t *data, mrb_value obj)
+{
+  mrb_value const textures = mrb_sdl2_video_renderer_kept(mrb, self, data);
+  mrb_ary_push(mrb, textures, obj);
+  return (uint32_t)(RARRAY_LEN(textures) - 1);
+}
+
+/* the display list being recorded, otherwise the deferred buffer */
+static mrb_sdl2_video_render_cmdbuf_t *
+mrb_sdl2_video_renderer_defer_buf(mrb_sdl2_video_renderer_data_t *data)
+{
+  return (NULL != data->recording) ? data->recording : &data->deferred;
+}
+
+/*
+ * Appends a command to the deferred buffer (or the display list being
+ * recorded) with the current layer and draw state.
+ */
+static mrb_sdl2_video_render_cmd_t *
+mrb_sdl2_video_renderer_defer(mrb_state *mrb, mrb_value self, mrb_sdl2_video_renderer_data_t *data, uint8_t kind, mrb_value texture)
+{
+  mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_render_cmdbuf_push(mrb, mrb_sdl2_video_renderer_defer_buf(data));
+  cmd->kind  = kind;
+  cmd->layer = data->layer;
+  cmd->color = data->draw_color;
+  cmd->blend = data->draw_blend;
+  if (!mrb_nil_p(texture)) {
+    cmd->texture = mrb_sdl2_video_texture_get_ptr(mrb, texture);
+    if (cmd->texture != data->last_deferred_texture) {
+      data->last_deferred_ref     = mrb_sdl2_video_renderer_keep(mrb, self, data, texture);
+      data->last_deferred_texture = cmd->texture;
+    }
+    cmd->ref = data->last_deferred_ref;
+  }
+  return cmd;
+}
+
+/*
+ * Sorts the deferred commands by layer, texture and blend mode (stable) and
+ * submits them. The recorded draw state is restored afterwards.
+ */
+static void
+mrb_sdl2_video_renderer_flush_deferred(mrb_state *mrb, mrb_value self, mrb_sdl2_video_renderer_data_t *data)
+{
+  mrb_value textures;
+  int result;
+  if (0 == data->deferred.size) {
+    return;
+  }
+  qsort(data->deferred.cmds, data->deferred.size, sizeof(mrb_sdl2_video_render_cmd_t), mrb_sdl2_video_render_cmd_compare);
+  result = mrb_sdl2_video_render_cmds_submit(mrb, data, data->deferred.cmds, data->deferred.size, 0, 0);
+  if (0 == result) {
+    result = mrb_sdl2_video_renderer_apply_draw_blend(data, data->draw_blend);
+  }
+  if (0 == result) {
+    result = mrb_sdl2_video_renderer_apply_draw_color(data, data->draw_color);
+  }
+  data->deferred.size = 0;
+  data->last_deferred_texture = NULL;
+  textures = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__deferred_textures__"));
+  if (!mrb_nil_p(textures)) {
+    mrb_ary_resize(mrb, textures, 0);
+  }
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+}
+
+/*
+ * Flushes pending deferred commands before an operation that changes what
+ * they would draw onto (target, clip rect, view port, read back...).
+ */
+SDL_Renderer *
+mrb_sdl2_video_renderer_get_flushed_ptr(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  if (data->is_deferred) {
+    mrb_sdl2_video_renderer_flush_deferred(mrb, self, data);
+  }
+  return data->renderer;
+}
+
+/*
+ * Same as get_flushed_ptr, for draws made with SDL calls that a display
+ * list cannot capture: raises `message` inside Renderer#record.
+ */
+SDL_Renderer *
+mrb_sdl2_video_renderer_get_draw_ptr(mrb_state *mrb, mrb_value self, char const *message)
+{
+  if (NULL != mrb_sdl2_video_renderer_get_data(mrb, self)->recording) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, message);
+  }
+  return mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+}
+
+/*
+ * Must follow SDL calls made on the renderer outside these bindings, so
+ * the state cache does not skip a setter SDL has not actually seen.
+ */
+void
+mrb_sdl2_video_renderer_invalidate_state(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_renderer_get_data(mrb, self)->state.valid = 0;
+}
+
+/*
+ * For helpers that change the draw color or blend mode behind the
+ * bindings: forgets the cached state and puts back the draw color and
+ * blend mode last set through the Renderer.
+ */
+void
+mrb_sdl2_video_renderer_restore_state(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  data->state.valid = 0;
+  if ((0 != mrb_sdl2_video_renderer_apply_draw_blend(data, data->draw_blend)) ||
+      (0 != mrb_sdl2_video_renderer_apply_draw_color(data, data->draw_color))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+}
+
 /*
  * SDL2::Video::Renderer.initialize
  */
@@ -203,7 +857,7 @@ mrb_sdl2_video_renderer_initialize(mrb_state *mrb, mrb_value self)
     if (NULL == data) {
       mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
     }
-    data->renderer = NULL;
+    mrb_sdl2_video_renderer_data_init(data, NULL);
   }
   if (mrb_obj_is_instance_of(mrb, obj, mrb_class_get_under(mrb, mod_Video, "Window"))) {
     SDL_Window *window = mrb_sdl2_video_window_get_ptr(mrb, obj);
@@ -237,6 +891,10 @@ mrb_sdl2_video_renderer_destroy(mrb_state *mrb, mrb_value self)
     SDL_DestroyRenderer(data->renderer);
     data->renderer = NULL;
   }
+  data->deferred.size = 0;
+  data->last_deferred_texture = NULL;
+  data->state.valid = 0;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__deferred_textures__"), mrb_nil_value());
   return self;
 }
 
@@ -244,8 +902,11 @@ static mrb_value
 mrb_sdl2_video_renderer_get_draw_blend_mode(mrb_state *mrb, mrb_value self)
 {
   SDL_BlendMode mode;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  if (0 != SDL_GetRenderDrawBlendMode(renderer, &mode)) {
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  if (data->is_deferred) {
+    return mrb_fixnum_value(data->draw_blend);
+  }
+  if (0 != SDL_GetRenderDrawBlendMode(data->renderer, &mode)) {
     mruby_sdl2_raise_error(mrb);
   }
   return mrb_fixnum_value(mode);
@@ -255,9 +916,13 @@ static mrb_value
 mrb_sdl2_video_renderer_set_draw_blend_mode(mrb_state *mrb, mrb_value self)
 {
   mrb_int mode;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "i", &mode);
-  if (0 != SDL_SetRenderDrawBlendMode(renderer, (SDL_BlendMode)mode)) {
+  data->draw_blend = (SDL_BlendMode)mode;
+  if (data->is_deferred) {
+    return self;
+  }
+  if (0 != mrb_sdl2_video_renderer_apply_draw_blend(data, (SDL_BlendMode)mode)) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -268,8 +933,13 @@ mrb_sdl2_video_renderer_get_draw_color(mrb_state *mrb, mrb_value self)
 {
   uint8_t r, g, b, a;
   mrb_value rgba[4];
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  if (0 != SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a)) {
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  if (data->is_deferred) {
+    r = data->draw_color.r;
+    g = data->draw_color.g;
+    b = data->draw_color.b;
+    a = data->draw_color.a;
+  } else if (0 != SDL_GetRenderDrawColor(data->renderer, &r, &g, &b, &a)) {
     mruby_sdl2_raise_error(mrb);
   }
   rgba[0] = mrb_fixnum_value(r);
@@ -284,12 +954,16 @@ static mrb_value
 mrb_sdl2_video_renderer_set_draw_color(mrb_state *mrb, mrb_value self)
 {
   mrb_int r, g, b, a;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   int argc = mrb_get_args(mrb, "iii|i", &r, &g, &b, &a);
   if (argc != 4) {
     a = SDL_ALPHA_OPAQUE;
   }
-  if (0 != SDL_SetRenderDrawColor(renderer, r, g, b, a)) {
+  data->draw_color = (SDL_Color){ (Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a };
+  if (data->is_deferred) {
+    return self;
+  }
+  if (0 != mrb_sdl2_video_renderer_apply_draw_color(data, data->draw_color)) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -300,15 +974,26 @@ mrb_sdl2_video_renderer_set_target(mrb_state *mrb, mrb_value self)
 {
   mrb_value arg;
   SDL_Texture *texture;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "o", &arg);
   texture = mrb_sdl2_video_texture_get_ptr(mrb, arg);
-  if (0 != SDL_SetRenderTarget(renderer, texture)) {
+  if (!mrb_sdl2_video_render_state_same(&data->state, MRB_SDL2_RENDER_STATE_TARGET, data->state.target == texture)) {
+    mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+  }
+  if (0 != mrb_sdl2_video_renderer_apply_target(data, texture)) {
     mruby_sdl2_raise_error(mrb);
   }
+  /* keeps the target texture alive while it is drawn to */
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__target__"), arg);
   return self;
 }
 
+static mrb_value
+mrb_sdl2_video_renderer_get_target(mrb_state *mrb, mrb_value self)
+{
+  return mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__target__"));
+}
+
 static mrb_value
 mrb_sdl2_video_renderer_get_info(mrb_state *mrb, mrb_value self)
 {
@@ -323,8 +1008,11 @@ mrb_sdl2_video_renderer_get_info(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_sdl2_video_renderer_clear(mrb_state *mrb, mrb_value self)
 {
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  if (0 != SDL_RenderClear(renderer)) {
+  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+  Uint64 const begin = mrb_sdl2_video_render_stats_begin();
+  int const result = SDL_RenderClear(renderer);
+  mrb_sdl2_video_render_stats_draw(mrb_sdl2_video_renderer_get_data(mrb, self), MRB_SDL2_RENDER_CALL_CLEAR, 1, NULL, begin);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -337,16 +1025,26 @@ mrb_sdl2_video_renderer_copy(mrb_state *mrb, mrb_value self)
   SDL_Rect const *dr = NULL;
   mrb_value texture, src_rect, dst_rect;
   SDL_Texture *t;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  Uint64 begin;
+  int result;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   int const argc = mrb_get_args(mrb, "o|oo", &texture, &src_rect, &dst_rect);
-  t = mrb_sdl2_video_texture_get_ptr(mrb, texture);
   if (argc > 1) {
     sr = mrb_sdl2_rect_get_ptr(mrb, src_rect);
   }
   if (argc > 2) {
     dr = mrb_sdl2_rect_get_ptr(mrb, dst_rect);
   }
-  if (0 != SDL_RenderCopy(renderer, t, sr, dr)) {
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_COPY, texture);
+    mrb_sdl2_video_render_cmd_set_rects(cmd, sr, dr);
+    return self;
+  }
+  t = mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderCopy(data->renderer, t, sr, dr);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_COPY, 1, t, begin);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -358,16 +1056,17 @@ mrb_sdl2_video_renderer_copy_ex(mrb_state *mrb, mrb_value self)
   mrb_value texture, src_rect, dst_rect, center;
   mrb_float angle;
   mrb_int flip;
-  SDL_Renderer *renderer;
+  mrb_sdl2_video_renderer_data_t *data;
   SDL_Texture *t;
   SDL_Rect const *sr = NULL;
   SDL_Rect const *dr = NULL;
   double a = 0;
   SDL_Point *c = NULL;
   SDL_RendererFlip f = SDL_FLIP_NONE;
+  Uint64 begin;
+  int result;
   int const argc = mrb_get_args(mrb, "o|oofoi", &texture, &src_rect, &dst_rect, &angle, &center, &flip);
-  renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  t = mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  data = mrb_sdl2_video_renderer_get_data(mrb, self);
   if (argc > 1) {
     sr = mrb_sdl2_rect_get_ptr(mrb, src_rect);
   }
@@ -383,77 +1082,253 @@ mrb_sdl2_video_renderer_copy_ex(mrb_state *mrb, mrb_value self)
   if (argc > 5) {
     f = (SDL_RendererFlip)flip;
   }
-  if (0 != SDL_RenderCopyEx(renderer, t, sr, dr, a, c, f)) {
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_COPY_EX, texture);
+    mrb_sdl2_video_render_cmd_set_rects(cmd, sr, dr);
+    cmd->angle = a;
+    cmd->flip  = (uint8_t)f;
+    if (NULL != c) {
+      cmd->flags |= MRB_SDL2_RENDER_CMD_HAS_CENTER;
+      cmd->center = *c;
+    }
+    return self;
+  }
+  t = mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderCopyEx(data->renderer, t, sr, dr, a, c, f);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_COPY_EX, 1, t, begin);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
 }
 
-static mrb_value
-mrb_sdl2_video_renderer_draw_line(mrb_state *mrb, mrb_value self)
+/*
+ * Resolves a packed argument (String or SDL2::Buffer) to raw memory holding
+ * `count` records of `record_size` bytes. A nil count means "as many whole
+ * records as the buffer holds".
+ */
+static uint8_t const *
+mrb_sdl2_video_renderer_packed_records(mrb_state *mrb, mrb_value buffer, mrb_value count, size_t record_size, mrb_int *n)
 {
-  mrb_value p1, p2;
-  SDL_Point * point1;
-  SDL_Point * point2;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  mrb_get_args(mrb, "oo", &p1, &p2);
-  point1 = mrb_sdl2_point_get_ptr(mrb, p1);
-  point2 = mrb_sdl2_point_get_ptr(mrb, p2);
-  if (0 != SDL_RenderDrawLine(renderer, point1->x, point1->y, point2->x, point2->y)) {
-    mruby_sdl2_raise_error(mrb);
+  size_t size;
+  uint8_t const *ptr = (uint8_t const *)mrb_sdl2_misc_bytes_get_ptr(mrb, buffer, &size);
+  if (mrb_nil_p(count)) {
+    *n = (mrb_int)(size / record_size);
+  } else {
+    if (!mrb_fixnum_p(count)) {
+      mrb_raise(mrb, E_TYPE_ERROR, "given count is unexpected type (expected Fixnum).");
+    }
+    *n = mrb_fixnum(count);
+    if ((*n < 0) || ((size_t)*n > size / record_size)) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "buffer is too small for given count.");
+    }
   }
-  return self;
+  return ptr;
 }
 
+/*
+ * SDL2::Video::Renderer#copy_batch(texture, buffer, count = nil)
+ *
+ * Copies `count` sprites of one texture in a single call. Each record of
+ * the buffer is 8 packed int32 values: src x, y, w, h, dst x, y, w, h.
+ * A source rect with zero width or height stands for the whole texture.
+ */
 static mrb_value
-mrb_sdl2_video_renderer_draw_lines(mrb_state *mrb, mrb_value self)
+mrb_sdl2_video_renderer_copy_batch(mrb_state *mrb, mrb_value self)
 {
-  SDL_Point * points;
-  mrb_value *argv;
-  mrb_int argc;
-  mrb_int i;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  mrb_get_args(mrb, "*", &argv, &argc);
-  points = (SDL_Point *) SDL_malloc(sizeof(SDL_Point) * argc);
-  for (i = 0; i < argc; ++i) {
-    SDL_Point * p;
-    p = mrb_sdl2_point_get_ptr(mrb, argv[i]);
-    if (NULL != p) {
-      points[i] = *p;
+  mrb_value texture, buffer;
+  mrb_value count = mrb_nil_value();
+  uint8_t const *records;
+  SDL_Texture *t;
+  SDL_Rect r[2];
+  mrb_int i, n;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "oo|o", &texture, &buffer, &count);
+  t = mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  records = mrb_sdl2_video_renderer_packed_records(mrb, buffer, count, sizeof(r), &n);
+  for (i = 0; i < n; ++i) {
+    SDL_Rect const *sr;
+    SDL_memcpy(r, records + i * sizeof(r), sizeof(r));
+    sr = ((0 < r[0].w) && (0 < r[0].h)) ? &r[0] : NULL;
+    if (data->is_deferred) {
+      mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_COPY, texture);
+      mrb_sdl2_video_render_cmd_set_rects(cmd, sr, &r[1]);
     } else {
-      points[i] = (SDL_Point){ 0, 0 };
+      Uint64 const begin = mrb_sdl2_video_render_stats_begin();
+      int const result = SDL_RenderCopy(data->renderer, t, sr, &r[1]);
+      mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_COPY, 1, t, begin);
+      if (0 != result) {
+        mruby_sdl2_raise_error(mrb);
+      }
     }
   }
-  if (0 != SDL_RenderDrawLines(renderer, points, argc)) {
-    mruby_sdl2_raise_error(mrb);
-  }
   return self;
 }
 
+/* well inside int range, so that x + w cannot overflow in SDL either */
+#define MRB_SDL2_RENDER_COORD_MAX 1073741823.0f
+
+/* v must be finite */
+static inline int
+mrb_sdl2_video_renderer_round(float v)
+{
+  v = SDL_min(SDL_max(v, -MRB_SDL2_RENDER_COORD_MAX), MRB_SDL2_RENDER_COORD_MAX);
+  return (int)((v < 0.0f) ? (v - 0.5f) : (v + 0.5f));
+}
+
+static inline Uint8
+mrb_sdl2_video_renderer_clamp_byte(float v)
+{
+  return (v <= 0.0f) ? 0 : ((v >= 255.0f) ? 255 : (Uint8)(v + 0.5f));
+}
+
+/*
+ * SDL2::Video::Renderer#copy_ex_batch(texture, buffer, count = nil)
+ *
+ * Rotated, flipped and tinted copies of one texture in a single call. Each
+ * record is 16 packed floats: src x, y, w, h, dst x, y, w, h, angle,
+ * center x, center y, flip, color mod r, g, b and alpha mod (0-255). A src
+ * with zero width or height is the whole texture, and a NaN center is the
+ * middle of dst. Color and alpha mod are only set when they differ from
+ * the previous sprite; the texture's own modulation is put back at the end.
+ * Queued deferred draw calls are flushed first, as the batch is not queued.
+ * Raises ArgumentError, before drawing anything, when a record holds NaN or
+ * infinity anywhere but in a NaN center.
+ */
 static mrb_value
-mrb_sdl2_video_renderer_draw_point(mrb_state *mrb, mrb_value self)
+mrb_sdl2_video_renderer_copy_ex_batch(mrb_state *mrb, mrb_value self)
 {
-  mrb_value p;
-  SDL_Point * point;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  mrb_get_args(mrb, "o", &p);
-  point = mrb_sdl2_point_get_ptr(mrb, p);
-  if (0 != SDL_RenderDrawPoint(renderer, point->x, point->y)) {
+  mrb_value texture, buffer;
+  mrb_value count = mrb_nil_value();
+  uint8_t const *records;
+  SDL_Renderer *renderer;
+  SDL_Texture *t;
+  Uint8 base[4], mod[4];
+  float f[16];
+  mrb_int i, n;
+  int result = 0;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "oo|o", &texture, &buffer, &count);
+  if (NULL != data->recording) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "copy_ex_batch cannot be recorded.");
+  }
+  t = mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  records = mrb_sdl2_video_renderer_packed_records(mrb, buffer, count, sizeof(f), &n);
+  for (i = 0; i < n; ++i) {
+    int k;
+    SDL_memcpy(f, records + i * sizeof(f), sizeof(f));
+    for (k = 0; k < 16; ++k) {
+      bool const nan_center = ((9 == k) || (10 == k)) && isnan(f[k]);
+      if (!isfinite(f[k]) && !nan_center) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "record values must be finite.");
+      }
+    }
+  }
+  renderer = mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+  if ((0 != SDL_GetTextureColorMod(t, &base[0], &base[1], &base[2])) ||
+      (0 != SDL_GetTextureAlphaMod(t, &base[3]))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  SDL_memcpy(mod, base, sizeof(mod));
+  for (i = 0; (0 == result) && (i < n); ++i) {
+    SDL_Rect sr, dr;
+    SDL_Point c;
+    SDL_Point const *center = NULL;
+    Uint8 want[4];
+    Uint64 begin;
+    int k, flip = SDL_FLIP_NONE;
+    SDL_memcpy(f, records + i * sizeof(f), sizeof(f));
+    for (k = 0; k < 4; ++k) {
+      want[k] = mrb_sdl2_video_renderer_clamp_byte(f[12 + k]);
+    }
+    if (0 != SDL_memcmp(want, mod, 3)) {
+      begin = mrb_sdl2_video_render_stats_begin();
+      result = SDL_SetTextureColorMod(t, want[0], want[1], want[2]);
+      mrb_sdl2_video_render_stats_state(data, begin);
+      SDL_memcpy(mod, want, 3);
+    }
+    if ((0 == result) && (want[3] != mod[3])) {
+      begin = mrb_sdl2_video_render_stats_begin();
+      result = SDL_SetTextureAlphaMod(t, want[3]);
+      mrb_sdl2_video_render_stats_state(data, begin);
+      mod[3] = want[3];
+    }
+    if (0 != result) {
+      break;
+    }
+    sr = (SDL_Rect){ mrb_sdl2_video_renderer_round(f[0]), mrb_sdl2_video_renderer_round(f[1]),
+                     mrb_sdl2_video_renderer_round(f[2]), mrb_sdl2_video_renderer_round(f[3]) };
+    dr = (SDL_Rect){ mrb_sdl2_video_renderer_round(f[4]), mrb_sdl2_video_renderer_round(f[5]),
+                     mrb_sdl2_video_renderer_round(f[6]), mrb_sdl2_video_renderer_round(f[7]) };
+    if (!isnan(f[9]) && !isnan(f[10])) {
+      c = (SDL_Point){ mrb_sdl2_video_renderer_round(f[9]), mrb_sdl2_video_renderer_round(f[10]) };
+      center = &c;
+    }
+    if (f[11] >= 1.0f) {
+      flip = (int)SDL_min(f[11], 3.0f) & (SDL_FLIP_HORIZONTAL | SDL_FLIP_VERTICAL);
+    }
+    begin = mrb_sdl2_video_render_stats_begin();
+    result = SDL_RenderCopyEx(renderer, t, ((0 < sr.w) && (0 < sr.h)) ? &sr : NULL, &dr, (double)f[8], center,
+                              (SDL_RendererFlip)flip);
+    mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_COPY_EX, 1, t, begin);
+  }
+  if (0 != SDL_memcmp(mod, base, 3)) {
+    SDL_SetTextureColorMod(t, base[0], base[1], base[2]);
+  }
+  if (mod[3] != base[3]) {
+    SDL_SetTextureAlphaMod(t, base[3]);
+  }
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
 }
 
 static mrb_value
-mrb_sdl2_video_renderer_draw_points(mrb_state *mrb, mrb_value self)
+mrb_sdl2_video_renderer_draw_line(mrb_state *mrb, mrb_value self)
 {
-  mrb_value *argv;
+  mrb_value p1, p2;
+  SDL_Point * point1;
+  SDL_Point * point2;
+  Uint64 begin;
+  int result;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "oo", &p1, &p2);
+  point1 = mrb_sdl2_point_get_ptr(mrb, p1);
+  point2 = mrb_sdl2_point_get_ptr(mrb, p2);
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_DRAW_LINE, mrb_nil_value());
+    cmd->dst = (SDL_Rect){ point1->x, point1->y, point2->x, point2->y };
+    return self;
+  }
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderDrawLine(data->renderer, point1->x, point1->y, point2->x, point2->y);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_DRAW_LINES, 1, NULL, begin);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+/*
+ * Collects the points of a draw call. A single SDL2::PointArray argument is
+ * used in place; otherwise a temporary array is built from SDL2::Point
+ * arguments in the scratch arena. Arguments are type checked before the
+ * allocation, so nothing raises once scratch memory is taken.
+ */
+static SDL_Point *
+mrb_sdl2_video_renderer_points_from_args(mrb_state *mrb, mrb_value *argv, mrb_int argc, mrb_int *n)
+{
+  SDL_Point *points;
   mrb_int i;
-  mrb_int argc;
-  SDL_Point * points;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  mrb_get_args(mrb, "*", &argv, &argc);
-  points = (SDL_Point *) SDL_malloc(sizeof(SDL_Point) * argc);
+  if ((1 == argc) && mrb_sdl2_pointarray_p(mrb, argv[0])) {
+    return mrb_sdl2_pointarray_get_ptr(mrb, argv[0], n);
+  }
+  for (i = 0; i < argc; ++i) {
+    mrb_sdl2_point_get_ptr(mrb, argv[i]);
+  }
+  points = (SDL_Point *) mrb_sdl2_scratch_alloc(mrb, sizeof(SDL_Point) * argc);
   for (i = 0; i < argc; ++i) {
     SDL_Point * p;
     p = mrb_sdl2_point_get_ptr(mrb, argv[i]);
@@ -463,7 +1338,127 @@ mrb_sdl2_video_renderer_draw_points(mrb_state *mrb, mrb_value self)
       points[i] = (SDL_Point){ 0, 0 };
     }
   }
-  if (0 != SDL_RenderDrawPoints(renderer, points, argc)) {
+  *n = argc;
+  return points;
+}
+
+/*
+ * Same as above for rects and SDL2::RectArray.
+ */
+static SDL_Rect *
+mrb_sdl2_video_renderer_rects_from_args(mrb_state *mrb, mrb_value *argv, mrb_int argc, mrb_int *n)
+{
+  SDL_Rect *rects;
+  mrb_int i;
+  if ((1 == argc) && mrb_sdl2_rectarray_p(mrb, argv[0])) {
+    return mrb_sdl2_rectarray_get_ptr(mrb, argv[0], n);
+  }
+  for (i = 0; i < argc; ++i) {
+    mrb_sdl2_rect_get_ptr(mrb, argv[i]);
+  }
+  rects = (SDL_Rect *) mrb_sdl2_scratch_alloc(mrb, sizeof(SDL_Rect) * argc);
+  for (i = 0; i < argc; ++i) {
+    SDL_Rect * r;
+    r = mrb_sdl2_rect_get_ptr(mrb, argv[i]);
+    if (NULL != r) {
+      rects[i] = *r;
+    } else {
+      rects[i] = (SDL_Rect){ 0, 0, 0, 0 };
+    }
+  }
+  *n = argc;
+  return rects;
+}
+
+static mrb_value
+mrb_sdl2_video_renderer_draw_lines(mrb_state *mrb, mrb_value self)
+{
+  SDL_Point * points;
+  mrb_value *argv;
+  mrb_int argc, n, i;
+  int result;
+  mrb_sdl2_scratch_mark_t mark;
+  Uint64 begin;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "*", &argv, &argc);
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmdbuf_reserve(mrb, mrb_sdl2_video_renderer_defer_buf(data), argc);
+  }
+  mark = mrb_sdl2_scratch_mark();
+  points = mrb_sdl2_video_renderer_points_from_args(mrb, argv, argc, &n);
+  if (data->is_deferred) {
+    for (i = 1; i < n; ++i) {
+      mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_DRAW_LINE, mrb_nil_value());
+      cmd->dst = (SDL_Rect){ points[i - 1].x, points[i - 1].y, points[i].x, points[i].y };
+    }
+    mrb_sdl2_scratch_release(mark);
+    return self;
+  }
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderDrawLines(data->renderer, points, n);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_DRAW_LINES, (n > 0) ? n - 1 : 0, NULL, begin);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_renderer_draw_point(mrb_state *mrb, mrb_value self)
+{
+  mrb_value p;
+  SDL_Point * point;
+  Uint64 begin;
+  int result;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "o", &p);
+  point = mrb_sdl2_point_get_ptr(mrb, p);
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_DRAW_POINT, mrb_nil_value());
+    cmd->dst.x = point->x;
+    cmd->dst.y = point->y;
+    return self;
+  }
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderDrawPoint(data->renderer, point->x, point->y);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_DRAW_POINTS, 1, NULL, begin);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_renderer_draw_points(mrb_state *mrb, mrb_value self)
+{
+  SDL_Point * points;
+  mrb_value *argv;
+  mrb_int argc, n, i;
+  int result;
+  mrb_sdl2_scratch_mark_t mark;
+  Uint64 begin;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "*", &argv, &argc);
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmdbuf_reserve(mrb, mrb_sdl2_video_renderer_defer_buf(data), argc);
+  }
+  mark = mrb_sdl2_scratch_mark();
+  points = mrb_sdl2_video_renderer_points_from_args(mrb, argv, argc, &n);
+  if (data->is_deferred) {
+    for (i = 0; i < n; ++i) {
+      mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_DRAW_POINT, mrb_nil_value());
+      cmd->dst.x = points[i].x;
+      cmd->dst.y = points[i].y;
+    }
+    mrb_sdl2_scratch_release(mark);
+    return self;
+  }
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderDrawPoints(data->renderer, points, n);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_DRAW_POINTS, n, NULL, begin);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -474,10 +1469,20 @@ mrb_sdl2_video_renderer_draw_rect(mrb_state *mrb, mrb_value self)
 {
   mrb_value arg;
   SDL_Rect * r;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  Uint64 begin;
+  int result;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "o", &arg);
   r = mrb_sdl2_rect_get_ptr(mrb, arg);
-  if (0 != SDL_RenderDrawRect(renderer, r)) {
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_DRAW_RECT, mrb_nil_value());
+    mrb_sdl2_video_render_cmd_set_rects(cmd, NULL, r);
+    return self;
+  }
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderDrawRect(data->renderer, r);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_DRAW_RECTS, 1, NULL, begin);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -486,23 +1491,32 @@ mrb_sdl2_video_renderer_draw_rect(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_sdl2_video_renderer_draw_rects(mrb_state *mrb, mrb_value self)
 {
-  mrb_value *argv;
-  mrb_int argc;
   SDL_Rect * rects;
-  mrb_int i;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  mrb_value *argv;
+  mrb_int argc, n, i;
+  int result;
+  mrb_sdl2_scratch_mark_t mark;
+  Uint64 begin;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "*", &argv, &argc);
-  rects = (SDL_Rect *) SDL_malloc(sizeof(SDL_Rect) * argc);
-  for (i = 0; i < argc; ++i) {
-    SDL_Rect * r;
-    r = mrb_sdl2_rect_get_ptr(mrb, argv[i]);
-    if (NULL != r) {
-      rects[i] = *r;
-    } else {
-      rects[i] = (SDL_Rect){ 0, 0, 0, 0 };
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmdbuf_reserve(mrb, mrb_sdl2_video_renderer_defer_buf(data), argc);
+  }
+  mark = mrb_sdl2_scratch_mark();
+  rects = mrb_sdl2_video_renderer_rects_from_args(mrb, argv, argc, &n);
+  if (data->is_deferred) {
+    for (i = 0; i < n; ++i) {
+      mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_DRAW_RECT, mrb_nil_value());
+      mrb_sdl2_video_render_cmd_set_rects(cmd, NULL, &rects[i]);
     }
+    mrb_sdl2_scratch_release(mark);
+    return self;
   }
-  if (0 != SDL_RenderDrawRects(renderer, rects, argc)) {
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderDrawRects(data->renderer, rects, n);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_DRAW_RECTS, n, NULL, begin);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -513,10 +1527,20 @@ mrb_sdl2_video_renderer_fill_rect(mrb_state *mrb, mrb_value self)
 {
   mrb_value arg;
   SDL_Rect * r;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  Uint64 begin;
+  int result;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "o", &arg);
   r = mrb_sdl2_rect_get_ptr(mrb, arg);
-  if (0 != SDL_RenderFillRect(renderer, r)) {
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_FILL_RECT, mrb_nil_value());
+    mrb_sdl2_video_render_cmd_set_rects(cmd, NULL, r);
+    return self;
+  }
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderFillRect(data->renderer, r);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_FILL_RECTS, 1, NULL, begin);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -525,23 +1549,32 @@ mrb_sdl2_video_renderer_fill_rect(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_sdl2_video_renderer_fill_rects(mrb_state *mrb, mrb_value self)
 {
-  mrb_value *argv;
-  mrb_int argc;
   SDL_Rect * rects;
-  mrb_int i;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  mrb_value *argv;
+  mrb_int argc, n, i;
+  int result;
+  mrb_sdl2_scratch_mark_t mark;
+  Uint64 begin;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "*", &argv, &argc);
-  rects = (SDL_Rect *) SDL_malloc(sizeof(SDL_Rect) * argc);
-  for (i = 0; i < argc; ++i) {
-    SDL_Rect * r;
-    r = mrb_sdl2_rect_get_ptr(mrb, argv[i]);
-    if (NULL != r) {
-      rects[i] = *r;
-    } else {
-      rects[i] = (SDL_Rect){ 0, 0, 0, 0 };
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmdbuf_reserve(mrb, mrb_sdl2_video_renderer_defer_buf(data), argc);
+  }
+  mark = mrb_sdl2_scratch_mark();
+  rects = mrb_sdl2_video_renderer_rects_from_args(mrb, argv, argc, &n);
+  if (data->is_deferred) {
+    for (i = 0; i < n; ++i) {
+      mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_renderer_defer(mrb, self, data, MRB_SDL2_RENDER_CMD_FILL_RECT, mrb_nil_value());
+      mrb_sdl2_video_render_cmd_set_rects(cmd, NULL, &rects[i]);
     }
+    mrb_sdl2_scratch_release(mark);
+    return self;
   }
-  if (0 != SDL_RenderFillRects(renderer, rects, argc)) {
+  begin = mrb_sdl2_video_render_stats_begin();
+  result = SDL_RenderFillRects(data->renderer, rects, n);
+  mrb_sdl2_video_render_stats_draw(data, MRB_SDL2_RENDER_CALL_FILL_RECTS, n, NULL, begin);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -561,10 +1594,14 @@ mrb_sdl2_video_renderer_set_clip_rect(mrb_state *mrb, mrb_value self)
 {
   mrb_value arg;
   SDL_Rect * rect;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "o", &arg);
   rect = mrb_sdl2_rect_get_ptr(mrb, arg);
-  if (0 != SDL_RenderSetClipRect(renderer, rect)) {
+  if (!mrb_sdl2_video_render_state_same(&data->state, MRB_SDL2_RENDER_STATE_CLIP_RECT,
+                                         mrb_sdl2_video_render_state_rect_equal(data->state.has_clip_rect, &data->state.clip_rect, rect))) {
+    mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+  }
+  if (0 != mrb_sdl2_video_renderer_apply_clip_rect(data, rect)) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -584,10 +1621,14 @@ mrb_sdl2_video_renderer_set_view_port(mrb_state *mrb, mrb_value self)
 {
   mrb_value arg;
   SDL_Rect * rect;
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
   mrb_get_args(mrb, "o", &arg);
   rect = mrb_sdl2_rect_get_ptr(mrb, arg);
-  if (0 != SDL_RenderSetViewport(renderer, rect)) {
+  if (!mrb_sdl2_video_render_state_same(&data->state, MRB_SDL2_RENDER_STATE_VIEW_PORT,
+                                         mrb_sdl2_video_render_state_rect_equal(data->state.has_view_port, &data->state.view_port, rect))) {
+    mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+  }
+  if (0 != mrb_sdl2_video_renderer_apply_view_port(data, rect)) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -596,11 +1637,250 @@ mrb_sdl2_video_renderer_set_view_port(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_sdl2_video_renderer_present(mrb_state *mrb, mrb_value self)
 {
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  SDL_RenderPresent(renderer);
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  Uint64 begin;
+  mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+  begin = mrb_sdl2_video_render_stats_begin();
+  SDL_RenderPresent(data->renderer);
+  data->stats.ticks += SDL_GetPerformanceCounter() - begin;
+  data->frame_stats = data->stats;
+  SDL_memset(&data->stats, 0, sizeof(data->stats));
+  /* window resizes handled during event polling reset the view port */
+  data->state.valid &= ~MRB_SDL2_RENDER_STATE_BIT(MRB_SDL2_RENDER_STATE_VIEW_PORT);
+  mrb_sdl2_scratch_reset();
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_renderer_flush(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_renderer_is_deferred(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(mrb_sdl2_video_renderer_get_data(mrb, self)->is_deferred);
+}
+
+/*
+ * SDL2::Video::Renderer#deferred=
+ *
+ * In deferred mode draw calls are queued and submitted at flush/present,
+ * sorted by layer first and by texture and blend mode within a layer.
+ * Draw order is only kept between layers; changing the target, clip rect
+ * or view port, or the pixels, modulation or blend mode of a texture,
+ * submits what has been queued so far.
+ */
+static mrb_value
+mrb_sdl2_video_renderer_set_deferred(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool is_deferred;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "b", &is_deferred);
+  if (NULL != data->recording) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot change deferred mode while recording.");
+  }
+  if (is_deferred && !data->is_deferred) {
+    if ((0 != SDL_GetRenderDrawColor(data->renderer, &data->draw_color.r, &data->draw_color.g, &data->draw_color.b, &data->draw_color.a)) ||
+        (0 != SDL_GetRenderDrawBlendMode(data->renderer, &data->draw_blend))) {
+      mruby_sdl2_raise_error(mrb);
+    }
+  } else if (!is_deferred && data->is_deferred) {
+    mrb_sdl2_video_renderer_flush_deferred(mrb, self, data);
+  }
+  data->is_deferred = is_deferred;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_renderer_get_layer(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_renderer_get_data(mrb, self)->layer);
+}
+
+static mrb_value
+mrb_sdl2_video_renderer_set_layer(mrb_state *mrb, mrb_value self)
+{
+  mrb_int layer;
+  mrb_get_args(mrb, "i", &layer);
+  mrb_sdl2_video_renderer_get_data(mrb, self)->layer = (int32_t)layer;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_render_stats_hash(mrb_state *mrb, mrb_sdl2_video_render_stats_t const *stats)
+{
+  mrb_value hash = mrb_hash_new(mrb);
+  mrb_value calls = mrb_hash_new(mrb);
+  mrb_int total = 0;
+  int i;
+  for (i = 0; i < MRB_SDL2_RENDER_CALL_COUNT; ++i) {
+    total += stats->calls[i];
+  }
+  mrb_hash_set(mrb, calls, mrb_symbol_value(mrb_intern_lit(mrb, "clear")),       mrb_fixnum_value(stats->calls[MRB_SDL2_RENDER_CALL_CLEAR]));
+  mrb_hash_set(mrb, calls, mrb_symbol_value(mrb_intern_lit(mrb, "copy")),        mrb_fixnum_value(stats->calls[MRB_SDL2_RENDER_CALL_COPY]));
+  mrb_hash_set(mrb, calls, mrb_symbol_value(mrb_intern_lit(mrb, "copy_ex")),     mrb_fixnum_value(stats->calls[MRB_SDL2_RENDER_CALL_COPY_EX]));
+  mrb_hash_set(mrb, calls, mrb_symbol_value(mrb_intern_lit(mrb, "draw_lines")),  mrb_fixnum_value(stats->calls[MRB_SDL2_RENDER_CALL_DRAW_LINES]));
+  mrb_hash_set(mrb, calls, mrb_symbol_value(mrb_intern_lit(mrb, "draw_points")), mrb_fixnum_value(stats->calls[MRB_SDL2_RENDER_CALL_DRAW_POINTS]));
+  mrb_hash_set(mrb, calls, mrb_symbol_value(mrb_intern_lit(mrb, "draw_rects")),  mrb_fixnum_value(stats->calls[MRB_SDL2_RENDER_CALL_DRAW_RECTS]));
+  mrb_hash_set(mrb, calls, mrb_symbol_value(mrb_intern_lit(mrb, "fill_rects")),  mrb_fixnum_value(stats->calls[MRB_SDL2_RENDER_CALL_FILL_RECTS]));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "draw_calls")),      mrb_fixnum_value(total));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "calls")),           calls);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "primitives")),      mrb_fixnum_value(stats->primitives));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "texture_binds")),   mrb_fixnum_value(stats->texture_binds));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "state_calls")),     mrb_fixnum_value(stats->state_calls));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "texture_updates")), mrb_fixnum_value(stats->texture_updates));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "bytes_uploaded")),  mrb_fixnum_value((mrb_int)stats->bytes_uploaded));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "sdl_seconds")),     mrb_float_value(mrb, (mrb_float)stats->ticks / (mrb_float)SDL_GetPerformanceFrequency()));
+  return hash;
+}
+
+/*
+ * SDL2::Video::Renderer#stats
+ *
+ * Counters for the frame being drawn, reset at #present: draw calls in
+ * total and by kind, primitives submitted, texture changes between
+ * copies, SDL state setter calls, Texture#update / #update_locked calls
+ * and bytes, and the time spent inside those SDL calls. Draw calls queued
+ * in deferred mode are counted when they are submitted.
+ */
+static mrb_value
+mrb_sdl2_video_renderer_get_stats(mrb_state *mrb, mrb_value self)
+{
+  return mrb_sdl2_video_render_stats_hash(mrb, &mrb_sdl2_video_renderer_get_data(mrb, self)->stats);
+}
+
+/*
+ * SDL2::Video::Renderer#frame_stats
+ *
+ * The counters of the frame completed by the last #present, including
+ * the time spent presenting it.
+ */
+static mrb_value
+mrb_sdl2_video_renderer_get_frame_stats(mrb_state *mrb, mrb_value self)
+{
+  return mrb_sdl2_video_render_stats_hash(mrb, &mrb_sdl2_video_renderer_get_data(mrb, self)->frame_stats);
+}
+
+/*
+ * SDL2::Video::Renderer#state_cache_stats
+ *
+ * Number of draw color, blend mode, target, clip rect and view port
+ * changes that were skipped because SDL already had that state.
+ */
+static mrb_value
+mrb_sdl2_video_renderer_get_state_cache_stats(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_render_state_t const *state = &mrb_sdl2_video_renderer_get_data(mrb, self)->state;
+  mrb_value hash = mrb_hash_new(mrb);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "draw_color")),      mrb_fixnum_value(state->elided[MRB_SDL2_RENDER_STATE_DRAW_COLOR]));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "draw_blend_mode")), mrb_fixnum_value(state->elided[MRB_SDL2_RENDER_STATE_DRAW_BLEND]));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "target")),          mrb_fixnum_value(state->elided[MRB_SDL2_RENDER_STATE_TARGET]));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "clip_rect")),       mrb_fixnum_value(state->elided[MRB_SDL2_RENDER_STATE_CLIP_RECT]));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "view_port")),       mrb_fixnum_value(state->elided[MRB_SDL2_RENDER_STATE_VIEW_PORT]));
+  return hash;
+}
+
+/*
+ * SDL2::Video::Renderer#invalidate_state_cache
+ *
+ * Forgets the cached state so that the next setters reach SDL again.
+ * Needed when the renderer is driven from outside these bindings.
+ */
+static mrb_value
+mrb_sdl2_video_renderer_invalidate_state_cache(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_renderer_invalidate_state(mrb, self);
   return self;
 }
 
+static mrb_value
+mrb_sdl2_video_renderer_get_pending_commands(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_renderer_get_data(mrb, self)->deferred.size);
+}
+
+/* args: [block, renderer] */
+static mrb_value
+mrb_sdl2_video_renderer_record_body(mrb_state *mrb, mrb_value args)
+{
+  return mrb_yield(mrb, mrb_ary_ref(mrb, args, 0), mrb_ary_ref(mrb, args, 1));
+}
+
+/* args: renderer */
+static mrb_value
+mrb_sdl2_video_renderer_record_ensure(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  data->is_deferred           = data->saved.is_deferred;
+  data->layer                 = data->saved.layer;
+  data->draw_color            = data->saved.draw_color;
+  data->draw_blend            = data->saved.draw_blend;
+  data->last_deferred_texture = data->saved.last_deferred_texture;
+  data->recording             = NULL;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__recording__"), mrb_nil_value());
+  return mrb_nil_value();
+}
+
+/*
+ * SDL2::Video::Renderer#record { |renderer| ... }
+ *
+ * Runs the block with colors, blend modes, rects, lines, points and copies
+ * captured into a new DisplayList instead of being drawn; other calls
+ * (clear, target=, clip_rect=...) still take effect immediately. The draw
+ * color, blend mode and layer are the same after the block as before it.
+ * Drawing that cannot be captured (copy_ex_batch, RenderQueue, TileLayer,
+ * ParticleEmitter, BitmapFont, RenderLayer and Compositor) raises.
+ */
+static mrb_value
+mrb_sdl2_video_renderer_record(mrb_state *mrb, mrb_value self)
+{
+  mrb_value block, list, body[2];
+  mrb_sdl2_video_displaylist_data_t *list_data;
+  mrb_sdl2_video_render_cmdbuf_t *cmds;
+  mrb_sdl2_video_renderer_data_t *data = mrb_sdl2_video_renderer_get_data(mrb, self);
+  mrb_get_args(mrb, "&", &block);
+  if (mrb_nil_p(block)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "no block given.");
+  }
+  if (NULL != data->recording) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "already recording.");
+  }
+  list_data = (mrb_sdl2_video_displaylist_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_displaylist_data_t));
+  if (NULL == list_data) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+  list_data->renderer  = data->renderer;
+  list_data->cmds.cmds = NULL;
+  list_data->cmds.size = 0;
+  list_data->cmds.capa = 0;
+  list = mrb_obj_value(Data_Wrap_Struct(mrb, class_DisplayList, &mrb_sdl2_video_displaylist_data_type, list_data));
+
+  data->saved.is_deferred           = data->is_deferred;
+  data->saved.layer                 = data->layer;
+  data->saved.draw_color            = data->draw_color;
+  data->saved.draw_blend            = data->draw_blend;
+  data->saved.last_deferred_texture = data->last_deferred_texture;
+  data->is_deferred           = true;
+  data->last_deferred_texture = NULL;
+  data->recording             = &list_data->cmds;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__recording__"), list);
+  body[0] = block;
+  body[1] = self;
+  mrb_ensure(mrb, mrb_sdl2_video_renderer_record_body, mrb_ary_new_from_values(mrb, 2, body),
+                  mrb_sdl2_video_renderer_record_ensure, self);
+
+  /* the list is immutable from here on, so drop the growth slack */
+  cmds = &list_data->cmds;
+  if ((0 < cmds->size) && (cmds->size < cmds->capa)) {
+    cmds->cmds = (mrb_sdl2_video_render_cmd_t*)mrb_realloc(mrb, cmds->cmds, sizeof(mrb_sdl2_video_render_cmd_t) * cmds->size);
+    cmds->capa = cmds->size;
+  }
+  return list;
+}
+
 static mrb_value
 mrb_sdl2_video_renderer_read_pixels(mrb_state *mrb, mrb_value self)
 {
@@ -614,7 +1894,7 @@ mrb_sdl2_video_renderer_read_pixels(mrb_state *mrb, mrb_value self)
   SDL_Rect viewport;
   SDL_Surface *surface;
   mrb_get_args(mrb, "o|i", &rrect, &format);
-  render = mrb_sdl2_video_renderer_get_ptr(mrb, self);
+  render = mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
   SDL_RenderGetViewport(render, &viewport);
   rect = mrb_sdl2_rect_get_ptr(mrb, rrect);
   surface = SDL_CreateRGBSurface(0, viewport.w, viewport.h, 32,
@@ -673,21 +1953,195 @@ mrb_sdl2_video_renderer_save_bmp(mrb_state *mrb, mrb_value self)
 {
   mrb_int w,h;
   mrb_value filename;
+  char const *path;
+  void *pixels;
+  SDL_Surface *sshot;
+  int result;
+  mrb_sdl2_scratch_mark_t mark;
+  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_flushed_ptr(mrb, self);
   mrb_get_args(mrb, "iio", &w, &h, &filename);
-  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, self);
-  SDL_Surface *sshot = SDL_CreateRGBSurface(0, w, h, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
-  SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, sshot->pixels, sshot->pitch);
-  SDL_SaveBMP(sshot, RSTRING_PTR(filename));
+  if ((0 >= w) || (0 >= h)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "width and height must be positive.");
+  }
+  path = mrb_string_value_cstr(mrb, &filename);
+  mark = mrb_sdl2_scratch_mark();
+  pixels = mrb_sdl2_scratch_alloc(mrb, (size_t)w * h * 4);
+  sshot = SDL_CreateRGBSurfaceFrom(pixels, w, h, 32, w * 4, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+  if (NULL == sshot) {
+    mrb_sdl2_scratch_release(mark);
+    mruby_sdl2_raise_error(mrb);
+  }
+  result = SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, sshot->pixels, sshot->pitch);
+  if (0 == result) {
+    result = SDL_SaveBMP(sshot, path);
+  }
   SDL_FreeSurface(sshot);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::DisplayList
+*
+***************************************************************************/
+
+static mrb_sdl2_video_displaylist_data_t *
+mrb_sdl2_video_displaylist_get_data(mrb_state *mrb, mrb_value list)
+{
+  return (mrb_sdl2_video_displaylist_data_t*)mrb_data_get_ptr(mrb, list, &mrb_sdl2_video_displaylist_data_type);
+}
+
+/*
+ * Re-reads the texture of every recorded copy from the Texture objects the
+ * list keeps, so one destroyed since recording raises instead of reaching
+ * SDL as a dangling pointer.
+ */
+static void
+mrb_sdl2_video_displaylist_resolve(mrb_state *mrb, mrb_value self, mrb_sdl2_video_displaylist_data_t *list)
+{
+  mrb_value const textures = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__"));
+  mrb_sdl2_scratch_mark_t mark;
+  SDL_Texture **ptrs;
+  mrb_int i, n;
+  if (mrb_nil_p(textures)) {
+    return;
+  }
+  n = RARRAY_LEN(textures);
+  mark = mrb_sdl2_scratch_mark();
+  ptrs = (SDL_Texture **)mrb_sdl2_scratch_alloc(mrb, sizeof(SDL_Texture *) * (n + 1));
+  for (i = 0; i < n; ++i) {
+    ptrs[i] = mrb_sdl2_video_texture_get_ptr(mrb, mrb_ary_ref(mrb, textures, i));
+  }
+  for (i = 0; i < list->cmds.size; ++i) {
+    mrb_sdl2_video_render_cmd_t *cmd = &list->cmds.cmds[i];
+    if (NULL == cmd->texture) {
+      continue;
+    }
+    if ((cmd->ref >= (uint32_t)n) || (NULL == ptrs[cmd->ref])) {
+      mrb_sdl2_scratch_release(mark);
+      mrb_raise(mrb, E_RUNTIME_ERROR, "texture is already destroyed.");
+    }
+    cmd->texture = ptrs[cmd->ref];
+  }
+  mrb_sdl2_scratch_release(mark);
+}
+
+/*
+ * SDL2::Video::DisplayList#replay(renderer, dx = 0, dy = 0)
+ *
+ * Issues the recorded commands in recording order, translated by (dx, dy).
+ * In deferred mode, or while recording another list, the commands are
+ * queued on the current layer instead; the renderer's draw color and
+ * blend mode are left as they were.
+ */
+static mrb_value
+mrb_sdl2_video_displaylist_replay(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer;
+  mrb_int dx = 0, dy = 0, i;
+  mrb_sdl2_video_renderer_data_t *data;
+  mrb_sdl2_video_displaylist_data_t *list = mrb_sdl2_video_displaylist_get_data(mrb, self);
+  int result;
+  mrb_get_args(mrb, "o|ii", &renderer, &dx, &dy);
+  data = mrb_sdl2_video_renderer_get_data(mrb, renderer);
+  if (NULL == data->renderer) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "renderer is destroyed.");
+  }
+  if (data->renderer != list->renderer) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "display list was recorded on another renderer.");
+  }
+  if (0 == list->cmds.size) {
+    return self;
+  }
+  mrb_sdl2_video_displaylist_resolve(mrb, self, list);
+  if (data->is_deferred) {
+    mrb_sdl2_video_render_cmdbuf_t *buf = (NULL != data->recording) ? data->recording : &data->deferred;
+    uint32_t offset = 0;
+    if (NULL != data->recording) {
+      /* the copies index the textures of the list being recorded */
+      mrb_value const kept     = mrb_sdl2_video_renderer_kept(mrb, renderer, data);
+      mrb_value const textures = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__"));
+      offset = (uint32_t)RARRAY_LEN(kept);
+      if (!mrb_nil_p(textures)) {
+        mrb_ary_concat(mrb, kept, textures);
+      }
+    } else {
+      /* the list keeps its textures alive */
+      mrb_sdl2_video_renderer_keep(mrb, renderer, data, self);
+    }
+    for (i = 0; i < list->cmds.size; ++i) {
+      mrb_sdl2_video_render_cmd_t *cmd = mrb_sdl2_video_render_cmdbuf_push(mrb, buf);
+      uint32_t const seq = cmd->seq;
+      *cmd = list->cmds.cmds[i];
+      cmd->seq    = seq;
+      cmd->ref   += offset;
+      cmd->layer  = data->layer;
+      cmd->dst.x += (int)dx;
+      cmd->dst.y += (int)dy;
+      if (MRB_SDL2_RENDER_CMD_DRAW_LINE == cmd->kind) {
+        cmd->dst.w += (int)dx;
+        cmd->dst.h += (int)dy;
+      }
+    }
+    data->last_deferred_texture = NULL;
+    return self;
+  }
+  result = mrb_sdl2_video_render_cmds_submit(mrb, data, list->cmds.cmds, list->cmds.size, (int)dx, (int)dy);
+  if (0 == result) {
+    result = mrb_sdl2_video_renderer_apply_draw_blend(data, data->draw_blend);
+  }
+  if (0 == result) {
+    result = mrb_sdl2_video_renderer_apply_draw_color(data, data->draw_color);
+  }
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
   return self;
 }
 
+static mrb_value
+mrb_sdl2_video_displaylist_get_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_displaylist_get_data(mrb, self)->cmds.size);
+}
+
 /***************************************************************************
 *
 * class SDL2::Video::Texture
 *
 ***************************************************************************/
 
+/*
+ * Must precede SDL_DestroyTexture and any change to the texture's pixels,
+ * modulation or blend mode: draws the owning renderer still has queued
+ * may use the texture and have to see it as it was, so they are submitted
+ * first. The pointer is dropped from the queue's dedup so a new texture
+ * allocated at the same address is referenced again.
+ */
+static void
+mrb_sdl2_video_texture_flush_queued(mrb_state *mrb, mrb_value self, SDL_Texture *texture)
+{
+  mrb_value const renderer = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__renderer__"));
+  mrb_sdl2_video_renderer_data_t *data;
+  if (mrb_nil_p(renderer)) {
+    return;
+  }
+  data = mrb_sdl2_video_renderer_get_data(mrb, renderer);
+  if (NULL != data->renderer) {
+    mrb_sdl2_video_renderer_flush_deferred(mrb, renderer, data);
+  }
+  if (data->last_deferred_texture == texture) {
+    data->last_deferred_texture = NULL;
+  }
+  if (data->saved.last_deferred_texture == texture) {
+    data->saved.last_deferred_texture = NULL;
+  }
+}
+
 static mrb_value
 mrb_sdl2_video_texture_initialize(mrb_state *mrb, mrb_value self)
 {
@@ -707,6 +2161,7 @@ mrb_sdl2_video_texture_initialize(mrb_state *mrb, mrb_value self)
     }
     data->texture = NULL;
   } else if (NULL != data->texture) {
+    mrb_sdl2_video_texture_flush_queued(mrb, self, data->texture);
     SDL_DestroyTexture(data->texture);
     data->texture = NULL;
   }
@@ -738,15 +2193,48 @@ mrb_sdl2_video_texture_initialize(mrb_state *mrb, mrb_value self)
   data->texture = texture;
   DATA_PTR(self) = data;
   DATA_TYPE(self) = &mrb_sdl2_video_texture_data_type;
+  /* uploads are counted in the renderer's stats */
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), argv[0]);
   return self;
 }
 
+static void
+mrb_sdl2_video_texture_count_upload(mrb_state *mrb, mrb_value self, size_t bytes, Uint64 begin)
+{
+  mrb_value renderer = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__renderer__"));
+  mrb_sdl2_video_render_stats_t *stats;
+  if (mrb_nil_p(renderer)) {
+    return;
+  }
+  stats = &mrb_sdl2_video_renderer_get_data(mrb, renderer)->stats;
+  stats->ticks += SDL_GetPerformanceCounter() - begin;
+  ++stats->texture_updates;
+  stats->bytes_uploaded += bytes;
+}
+
+/*
+ * Forgets the pixels of the PixelBuffer handed out by Texture#lock, so it
+ * can no longer be written once SDL has taken the memory back.
+ */
+static void
+mrb_sdl2_video_texture_release_pixelbuf(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym const key = mrb_intern_lit(mrb, "__pixelbuf__");
+  mrb_value pbuf = mrb_iv_get(mrb, self, key);
+  if (!mrb_nil_p(pbuf)) {
+    mrb_sdl2_video_pixelbuf_get_ptr(mrb, pbuf)->pixels = NULL;
+    mrb_iv_set(mrb, self, key, mrb_nil_value());
+  }
+}
+
 static mrb_value
 mrb_sdl2_video_texture_destroy(mrb_state *mrb, mrb_value self)
 {
   mrb_sdl2_video_texture_data_t *data =
     (mrb_sdl2_video_texture_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_texture_data_type);
+  mrb_sdl2_video_texture_release_pixelbuf(mrb, self);
   if (NULL != data->texture) {
+    mrb_sdl2_video_texture_flush_queued(mrb, self, data->texture);
     SDL_DestroyTexture(data->texture);
     data->texture = NULL;
   }
@@ -770,6 +2258,7 @@ mrb_sdl2_video_texture_set_alpha_mod(mrb_state *mrb, mrb_value self)
   mrb_int alpha;
   SDL_Texture *texture = mrb_sdl2_video_texture_get_ptr(mrb, self);
   mrb_get_args(mrb, "i", &alpha);
+  mrb_sdl2_video_texture_flush_queued(mrb, self, texture);
   if (0 != SDL_SetTextureAlphaMod(texture, (uint8_t)(alpha & 0xff))) {
     mruby_sdl2_raise_error(mrb);
   }
@@ -793,6 +2282,7 @@ mrb_sdl2_video_texture_set_blend_mode(mrb_state *mrb, mrb_value self)
   mrb_int mode;
   SDL_Texture *texture = mrb_sdl2_video_texture_get_ptr(mrb, self);
   mrb_get_args(mrb, "i", &mode);
+  mrb_sdl2_video_texture_flush_queued(mrb, self, texture);
   if (0 != SDL_SetTextureBlendMode(texture, (SDL_BlendMode)mode)) {
     mruby_sdl2_raise_error(mrb);
   }
@@ -822,24 +2312,71 @@ mrb_sdl2_video_texture_set_color_mod(mrb_state *mrb, mrb_value self)
   SDL_Texture *texture;
   mrb_get_args(mrb, "iii", &r, &g, &b);
   texture = mrb_sdl2_video_texture_get_ptr(mrb, self);
+  mrb_sdl2_video_texture_flush_queued(mrb, self, texture);
   if (0 != SDL_SetTextureColorMod(texture, r, g, b)) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
 }
 
+/*
+ * SDL2::Video::Texture#lock(rect = nil)
+ *
+ * Locks a streaming texture for write-only access and returns a
+ * PixelBuffer over the locked pixels. The buffer is invalidated by unlock.
+ * Raises IndexError unless rect is non-empty and inside the texture.
+ */
 static mrb_value
 mrb_sdl2_video_texture_lock(mrb_state *mrb, mrb_value self)
 {
-  mrb_raise(mrb, E_NOTIMP_ERROR, "not implemented.");
-  return mrb_nil_value();
+  mrb_value rect = mrb_nil_value();
+  mrb_sdl2_video_pixelbuf_data_t *data;
+  SDL_Rect const *r;
+  uint32_t format;
+  int w, h;
+  struct RData *pbuf;
+  SDL_Texture *texture = mrb_sdl2_video_texture_get_ptr(mrb, self);
+  mrb_get_args(mrb, "|o", &rect);
+  if (!mrb_nil_p(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__pixelbuf__")))) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "texture is already locked.");
+  }
+  r = mrb_sdl2_rect_get_ptr(mrb, rect);
+  if (0 != SDL_QueryTexture(texture, &format, NULL, &w, &h)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  /* SDL_LockTexture does not clip, a rect outside the texture would hand
+   * out a pointer past its pixels */
+  if ((NULL != r) && ((r->w <= 0) || (r->h <= 0) || (r->x < 0) || (r->y < 0) || (r->x > w - r->w) || (r->y > h - r->h))) {
+    mrb_raise(mrb, E_INDEX_ERROR, "lock rect out of bounds.");
+  }
+  mrb_sdl2_video_texture_flush_queued(mrb, self, texture);
+  data = (mrb_sdl2_video_pixelbuf_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_pixelbuf_data_t));
+  if (NULL == data) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+  if (NULL != r) {
+    data->data.rect = *r;
+  } else {
+    data->data.rect = (SDL_Rect){ 0, 0, w, h };
+  }
+  data->data.bytes_per_pixel = SDL_BYTESPERPIXEL(format);
+  if (0 != SDL_LockTexture(texture, r, &data->data.pixels, &data->data.pitch)) {
+    mrb_free(mrb, data);
+    mruby_sdl2_raise_error(mrb);
+  }
+  pbuf = Data_Wrap_Struct(mrb, class_PixelBuffer, &mrb_sdl2_video_pixelbuf_data_type, data);
+  mrb_iv_set(mrb, mrb_obj_value(pbuf), mrb_intern_lit(mrb, "__texture__"), self);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__pixelbuf__"), mrb_obj_value(pbuf));
+  return mrb_obj_value(pbuf);
 }
 
 static mrb_value
 mrb_sdl2_video_texture_unlock(mrb_state *mrb, mrb_value self)
 {
-  mrb_raise(mrb, E_NOTIMP_ERROR, "not implemented.");
-  return mrb_nil_value();
+  SDL_Texture *texture = mrb_sdl2_video_texture_get_ptr(mrb, self);
+  mrb_sdl2_video_texture_release_pixelbuf(mrb, self);
+  SDL_UnlockTexture(texture);
+  return self;
 }
 
 static mrb_value
@@ -886,51 +2423,240 @@ mrb_sdl2_video_texture_get_height(mrb_state *mrb, mrb_value self)
   return mrb_fixnum_value(h);
 }
 
+/*
+ * Uploads the `src` area of the surface to (dst_x, dst_y) in the texture.
+ * The area is clipped against both the surface and the texture, and the
+ * pixel pointer is offset to the clipped origin so SDL only reads the rows
+ * it writes. Stores the number of bytes uploaded (0 when nothing overlaps)
+ * in `bytes` and returns the SDL result, leaving the caller to raise.
+ */
+static int
+mrb_sdl2_video_texture_update_area(SDL_Texture *t, int tw, int th,
+                                   SDL_Surface *s, SDL_Rect const *src, int dst_x, int dst_y, size_t *bytes)
+{
+  SDL_Rect bounds = { 0, 0, s->w, s->h };
+  SDL_Rect area, dst, clipped;
+  int const bpp = s->format->BytesPerPixel;
+  uint8_t const *pixels;
+  int result;
+  *bytes = 0;
+  if (!SDL_IntersectRect(src, &bounds, &area)) {
+    return 0;
+  }
+  dst = (SDL_Rect){ dst_x + area.x - src->x, dst_y + area.y - src->y, area.w, area.h };
+  bounds = (SDL_Rect){ 0, 0, tw, th };
+  if (!SDL_IntersectRect(&dst, &bounds, &clipped)) {
+    return 0;
+  }
+  area.x += clipped.x - dst.x;
+  area.y += clipped.y - dst.y;
+  if (SDL_MUSTLOCK(s) && (SDL_LockSurface(s) < 0)) {
+    return -1;
+  }
+  pixels = (uint8_t const *)s->pixels + area.y * s->pitch + area.x * bpp;
+  result = SDL_UpdateTexture(t, &clipped, pixels, s->pitch);
+  if (SDL_MUSTLOCK(s)) {
+    SDL_UnlockSurface(s);
+  }
+  if (0 == result) {
+    *bytes = (size_t)clipped.w * clipped.h * bpp;
+  }
+  return result;
+}
+
+static SDL_Texture *
+mrb_sdl2_video_texture_update_target(mrb_state *mrb, mrb_value self, SDL_Surface *s, int *w, int *h)
+{
+  uint32_t format;
+  SDL_Texture *t = mrb_sdl2_video_texture_get_ptr(mrb, self);
+  if (0 != SDL_QueryTexture(t, &format, NULL, w, h)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  if (SDL_BYTESPERPIXEL(format) != s->format->BytesPerPixel) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "surface and texture pixel sizes differ.");
+  }
+  mrb_sdl2_video_texture_flush_queued(mrb, self, t);
+  return t;
+}
+
+/*
+ * SDL2::Video::Texture#update(surface)
+ * SDL2::Video::Texture#update(surface, dst_rect)
+ * SDL2::Video::Texture#update(surface, src_rect, dst_rect)
+ *
+ * Uploads surface pixels into the texture. With one rect it is the
+ * destination and pixels are read from the surface origin; with two, the
+ * `src_rect` area (nil for the whole surface) is written at the position of
+ * `dst_rect` (nil to keep the source position). Only the position of
+ * `dst_rect` is used, and the copy is clipped to both surface and texture.
+ */
 static mrb_value
 mrb_sdl2_video_texture_update(mrb_state *mrb, mrb_value self)
 {
-  int result;
-  mrb_value surface, rect;
-  SDL_Texture *t = mrb_sdl2_video_texture_get_ptr(mrb, self);
-  int argc = mrb_get_args(mrb, "o|o", &surface, &rect);
-  SDL_Surface *s = mrb_sdl2_video_surface_get_ptr(mrb, surface);
-  if (argc == 1) {
-    result = SDL_UpdateTexture(t, NULL, s->pixels, s->pitch);
+  mrb_value surface;
+  mrb_value rect = mrb_nil_value();
+  mrb_value dst_rect = mrb_nil_value();
+  SDL_Surface *s;
+  SDL_Texture *t;
+  SDL_Rect src;
+  SDL_Rect const *r;
+  int w, h, dst_x, dst_y;
+  size_t bytes;
+  Uint64 begin;
+  int argc = mrb_get_args(mrb, "o|oo", &surface, &rect, &dst_rect);
+  s = mrb_sdl2_video_surface_get_ptr(mrb, surface);
+  t = mrb_sdl2_video_texture_update_target(mrb, self, s, &w, &h);
+  src = (SDL_Rect){ 0, 0, s->w, s->h };
+  dst_x = dst_y = 0;
+  r = mrb_nil_p(rect) ? NULL : mrb_sdl2_rect_get_ptr(mrb, rect);
+  if (argc < 3) {
+    if (NULL != r) {
+      src.w = r->w;
+      src.h = r->h;
+      dst_x = r->x;
+      dst_y = r->y;
+    }
   } else {
-    SDL_Rect *r = mrb_sdl2_rect_get_ptr(mrb, rect);
-    result = SDL_UpdateTexture(t, r, s->pixels, s->pitch);
+    if (NULL != r) {
+      src = *r;
+    }
+    dst_x = src.x;
+    dst_y = src.y;
+    if (!mrb_nil_p(dst_rect)) {
+      SDL_Rect const *d = mrb_sdl2_rect_get_ptr(mrb, dst_rect);
+      dst_x = d->x;
+      dst_y = d->y;
+    }
   }
-  if (result < 0)
+  begin = mrb_sdl2_video_render_stats_begin();
+  if (mrb_sdl2_video_texture_update_area(t, w, h, s, &src, dst_x, dst_y, &bytes) < 0) {
     mruby_sdl2_raise_error(mrb);
+  }
+  if (0 < bytes) {
+    mrb_sdl2_video_texture_count_upload(mrb, self, bytes, begin);
+  }
 
   return mrb_true_value();
 }
 
+/*
+ * SDL2::Video::Texture#update_rects(surface, *rects)
+ *
+ * Uploads each dirty rect from the same position in the surface, clipped,
+ * so a mostly static surface can be mirrored without re-sending unchanged
+ * pixels. Accepts Rects, one Array of Rects or a RectArray. Returns the
+ * number of rects that overlapped and were uploaded.
+ */
+static mrb_value
+mrb_sdl2_video_texture_update_rects(mrb_state *mrb, mrb_value self)
+{
+  mrb_value surface;
+  mrb_value *argv;
+  mrb_int argc, n, i, count = 0;
+  SDL_Surface *s;
+  SDL_Texture *t;
+  SDL_Rect *rects;
+  int w, h;
+  size_t bytes = 0;
+  Uint64 begin;
+  int result = 0;
+  mrb_sdl2_scratch_mark_t mark;
+  mrb_get_args(mrb, "o*", &surface, &argv, &argc);
+  s = mrb_sdl2_video_surface_get_ptr(mrb, surface);
+  t = mrb_sdl2_video_texture_update_target(mrb, self, s, &w, &h);
+  if ((1 == argc) && mrb_array_p(argv[0])) {
+    argc = RARRAY_LEN(argv[0]);
+    argv = RARRAY_PTR(argv[0]);
+  }
+  mark = mrb_sdl2_scratch_mark();
+  rects = mrb_sdl2_video_renderer_rects_from_args(mrb, argv, argc, &n);
+  begin = mrb_sdl2_video_render_stats_begin();
+  for (i = 0; (0 == result) && (i < n); ++i) {
+    size_t b;
+    result = mrb_sdl2_video_texture_update_area(t, w, h, s, &rects[i], rects[i].x, rects[i].y, &b);
+    if (0 < b) {
+      bytes += b;
+      ++count;
+    }
+  }
+  mrb_sdl2_scratch_release(mark);
+  if (0 < bytes) {
+    mrb_sdl2_video_texture_count_upload(mrb, self, bytes, begin);
+  }
+  if (result < 0) {
+    mruby_sdl2_raise_error(mrb);
+  }
+
+  return mrb_fixnum_value(count);
+}
+
 
 
+/*
+ * SDL2::Video::Texture#update_locked(surface, src_rect = nil)
+ *
+ * Streams the surface (or `src_rect` of it) into the top left corner of the
+ * texture through SDL_LockTexture, row by row so that neither pitch has to
+ * match. The copied area is clipped to both the surface and the texture.
+ * Raises while the texture is locked by #lock.
+ */
 static mrb_value
 mrb_sdl2_video_texture_update_loc(mrb_state *mrb, mrb_value self)
 {
-  mrb_value surface, src_rect;
+  mrb_value surface;
+  mrb_value src_rect = mrb_nil_value();
   SDL_Surface *s;
-  void *mPixels;
-  int mPitch;
   SDL_Texture *t;
-  int argc = mrb_get_args(mrb, "o|o", &surface, &src_rect);//, &dest_rect);
+  SDL_Rect area, bounds;
+  void *pixels;
+  int pitch, w, h;
+  uint32_t format;
+  uint8_t const *src;
+  Uint64 begin;
+  mrb_get_args(mrb, "o|o", &surface, &src_rect);
   s = mrb_sdl2_video_surface_get_ptr(mrb, surface);
   t = mrb_sdl2_video_texture_get_ptr(mrb, self);
-
-  if (SDL_LockTexture(t, NULL, &mPixels, &mPitch) < 0) {
+  /* SDL_LockTexture on a texture locked by #lock would hand out a second
+   * pointer into the same pixels */
+  if (!mrb_nil_p(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__pixelbuf__")))) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "texture is already locked.");
+  }
+  if (0 != SDL_QueryTexture(t, &format, NULL, &w, &h)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  if (SDL_BYTESPERPIXEL(format) != s->format->BytesPerPixel) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "surface and texture pixel sizes differ.");
+  }
+  bounds = (SDL_Rect){ 0, 0, s->w, s->h };
+  area = bounds;
+  if (!mrb_nil_p(src_rect) &&
+      !SDL_IntersectRect(mrb_sdl2_rect_get_ptr(mrb, src_rect), &bounds, &area)) {
+    return self;
+  }
+  area.w = SDL_min(area.w, w);
+  area.h = SDL_min(area.h, h);
+  if ((area.w <= 0) || (area.h <= 0)) {
+    return self;
+  }
+  bounds = (SDL_Rect){ 0, 0, area.w, area.h };
+  mrb_sdl2_video_texture_flush_queued(mrb, self, t);
+  begin = mrb_sdl2_video_render_stats_begin();
+  if (SDL_MUSTLOCK(s) && (SDL_LockSurface(s) < 0)) {
     mruby_sdl2_raise_error(mrb);
   }
-  void *stp = s->pixels;
-  if (argc == 2) {
-    SDL_Rect *r;
-    r = mrb_sdl2_rect_get_ptr(mrb, src_rect);
-    stp += r->h * mPitch;
+  if (SDL_LockTexture(t, &bounds, &pixels, &pitch) < 0) {
+    if (SDL_MUSTLOCK(s)) {
+      SDL_UnlockSurface(s);
+    }
+    mruby_sdl2_raise_error(mrb);
   }
-  memcpy(mPixels, stp, s->h * mPitch);
+  src = (uint8_t const *)s->pixels + area.y * s->pitch + area.x * s->format->BytesPerPixel;
+  mrb_sdl2_misc_copy_rows(pixels, pitch, src, s->pitch, (size_t)area.w * s->format->BytesPerPixel, area.h);
   SDL_UnlockTexture(t);
+  if (SDL_MUSTLOCK(s)) {
+    SDL_UnlockSurface(s);
+  }
+  mrb_sdl2_video_texture_count_upload(mrb, self, (size_t)area.w * area.h * s->format->BytesPerPixel, begin);
 
   return self;
 }
@@ -955,6 +2681,161 @@ mrb_sdl2_video_pixelbuf_get_rect(mrb_state *mrb, mrb_value self)
   return mrb_sdl2_rect_direct(mrb, &data->rect);
 }
 
+static pixelbuf_data_t *
+mrb_sdl2_video_pixelbuf_get_locked(mrb_state *mrb, mrb_value self)
+{
+  pixelbuf_data_t *data = mrb_sdl2_video_pixelbuf_get_ptr(mrb, self);
+  if (NULL == data->pixels) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "texture is no longer locked.");
+  }
+  return data;
+}
+
+static mrb_value
+mrb_sdl2_video_pixelbuf_get_bytes_per_pixel(mrb_state *mrb, mrb_value self)
+{
+  pixelbuf_data_t *data = mrb_sdl2_video_pixelbuf_get_ptr(mrb, self);
+  return mrb_fixnum_value(data->bytes_per_pixel);
+}
+
+static mrb_value
+mrb_sdl2_video_pixelbuf_is_locked(mrb_state *mrb, mrb_value self)
+{
+  pixelbuf_data_t *data = mrb_sdl2_video_pixelbuf_get_ptr(mrb, self);
+  return mrb_bool_value(NULL != data->pixels);
+}
+
+static mrb_value
+mrb_sdl2_video_pixelbuf_get_cptr(mrb_state *mrb, mrb_value self)
+{
+  pixelbuf_data_t *data = mrb_sdl2_video_pixelbuf_get_locked(mrb, self);
+  return mrb_cptr_value(mrb, data->pixels);
+}
+
+/*
+ * SDL2::Video::PixelBuffer#write(bytes, src_pitch = nil, y = 0)
+ *
+ * Copies rows from a String or SDL2::Buffer into the locked pixels starting
+ * at row `y`. `src_pitch` defaults to tightly packed rows. Returns the
+ * number of rows written.
+ */
+static mrb_value
+mrb_sdl2_video_pixelbuf_write(mrb_state *mrb, mrb_value self)
+{
+  mrb_value bytes;
+  mrb_value pitch = mrb_nil_value();
+  mrb_int y = 0;
+  size_t size, src_pitch, row_bytes;
+  int rows;
+  uint8_t const *src;
+  pixelbuf_data_t *data = mrb_sdl2_video_pixelbuf_get_locked(mrb, self);
+  mrb_get_args(mrb, "o|oi", &bytes, &pitch, &y);
+  if ((y < 0) || (y > data->rect.h)) {
+    mrb_raise(mrb, E_INDEX_ERROR, "row is out of range.");
+  }
+  src = (uint8_t const *)mrb_sdl2_misc_bytes_get_ptr(mrb, bytes, &size);
+  row_bytes = (size_t)data->rect.w * data->bytes_per_pixel;
+  src_pitch = row_bytes;
+  if (!mrb_nil_p(pitch)) {
+    if (!mrb_fixnum_p(pitch)) {
+      mrb_raise(mrb, E_TYPE_ERROR, "given pitch is unexpected type (expected Fixnum).");
+    }
+    /* compared signed, a negative pitch must not wrap to a huge one */
+    if ((mrb_fixnum(pitch) < (mrb_int)row_bytes) || (mrb_fixnum(pitch) > SDL_MAX_SINT32)) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "source pitch is out of range.");
+    }
+    src_pitch = (size_t)mrb_fixnum(pitch);
+  }
+  /* the last row does not need the padding of the pitch */
+  rows = (size < row_bytes) ? 0 : (int)((size - row_bytes) / src_pitch + 1);
+  rows = SDL_min(rows, data->rect.h - (int)y);
+  mrb_sdl2_misc_copy_rows((uint8_t*)data->pixels + y * data->pitch, data->pitch, src, (int)src_pitch, row_bytes, rows);
+  return mrb_fixnum_value(rows);
+}
+
+/*
+ * SDL2::Video::PixelBuffer#write_surface(surface, x = 0, y = 0)
+ *
+ * Copies the surface into the locked pixels at (x, y), clipped to the
+ * locked rect. Pixel sizes must match.
+ */
+static mrb_value
+mrb_sdl2_video_pixelbuf_write_surface(mrb_state *mrb, mrb_value self)
+{
+  mrb_value surface;
+  mrb_int x = 0, y = 0;
+  SDL_Surface *s;
+  SDL_Rect area, locked, clipped;
+  uint8_t const *src;
+  uint8_t *dst;
+  pixelbuf_data_t *data = mrb_sdl2_video_pixelbuf_get_locked(mrb, self);
+  mrb_get_args(mrb, "o|ii", &surface, &x, &y);
+  s = mrb_sdl2_video_surface_get_ptr(mrb, surface);
+  if (s->format->BytesPerPixel != data->bytes_per_pixel) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "surface and texture pixel sizes differ.");
+  }
+  area   = (SDL_Rect){ (int)x, (int)y, s->w, s->h };
+  locked = (SDL_Rect){ 0, 0, data->rect.w, data->rect.h };
+  if (!SDL_IntersectRect(&area, &locked, &clipped)) {
+    return self;
+  }
+  if (SDL_MUSTLOCK(s) && (0 != SDL_LockSurface(s))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  src = (uint8_t const *)s->pixels + (clipped.y - area.y) * s->pitch + (clipped.x - area.x) * data->bytes_per_pixel;
+  dst = (uint8_t*)data->pixels + clipped.y * data->pitch + clipped.x * data->bytes_per_pixel;
+  mrb_sdl2_misc_copy_rows(dst, data->pitch, src, s->pitch, (size_t)clipped.w * data->bytes_per_pixel, clipped.h);
+  if (SDL_MUSTLOCK(s)) {
+    SDL_UnlockSurface(s);
+  }
+  return self;
+}
+
+/*
+ * SDL2::Video::PixelBuffer#fill(pixel)
+ *
+ * Fills the locked rect with a raw pixel value in the texture format.
+ */
+static mrb_value
+mrb_sdl2_video_pixelbuf_fill(mrb_state *mrb, mrb_value self)
+{
+  mrb_int pixel;
+  int x, y;
+  pixelbuf_data_t *data = mrb_sdl2_video_pixelbuf_get_locked(mrb, self);
+  size_t const row_bytes = (size_t)data->rect.w * data->bytes_per_pixel;
+  uint8_t *row = (uint8_t*)data->pixels;
+  mrb_get_args(mrb, "i", &pixel);
+  if (data->rect.h <= 0) {
+    return self;
+  }
+  /* build the first row, then replicate it */
+  for (x = 0; x < data->rect.w; ++x) {
+    uint8_t *p = row + x * data->bytes_per_pixel;
+    switch (data->bytes_per_pixel) {
+    case 1:
+      *p = (Uint8)pixel;
+      break;
+    case 2:
+      *(Uint16*)p = (Uint16)pixel;
+      break;
+    case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+      p[0] = (Uint8)(pixel >> 16); p[1] = (Uint8)(pixel >> 8); p[2] = (Uint8)pixel;
+#else
+      p[0] = (Uint8)pixel; p[1] = (Uint8)(pixel >> 8); p[2] = (Uint8)(pixel >> 16);
+#endif
+      break;
+    default:
+      *(Uint32*)p = (Uint32)pixel;
+      break;
+    }
+  }
+  for (y = 1; y < data->rect.h; ++y) {
+    SDL_memcpy(row + y * data->pitch, row, row_bytes);
+  }
+  return self;
+}
+
 /***************************************************************************
 *
 * class SDL2::Video::RendererInfo
@@ -1081,11 +2962,13 @@ mruby_sdl2_video_renderer_init(mrb_state *mrb, struct RClass *mod_Video)
   class_Texture      = mrb_define_class_under(mrb, mod_Video, "Texture",      mrb->object_class);
   class_PixelBuffer  = mrb_define_class_under(mrb, mod_Video, "PixelBuffer",  mrb->object_class);
   class_RendererInfo = mrb_define_class_under(mrb, mod_Video, "RendererInfo", mrb->object_class);
+  class_DisplayList  = mrb_define_class_under(mrb, mod_Video, "DisplayList",  mrb->object_class);
 
   MRB_SET_INSTANCE_TT(class_Renderer,     MRB_TT_DATA);
   MRB_SET_INSTANCE_TT(class_Texture,      MRB_TT_DATA);
   MRB_SET_INSTANCE_TT(class_PixelBuffer,  MRB_TT_DATA);
   MRB_SET_INSTANCE_TT(class_RendererInfo, MRB_TT_DATA);
+  MRB_SET_INSTANCE_TT(class_DisplayList,  MRB_TT_DATA);
 
   mrb_define_method(mrb, class_Renderer, "initialize",       mrb_sdl2_video_renderer_initialize,          MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
   mrb_define_method(mrb, class_Renderer, "destroy",          mrb_sdl2_video_renderer_destroy,             MRB_ARGS_NONE());
@@ -1093,11 +2976,14 @@ mruby_sdl2_video_renderer_init(mrb_state *mrb, struct RClass *mod_Video)
   mrb_define_method(mrb, class_Renderer, "draw_blend_mode=", mrb_sdl2_video_renderer_set_draw_blend_mode, MRB_ARGS_REQ(1));
   mrb_define_method(mrb, class_Renderer, "get_draw_color",   mrb_sdl2_video_renderer_get_draw_color,      MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Renderer, "set_draw_color",   mrb_sdl2_video_renderer_set_draw_color,      MRB_ARGS_REQ(3) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_Renderer, "target",           mrb_sdl2_video_renderer_get_target,          MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Renderer, "target=",          mrb_sdl2_video_renderer_set_target,          MRB_ARGS_REQ(1));
   mrb_define_method(mrb, class_Renderer, "info",             mrb_sdl2_video_renderer_get_info,            MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Renderer, "clear",            mrb_sdl2_video_renderer_clear,               MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Renderer, "copy",             mrb_sdl2_video_renderer_copy,                MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
   mrb_define_method(mrb, class_Renderer, "copy_ex",          mrb_sdl2_video_renderer_copy_ex,             MRB_ARGS_REQ(1) | MRB_ARGS_OPT(5));
+  mrb_define_method(mrb, class_Renderer, "copy_batch",       mrb_sdl2_video_renderer_copy_batch,          MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_Renderer, "copy_ex_batch",    mrb_sdl2_video_renderer_copy_ex_batch,       MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
   mrb_define_method(mrb, class_Renderer, "draw_line",        mrb_sdl2_video_renderer_draw_line,           MRB_ARGS_REQ(2));
   mrb_define_method(mrb, class_Renderer, "draw_lines",       mrb_sdl2_video_renderer_draw_lines,          MRB_ARGS_ANY());
   mrb_define_method(mrb, class_Renderer, "draw_point",       mrb_sdl2_video_renderer_draw_point,          MRB_ARGS_REQ(1));
@@ -1114,6 +3000,17 @@ mruby_sdl2_video_renderer_init(mrb_state *mrb, struct RClass *mod_Video)
   mrb_define_method(mrb, class_Renderer, "read_pixels",      mrb_sdl2_video_renderer_read_pixels,         MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
   mrb_define_method(mrb, class_Renderer, "name",             mrb_sdl2_video_renderer_get_name,            MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Renderer, "save_bmp",         mrb_sdl2_video_renderer_save_bmp,            MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, class_Renderer, "flush",            mrb_sdl2_video_renderer_flush,               MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Renderer, "deferred?",        mrb_sdl2_video_renderer_is_deferred,         MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Renderer, "deferred=",        mrb_sdl2_video_renderer_set_deferred,        MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Renderer, "layer",            mrb_sdl2_video_renderer_get_layer,           MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Renderer, "layer=",           mrb_sdl2_video_renderer_set_layer,           MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Renderer, "pending_commands", mrb_sdl2_video_renderer_get_pending_commands, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Renderer, "record",           mrb_sdl2_video_renderer_record,              MRB_ARGS_BLOCK());
+  mrb_define_method(mrb, class_Renderer, "stats",            mrb_sdl2_video_renderer_get_stats,           MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Renderer, "frame_stats",      mrb_sdl2_video_renderer_get_frame_stats,     MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Renderer, "state_cache_stats",      mrb_sdl2_video_renderer_get_state_cache_stats,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Renderer, "invalidate_state_cache", mrb_sdl2_video_renderer_invalidate_state_cache, MRB_ARGS_NONE());
 
   arena_size = mrb_gc_arena_save(mrb);
 
@@ -1150,7 +3047,8 @@ mruby_sdl2_video_renderer_init(mrb_state *mrb, struct RClass *mod_Video)
   mrb_define_method(mrb, class_Texture, "width",         mrb_sdl2_video_texture_get_width,      MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Texture, "height",        mrb_sdl2_video_texture_get_height,     MRB_ARGS_NONE());
   mrb_define_method(mrb, class_Texture, "update_locked", mrb_sdl2_video_texture_update_loc,     MRB_ARGS_REQ(1));
-  mrb_define_method(mrb, class_Texture, "update",        mrb_sdl2_video_texture_update,         MRB_ARGS_REQ(1) | MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_Texture, "update",        mrb_sdl2_video_texture_update,         MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, class_Texture, "update_rects",  mrb_sdl2_video_texture_update_rects,   MRB_ARGS_REQ(1) | MRB_ARGS_REST());
 
   mrb_gc_arena_restore(mrb, arena_size);
   arena_size = mrb_gc_arena_save(mrb);
@@ -1168,8 +3066,18 @@ mruby_sdl2_video_renderer_init(mrb_state *mrb, struct RClass *mod_Video)
   mrb_gc_arena_restore(mrb, arena_size);
   arena_size = mrb_gc_arena_save(mrb);
 
-  mrb_define_method(mrb, class_PixelBuffer, "pitch", mrb_sdl2_video_pixelbuf_get_pitch, MRB_ARGS_NONE());
-  mrb_define_method(mrb, class_PixelBuffer, "rect",  mrb_sdl2_video_pixelbuf_get_rect,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PixelBuffer, "pitch",           mrb_sdl2_video_pixelbuf_get_pitch,           MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PixelBuffer, "rect",            mrb_sdl2_video_pixelbuf_get_rect,            MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PixelBuffer, "bytes_per_pixel", mrb_sdl2_video_pixelbuf_get_bytes_per_pixel, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PixelBuffer, "locked?",         mrb_sdl2_video_pixelbuf_is_locked,           MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PixelBuffer, "cptr",            mrb_sdl2_video_pixelbuf_get_cptr,            MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_PixelBuffer, "write",           mrb_sdl2_video_pixelbuf_write,               MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, class_PixelBuffer, "write_surface",   mrb_sdl2_video_pixelbuf_write_surface,       MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, class_PixelBuffer, "fill",            mrb_sdl2_video_pixelbuf_fill,                MRB_ARGS_REQ(1));
+
+  mrb_undef_class_method(mrb, class_DisplayList, "new");
+  mrb_define_method(mrb, class_DisplayList, "replay", mrb_sdl2_video_displaylist_replay,   MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, class_DisplayList, "size",   mrb_sdl2_video_displaylist_get_size, MRB_ARGS_NONE());
 
   mrb_define_method(mrb, class_RendererInfo, "name",               mrb_sdl2_video_rendererinfo_get_name,               MRB_ARGS_NONE());
   mrb_define_method(mrb, class_RendererInfo, "flags",              mrb_sdl2_video_rendererinfo_get_flags,              MRB_ARGS_NONE());
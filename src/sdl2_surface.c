@@ -1,11 +1,18 @@
 #include "sdl2_surface.h"
 #include "sdl2_rect.h"
 #include "sdl2_pixels.h"
+#include "misc.h"
 #ifdef __APPLE__
 #include <SDL2/SDL_endian.h>
 #else
 #include <SDL_endian.h>
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef MRB_SDL2_HAVE_AVX2_TARGET
+#include <immintrin.h>
+#endif
 #include "mruby/data.h"
 #include "mruby/class.h"
 #include "mruby/string.h"
@@ -61,6 +68,18 @@ mrb_sdl2_video_surface_get_ptr(mrb_state *mrb, mrb_value surface)
   return data->surface;
 }
 
+/* the pixels_view Buffer must not outlive the pixels it points at */
+static void
+mrb_sdl2_video_surface_detach_view(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym const key = mrb_intern_lit(mrb, "__pixels_view__");
+  mrb_value const view = mrb_iv_get(mrb, self, key);
+  if (!mrb_nil_p(view)) {
+    mrb_sdl2_misc_buffer_detach(mrb, view);
+    mrb_iv_set(mrb, self, key, mrb_nil_value());
+  }
+}
+
 
 static mrb_value
 mrb_sdl2_video_surface_initialize(mrb_state *mrb, mrb_value self)
@@ -78,6 +97,7 @@ mrb_sdl2_video_surface_initialize(mrb_state *mrb, mrb_value self)
     data->surface = NULL;
   } else {
     if (NULL != data->surface) {
+      mrb_sdl2_video_surface_detach_view(mrb, self);
       SDL_FreeSurface(data->surface);
     }
   }
@@ -97,6 +117,7 @@ mrb_sdl2_video_surface_free(mrb_state *mrb, mrb_value self)
   mrb_sdl2_video_surface_data_t *data =
     (mrb_sdl2_video_surface_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_surface_data_type);
   if ((NULL != data->surface)) {
+    mrb_sdl2_video_surface_detach_view(mrb, self);
     SDL_FreeSurface(data->surface);
     data->surface = NULL;
   }
@@ -180,7 +201,7 @@ mrb_sdl2_video_surface_convert_format(mrb_state *mrb, mrb_value self)
   if (NULL == new_s) {
     mruby_sdl2_raise_error(mrb);
   }
-  return mrb_sdl2_video_surface(mrb, new_s, true);
+  return mrb_sdl2_video_surface(mrb, new_s, false);
 }
 
 static mrb_value
@@ -219,19 +240,33 @@ mrb_sdl2_video_surface_fill_rect(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_sdl2_video_surface_fill_rects(mrb_state *mrb, mrb_value self)
 {
-  uint32_t color;
+  mrb_int color;
   mrb_value rects;
   mrb_int n;
   SDL_Surface *s;
   SDL_Rect * r;
   mrb_int i;
+  int result;
+  mrb_sdl2_scratch_mark_t mark;
   mrb_get_args(mrb, "io", &color, &rects);
+  s = mrb_sdl2_video_surface_get_ptr(mrb, self);
+  if (mrb_sdl2_rectarray_p(mrb, rects)) {
+    r = mrb_sdl2_rectarray_get_ptr(mrb, rects, &n);
+    if (0 != SDL_FillRects(s, r, n, (uint32_t)color)) {
+      mruby_sdl2_raise_error(mrb);
+    }
+    return self;
+  }
   if (!mrb_array_p(rects)) {
-    mrb_raise(mrb, E_TYPE_ERROR, "given 2nd argument is unexpected type (expected Array).");
+    mrb_raise(mrb, E_TYPE_ERROR, "given 2nd argument is unexpected type (expected Array or RectArray).");
   }
   n = RARRAY_LEN(rects);
-  s = mrb_sdl2_video_surface_get_ptr(mrb, self);
-  r = (SDL_Rect *) SDL_malloc(sizeof(SDL_Rect) * n);
+  /* type check every element before taking scratch memory */
+  for (i = 0; i < n; ++i) {
+    mrb_sdl2_rect_get_ptr(mrb, mrb_ary_ref(mrb, rects, i));
+  }
+  mark = mrb_sdl2_scratch_mark();
+  r = (SDL_Rect *) mrb_sdl2_scratch_alloc(mrb, sizeof(SDL_Rect) * n);
   for (i = 0; i < n; ++i) {
     SDL_Rect const * const ptr = mrb_sdl2_rect_get_ptr(mrb, mrb_ary_ref(mrb, rects, i));
     if (NULL != ptr) {
@@ -240,7 +275,9 @@ mrb_sdl2_video_surface_fill_rects(mrb_state *mrb, mrb_value self)
       r[i] = (SDL_Rect){ 0, 0, 0, 0 };
     }
   }
-  if (0 != SDL_FillRects(s, r, n, color)) {
+  result = SDL_FillRects(s, r, n, (uint32_t)color);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
     mruby_sdl2_raise_error(mrb);
   }
   return self;
@@ -388,6 +425,8 @@ mrb_sdl2_video_surface_set_rle(mrb_state *mrb, mrb_value self)
   SDL_Surface *s = mrb_sdl2_video_surface_get_ptr(mrb, self);
   mrb_bool is_rle_enabled;
   mrb_get_args(mrb, "b", &is_rle_enabled);
+  /* RLE encoding on the next blit frees the pixels a view points at */
+  mrb_sdl2_video_surface_detach_view(mrb, self);
   if (0 != SDL_SetSurfaceRLE(s, is_rle_enabled ? 1 : 0)) {
     mruby_sdl2_raise_error(mrb);
   }
@@ -409,6 +448,10 @@ mrb_sdl2_video_surface_unlock(mrb_state *mrb, mrb_value self)
 {
   SDL_Surface *s = mrb_sdl2_video_surface_get_ptr(mrb, self);
   SDL_UnlockSurface(s);
+  if (SDL_MUSTLOCK(s) && (0 == s->locked)) {
+    /* RLE surfaces are re-encoded on the last unlock */
+    mrb_sdl2_video_surface_detach_view(mrb, self);
+  }
   return self;
 }
 
@@ -503,7 +546,18 @@ mrb_sdl2_video_surface_convert(mrb_state *mrb, mrb_value self)
   if (NULL == new_s) {
     mruby_sdl2_raise_error(mrb);
   }
-  return mrb_sdl2_video_surface(mrb, new_s, true);
+  return mrb_sdl2_video_surface(mrb, new_s, false);
+}
+
+static void
+mrb_sdl2_video_surface_check_point(mrb_state *mrb, SDL_Surface const *surface, mrb_int x, mrb_int y)
+{
+  if (NULL == surface) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "surface is already freed.");
+  }
+  if ((x < 0) || (y < 0) || (x >= surface->w) || (y >= surface->h)) {
+    mrb_raise(mrb, E_INDEX_ERROR, "pixel position out of bounds.");
+  }
 }
 
 static mrb_value
@@ -544,6 +598,7 @@ mrb_sdl2_video_surface_get_pixel(mrb_state *mrb, mrb_value self)
   mrb_int x, y;
   mrb_get_args(mrb, "ii", &x, &y);
   surface = mrb_sdl2_video_surface_get_ptr(mrb, self);
+  mrb_sdl2_video_surface_check_point(mrb, surface, x, y);
   return mrb_sdl2_video_surface_return_pixel(mrb, surface, x, y);
 }
 
@@ -556,6 +611,7 @@ mrb_sdl2_video_surface_set_pixel(mrb_state *mrb, mrb_value self)
   Uint8 *p;
   mrb_get_args(mrb, "iii", &x, &y, &pixel);
   surface = mrb_sdl2_video_surface_get_ptr(mrb, self);
+  mrb_sdl2_video_surface_check_point(mrb, surface, x, y);
   bpp = surface->format->BytesPerPixel;
   /* Here p is the address to the pixel we want to set */
   p = (Uint8 *)surface->pixels + y * surface->pitch + x * bpp;
@@ -589,6 +645,156 @@ mrb_sdl2_video_surface_set_pixel(mrb_state *mrb, mrb_value self)
   return mrb_true_value();
 }
 
+/*
+ * Resolves `rect` (nil for the whole surface) to an area that must lie
+ * inside the surface.
+ */
+static SDL_Surface *
+mrb_sdl2_video_surface_region(mrb_state *mrb, mrb_value self, mrb_value rect, SDL_Rect *area)
+{
+  SDL_Surface *surface = mrb_sdl2_video_surface_get_ptr(mrb, self);
+  SDL_Rect const *r = mrb_sdl2_rect_get_ptr(mrb, rect);
+  if (NULL == surface) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "surface is already freed.");
+  }
+  *area = (NULL != r) ? *r : (SDL_Rect){ 0, 0, surface->w, surface->h };
+  if ((area->x < 0) || (area->y < 0) || (area->w < 0) || (area->h < 0) ||
+      (area->w > surface->w - area->x) || (area->h > surface->h - area->y)) {
+    mrb_raise(mrb, E_INDEX_ERROR, "region out of bounds.");
+  }
+  return surface;
+}
+
+/*
+ * SDL2::Video::Surface#read_region(rect = nil, into = nil)
+ *
+ * Copies the pixels of `rect` out row by row, tightly packed (w * bytes per
+ * pixel per row). Returns a new String, or `into` (a String, resized, or a
+ * Buffer large enough) filled in place.
+ */
+static mrb_value
+mrb_sdl2_video_surface_read_region(mrb_state *mrb, mrb_value self)
+{
+  mrb_value rect = mrb_nil_value();
+  mrb_value into = mrb_nil_value();
+  SDL_Surface *surface;
+  SDL_Rect area;
+  size_t row, size;
+  uint8_t *dst;
+  int bpp;
+  mrb_get_args(mrb, "|oo", &rect, &into);
+  surface = mrb_sdl2_video_surface_region(mrb, self, rect, &area);
+  bpp  = surface->format->BytesPerPixel;
+  row  = (size_t)area.w * bpp;
+  size = row * area.h;
+  if (mrb_nil_p(into)) {
+    into = mrb_str_new(mrb, NULL, size);
+    dst = (uint8_t *)RSTRING_PTR(into);
+  } else if (mrb_string_p(into)) {
+    mrb_str_resize(mrb, into, (mrb_int)size);
+    dst = (uint8_t *)RSTRING_PTR(into);
+  } else {
+    size_t capacity;
+    dst = (uint8_t *)mrb_sdl2_misc_buffer_get_ptr(mrb, into, &capacity);
+    if (capacity < size) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "buffer is too small for the region.");
+    }
+  }
+  if (SDL_MUSTLOCK(surface) && (0 != SDL_LockSurface(surface))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  mrb_sdl2_misc_copy_rows(dst, (int)row,
+                          (uint8_t const *)surface->pixels + area.y * surface->pitch + area.x * bpp,
+                          surface->pitch, row, area.h);
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_UnlockSurface(surface);
+  }
+  return into;
+}
+
+/*
+ * SDL2::Video::Surface#write_region(rect, data, pitch = w * bytes per pixel)
+ *
+ * Copies pixels from a String or Buffer into `rect` (nil for the whole
+ * surface). Rows in `data` are `pitch` bytes apart.
+ */
+static mrb_value
+mrb_sdl2_video_surface_write_region(mrb_state *mrb, mrb_value self)
+{
+  mrb_value rect, data;
+  SDL_Surface *surface;
+  SDL_Rect area;
+  size_t row, size;
+  mrb_int pitch;
+  uint8_t const *src;
+  int bpp;
+  int const argc = mrb_get_args(mrb, "oo|i", &rect, &data, &pitch);
+  surface = mrb_sdl2_video_surface_region(mrb, self, rect, &area);
+  bpp = surface->format->BytesPerPixel;
+  row = (size_t)area.w * bpp;
+  if (argc < 3) {
+    pitch = (mrb_int)row;
+  }
+  src = (uint8_t const *)mrb_sdl2_misc_bytes_get_ptr(mrb, data, &size);
+  if ((pitch < (mrb_int)row) || (pitch > SDL_MAX_SINT32)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "pitch is out of range.");
+  }
+  if ((0 < area.h) && (size < (size_t)pitch * (area.h - 1) + row)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "data is too small for the region.");
+  }
+  if (SDL_MUSTLOCK(surface) && (0 != SDL_LockSurface(surface))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  mrb_sdl2_misc_copy_rows((uint8_t *)surface->pixels + area.y * surface->pitch + area.x * bpp,
+                          surface->pitch, src, (int)pitch, row, area.h);
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_UnlockSurface(surface);
+  }
+  return self;
+}
+
+/*
+ * SDL2::Video::Surface#pixels_view
+ *
+ * A ByteBuffer over the surface's own pixel memory (pitch * height bytes),
+ * without copying. Surfaces that must be locked have to be locked first;
+ * the view is emptied when the surface is freed, finally unlocked or has
+ * its RLE flag changed. Window surfaces, whose pixels SDL replaces on a
+ * resize, have no view.
+ */
+static mrb_value
+mrb_sdl2_video_surface_pixels_view(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym const key = mrb_intern_lit(mrb, "__pixels_view__");
+  mrb_sdl2_video_surface_data_t *data =
+    (mrb_sdl2_video_surface_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_surface_data_type);
+  SDL_Surface *surface = data->surface;
+  mrb_value view;
+  size_t const size = (NULL != surface) ? (size_t)surface->pitch * surface->h : 0;
+  if (NULL == surface) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "surface is already freed.");
+  }
+  if (data->is_associated) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "window surfaces have no pixels view.");
+  }
+  if (SDL_MUSTLOCK(surface) && (0 == surface->locked)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "surface must be locked.");
+  }
+  view = mrb_iv_get(mrb, self, key);
+  if (!mrb_nil_p(view)) {
+    size_t view_size;
+    if ((mrb_sdl2_misc_buffer_get_ptr(mrb, view, &view_size) == surface->pixels) && (view_size == size)) {
+      return view;
+    }
+    mrb_sdl2_video_surface_detach_view(mrb, self);
+  }
+  view = mrb_sdl2_misc_buffer_view(mrb, surface->pixels, size);
+  /* keeps the surface alive while the view is */
+  mrb_iv_set(mrb, view, mrb_intern_lit(mrb, "__surface__"), self);
+  mrb_iv_set(mrb, self, key, view);
+  return view;
+}
+
 static mrb_value
 mrb_sdl2_video_surface_must_lock(mrb_state *mrb, mrb_value self)
 {
@@ -607,81 +813,147 @@ mrb_sdl2_video_surface_locked_num(mrb_state *mrb, mrb_value self)
   return mrb_fixnum_value(surface->locked);
 }
 
+#ifdef MRB_SDL2_HAVE_AVX2_TARGET
+/* 32-byte stores for the 32-bit spans; returns how many pixels it wrote */
+__attribute__((target("avx2"))) static int
+mrb_sdl2_video_surface_fill_span32_avx2(uint8_t *dst, int n, Uint32 pixel)
+{
+  __m256i const v = _mm256_set1_epi32((int)pixel);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_si256((__m256i *)(dst + i * 4), v);
+  }
+  return i;
+}
+#endif
+
+/*
+ * Writes `n` copies of a mapped pixel value. 32-bit spans are stored 32
+ * bytes at a time on CPUs with AVX2 and 16 bytes at a time with SSE2.
+ */
+static void
+mrb_sdl2_video_surface_fill_span(uint8_t *dst, int n, int bpp, Uint32 pixel)
+{
+  int i = 0;
+  switch (bpp) {
+  case 1:
+    SDL_memset(dst, (int)(pixel & 0xff), (size_t)n);
+    break;
+  case 2: {
+    Uint16 const p = (Uint16)pixel;
+    for (; i < n; ++i) {
+      SDL_memcpy(dst + i * 2, &p, 2);
+    }
+    break;
+  }
+  case 3: {
+    uint8_t bytes[3];
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    bytes[0] = (uint8_t)pixel;
+    bytes[1] = (uint8_t)(pixel >> 8);
+    bytes[2] = (uint8_t)(pixel >> 16);
+#else
+    bytes[0] = (uint8_t)(pixel >> 16);
+    bytes[1] = (uint8_t)(pixel >> 8);
+    bytes[2] = (uint8_t)pixel;
+#endif
+    for (; i < n; ++i) {
+      dst[i * 3]     = bytes[0];
+      dst[i * 3 + 1] = bytes[1];
+      dst[i * 3 + 2] = bytes[2];
+    }
+    break;
+  }
+  default: {
+#ifdef MRB_SDL2_HAVE_AVX2_TARGET
+    if ((8 <= n) && mrb_sdl2_misc_has_avx2()) {
+      i = mrb_sdl2_video_surface_fill_span32_avx2(dst, n, pixel);
+    }
+#endif
+#ifdef __SSE2__
+    __m128i const v = _mm_set1_epi32((int)pixel);
+    for (; i + 4 <= n; i += 4) {
+      _mm_storeu_si128((__m128i *)(dst + i * 4), v);
+    }
+#endif
+    for (; i < n; ++i) {
+      SDL_memcpy(dst + i * 4, &pixel, 4);
+    }
+    break;
+  }
+  }
+}
+
+/*
+ * SDL2::Video::Surface#gradient_fill_rect(r1, g1, b1, a1, r2, g2, b2, a2, rect, vertical)
+ *
+ * Interpolates each channel in 16.16 fixed point along the rect and writes
+ * into the locked pixels, clipped to the surface's clip rect. Vertical
+ * gradients fill one span per row; horizontal ones build the first row
+ * and copy it down.
+ */
 static mrb_value
 mrb_sdl2_video_surface_gradient_fill_rect(mrb_state *mrb, mrb_value self)
 {
   SDL_Surface *surface;
-  mrb_int r1, r2, g1, g2, b1, b2, a1, a2;
+  mrb_int c1[4], c2[4];
   mrb_value rect;
   SDL_Rect *re = NULL;
+  SDL_Rect area;
   mrb_bool vertical;
-  float i;
-  mrb_get_args(mrb, "iiiiiiiiob", &r1, &g1, &b1, &a1, &r2, &g2, &b2, &a2, &rect, &vertical);
+  int32_t acc[4], step[4];
+  uint8_t *origin;
+  int bpp, len, start, count, k, i;
+  mrb_get_args(mrb, "iiiiiiiiob", &c1[0], &c1[1], &c1[2], &c1[3], &c2[0], &c2[1], &c2[2], &c2[3], &rect, &vertical);
   surface = mrb_sdl2_video_surface_get_ptr(mrb, self);
   re = mrb_sdl2_rect_get_ptr(mrb, rect);
 
   if (surface == NULL || re == NULL) {
     mruby_sdl2_raise_error(mrb);
   }
+  if (!SDL_IntersectRect(re, &surface->clip_rect, &area)) {
+    return self;
+  }
+  len   = vertical ? re->h : re->w;
+  start = vertical ? (area.y - re->y) : (area.x - re->x);
+  count = vertical ? area.h : area.w;
+  for (k = 0; k < 4; ++k) {
+    int32_t const from = (int32_t)SDL_max(0, SDL_min(255, c1[k]));
+    int32_t const to   = (int32_t)SDL_max(0, SDL_min(255, c2[k]));
+    step[k] = (int32_t)(((int64_t)(to - from) << 16) / len);
+    acc[k]  = (from << 16) + step[k] * start;
+  }
   if (SDL_MUSTLOCK(surface)) {
     if (0 != SDL_LockSurface(surface)) {
       mruby_sdl2_raise_error(mrb);
     }
   }
-
-  int difr = r2 - r1;
-  int difg = g2 - g1;
-  int difb = b2 - b1;
-  int difa = a2 - a1;
-  if (vertical) {
-    for (i = 0; i < re->h; i+=1.0) {
-      float mod = i / re->h;
-      SDL_Rect rec;
-      rec.x = re->x;
-      rec.y = re->y + i;
-      rec.w = re->w;
-      rec.h = 1;
-      int r = r1 + difr * mod;
-      int g = g1 + difg * mod;
-      int b = b1 + difb * mod;
-      int a = a1 + difa * mod;
-      if (0 != SDL_FillRect(surface,
-			    &rec,
-			    SDL_MapRGBA(surface->format,
-					r,
-					g,
-					b,
-					a))) {
-	mruby_sdl2_raise_error(mrb);
-      }
+  bpp = surface->format->BytesPerPixel;
+  origin = (uint8_t *)surface->pixels + area.y * surface->pitch + area.x * bpp;
+  for (i = 0; i < count; ++i) {
+    Uint32 const pixel = SDL_MapRGBA(surface->format,
+                                     (Uint8)(acc[0] >> 16), (Uint8)(acc[1] >> 16),
+                                     (Uint8)(acc[2] >> 16), (Uint8)(acc[3] >> 16));
+    if (vertical) {
+      mrb_sdl2_video_surface_fill_span(origin + i * surface->pitch, area.w, bpp, pixel);
+    } else {
+      mrb_sdl2_video_surface_fill_span(origin + i * bpp, 1, bpp, pixel);
     }
-  } else {
-    for (i = 0; i < re->w; i+=1.0) {
-      float mod = i / re->w;
-      SDL_Rect rec;
-      rec.x = re->x + i;
-      rec.y = re->y;
-      rec.w = 1;
-      rec.h = re->h;
-      int r = r1 + difr * mod;
-      int g = g1 + difg * mod;
-      int b = b1 + difb * mod;
-      int a = a1 + difa * mod;
-      if (0 != SDL_FillRect(surface, &rec,
-			    SDL_MapRGBA(surface->format,
-					r, g, b,a))) {
-	mruby_sdl2_raise_error(mrb);
-      }
+    for (k = 0; k < 4; ++k) {
+      acc[k] += step[k];
+    }
+  }
+  if (!vertical) {
+    for (i = 1; i < area.h; ++i) {
+      SDL_memcpy(origin + i * surface->pitch, origin, (size_t)area.w * bpp);
     }
   }
-
   if (SDL_MUSTLOCK(surface)) {
     SDL_UnlockSurface(surface);
   }
   return self;
 }
 
-
 void
 mruby_sdl2_video_surface_init(mrb_state *mrb, struct RClass *mod_Video)
 {
@@ -723,6 +995,9 @@ mruby_sdl2_video_surface_init(mrb_state *mrb, struct RClass *mod_Video)
   mrb_define_method(mrb, class_Surface, "convert",            mrb_sdl2_video_surface_convert,            MRB_ARGS_REQ(1));
   mrb_define_method(mrb, class_Surface, "get_pixel",          mrb_sdl2_video_surface_get_pixel,          MRB_ARGS_REQ(2));
   mrb_define_method(mrb, class_Surface, "set_pixel",          mrb_sdl2_video_surface_set_pixel,          MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, class_Surface, "read_region",        mrb_sdl2_video_surface_read_region,        MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, class_Surface, "write_region",       mrb_sdl2_video_surface_write_region,       MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_Surface, "pixels_view",        mrb_sdl2_video_surface_pixels_view,        MRB_ARGS_NONE());
 
   arena_size = mrb_gc_arena_save(mrb);
   mrb_define_const(mrb, class_Surface, "SDL_BLENDMODE_NONE",  mrb_fixnum_value(SDL_BLENDMODE_NONE));
@@ -0,0 +1,754 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_surface.h"
+#include "sdl2_surface_filter.h"
+#include "misc.h"
+#include "mruby/array.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include <math.h>
+#ifdef __APPLE__
+#include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_endian.h>
+#else
+#include <SDL_surface.h>
+#include <SDL_endian.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* radius 512, far beyond anything a 3 sigma gaussian needs on screen */
+#define MRB_SDL2_FILTER_MAX_TAPS 1025
+
+/* rows per chunk handed to the worker pool */
+#define MRB_SDL2_FILTER_GRAIN 8
+
+/*
+ * One separable convolution: the horizontal pass reads the surface and
+ * writes `tmp` (w * 4 floats per row), the vertical pass reads `tmp` and
+ * writes the surface back. Edges are clamped. `tmp` is neither rounded nor
+ * clamped, so negative kernel lobes survive until the final store. Each
+ * worker owns one padded source line and one float accumulator row. With
+ * an alpha channel the line is premultiplied and the result divided back
+ * by alpha on store.
+ */
+typedef struct mrb_sdl2_filter_job_t {
+  uint8_t     *pixels;
+  int          pitch;
+  int          w;
+  int          h;
+  float       *tmp;
+  uint8_t     *lines;
+  float       *accs;
+  float const *kx;
+  int          rx;
+  float const *ky;
+  int          ry;
+  int          alpha;
+} mrb_sdl2_filter_job_t;
+
+/* acc[i] += weight * src[i] */
+static void
+mrb_sdl2_filter_accumulate(float *acc, uint8_t const *src, int n, float weight)
+{
+  int i = 0;
+#ifdef __SSE2__
+  __m128 const  w    = _mm_set1_ps(weight);
+  __m128i const zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i const px = _mm_loadu_si128((__m128i const *)(src + i));
+    __m128i const lo = _mm_unpacklo_epi8(px, zero);
+    __m128i const hi = _mm_unpackhi_epi8(px, zero);
+    _mm_storeu_ps(acc + i,      _mm_add_ps(_mm_loadu_ps(acc + i),      _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), w)));
+    _mm_storeu_ps(acc + i + 4,  _mm_add_ps(_mm_loadu_ps(acc + i + 4),  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), w)));
+    _mm_storeu_ps(acc + i + 8,  _mm_add_ps(_mm_loadu_ps(acc + i + 8),  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), w)));
+    _mm_storeu_ps(acc + i + 12, _mm_add_ps(_mm_loadu_ps(acc + i + 12), _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), w)));
+  }
+#endif
+  for (; i < n; ++i) {
+    acc[i] += weight * src[i];
+  }
+}
+
+/* acc[i] += weight * src[i], for a float source */
+static void
+mrb_sdl2_filter_accumulate_f(float *acc, float const *src, int n, float weight)
+{
+  int i = 0;
+#ifdef __SSE2__
+  __m128 const w = _mm_set1_ps(weight);
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_ps(acc + i,     _mm_add_ps(_mm_loadu_ps(acc + i),     _mm_mul_ps(_mm_loadu_ps(src + i), w)));
+    _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), w)));
+  }
+#endif
+  for (; i < n; ++i) {
+    acc[i] += weight * src[i];
+  }
+}
+
+/* dst[i] = acc[i] rounded and clamped to 0..255 */
+static void
+mrb_sdl2_filter_store(uint8_t *dst, float const *acc, int n)
+{
+  int i = 0;
+#ifdef __SSE2__
+  __m128 const half = _mm_set1_ps(0.5f);
+  __m128 const lo   = _mm_setzero_ps();
+  __m128 const hi   = _mm_set1_ps(255.0f);
+#define MRB_SDL2_FILTER_ROUND4(p) \
+  _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_loadu_ps(p), half), lo), hi))
+  for (; i + 16 <= n; i += 16) {
+    __m128i const a = MRB_SDL2_FILTER_ROUND4(acc + i);
+    __m128i const b = MRB_SDL2_FILTER_ROUND4(acc + i + 4);
+    __m128i const c = MRB_SDL2_FILTER_ROUND4(acc + i + 8);
+    __m128i const d = MRB_SDL2_FILTER_ROUND4(acc + i + 12);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+  }
+#undef MRB_SDL2_FILTER_ROUND4
+#endif
+  for (; i < n; ++i) {
+    float const v = acc[i] + 0.5f;
+    dst[i] = (v <= 0.0f) ? 0 : ((v >= 255.0f) ? 255 : (uint8_t)v);
+  }
+}
+
+/* byte offset of alpha within a pixel, -1 without alpha */
+static int
+mrb_sdl2_filter_alpha_index(SDL_PixelFormat const *format)
+{
+  if (0 == format->Amask) {
+    return -1;
+  }
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+  return 3 - format->Ashift / 8;
+#else
+  return format->Ashift / 8;
+#endif
+}
+
+/* color bytes of n pixels *= alpha / 255, rounded */
+static void
+mrb_sdl2_filter_premultiply(uint8_t *p, int n, int alpha)
+{
+  int i, c;
+  for (i = 0; i < n; ++i, p += 4) {
+    int const a = p[alpha];
+    for (c = 0; c < 4; ++c) {
+      if (c != alpha) {
+        int const x = p[c] * a + 128;
+        p[c] = (uint8_t)((x + (x >> 8)) >> 8);
+      }
+    }
+  }
+}
+
+/* color sums of n pixels *= 255 / alpha; colors of what stores as transparent go to 0 */
+static void
+mrb_sdl2_filter_unpremultiply(float *acc, int n, int alpha)
+{
+  int i, c;
+  for (i = 0; i < n; ++i, acc += 4) {
+    float const scale = (acc[alpha] >= 0.5f) ? 255.0f / acc[alpha] : 0.0f;
+    for (c = 0; c < 4; ++c) {
+      if (c != alpha) {
+        acc[c] *= scale;
+      }
+    }
+  }
+}
+
+static void
+mrb_sdl2_filter_rows_h(void *ctx, int begin, int end, int worker)
+{
+  mrb_sdl2_filter_job_t const *job = (mrb_sdl2_filter_job_t const *)ctx;
+  int const n    = job->w * 4;
+  int const taps = job->rx * 2 + 1;
+  uint8_t *line  = job->lines + (size_t)worker * (job->w + job->rx * 2) * 4;
+  int y, i, k;
+  for (y = begin; y < end; ++y) {
+    uint8_t const *src = job->pixels + (size_t)y * job->pitch;
+    float *acc = job->tmp + (size_t)y * n;
+    for (i = 0; i < job->rx; ++i) {
+      SDL_memcpy(line + i * 4,                      src,         4);
+      SDL_memcpy(line + (job->rx + job->w + i) * 4, src + n - 4, 4);
+    }
+    SDL_memcpy(line + job->rx * 4, src, n);
+    if (0 <= job->alpha) {
+      mrb_sdl2_filter_premultiply(line, job->w + job->rx * 2, job->alpha);
+    }
+    SDL_memset(acc, 0, n * sizeof(float));
+    for (k = 0; k < taps; ++k) {
+      mrb_sdl2_filter_accumulate(acc, line + k * 4, n, job->kx[k]);
+    }
+  }
+}
+
+static void
+mrb_sdl2_filter_rows_v(void *ctx, int begin, int end, int worker)
+{
+  mrb_sdl2_filter_job_t const *job = (mrb_sdl2_filter_job_t const *)ctx;
+  int const n    = job->w * 4;
+  int const taps = job->ry * 2 + 1;
+  float *acc     = job->accs + (size_t)worker * n;
+  int y, k;
+  for (y = begin; y < end; ++y) {
+    SDL_memset(acc, 0, n * sizeof(float));
+    for (k = 0; k < taps; ++k) {
+      int const sy = SDL_max(0, SDL_min(job->h - 1, y + k - job->ry));
+      mrb_sdl2_filter_accumulate_f(acc, job->tmp + (size_t)sy * n, n, job->ky[k]);
+    }
+    if (0 <= job->alpha) {
+      mrb_sdl2_filter_unpremultiply(acc, job->w, job->alpha);
+    }
+    mrb_sdl2_filter_store(job->pixels + (size_t)y * job->pitch, acc, n);
+  }
+}
+
+/* 32-bit pixels whose channels are whole bytes, so bytes can be filtered */
+static bool
+mrb_sdl2_filter_supported(SDL_PixelFormat const *format)
+{
+  return (4 == format->BytesPerPixel) && (NULL == format->palette) &&
+         (0 == format->Rloss) && (0 == format->Gloss) && (0 == format->Bloss) &&
+         (0 == format->Rshift % 8) && (0 == format->Gshift % 8) && (0 == format->Bshift % 8) &&
+         ((0 == format->Amask) || ((0 == format->Aloss) && (0 == format->Ashift % 8)));
+}
+
+/*
+ * Filters a surface of a supported format in place. Returns the result of
+ * locking it, so a failure can be raised once the caller's scratch memory
+ * is released.
+ */
+static int
+mrb_sdl2_filter_convolve(mrb_state *mrb, SDL_Surface *surface, float const *kx, int rx, float const *ky, int ry)
+{
+  mrb_sdl2_filter_job_t job;
+  mrb_sdl2_scratch_mark_t mark;
+  int const workers = mrb_sdl2_parallel_workers();
+  if ((0 >= surface->w) || (0 >= surface->h)) {
+    return 0;
+  }
+  mark = mrb_sdl2_scratch_mark();
+  job.w     = surface->w;
+  job.h     = surface->h;
+  job.kx    = kx;
+  job.rx    = rx;
+  job.ky    = ky;
+  job.ry    = ry;
+  job.alpha = mrb_sdl2_filter_alpha_index(surface->format);
+  job.tmp   = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)job.w * job.h * 4 * sizeof(float));
+  job.lines = (uint8_t *)mrb_sdl2_scratch_alloc(mrb, (size_t)workers * (job.w + rx * 2) * 4);
+  job.accs  = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)workers * job.w * 4 * sizeof(float));
+  if (SDL_MUSTLOCK(surface) && (0 != SDL_LockSurface(surface))) {
+    mrb_sdl2_scratch_release(mark);
+    return -1;
+  }
+  job.pixels = (uint8_t *)surface->pixels;
+  job.pitch  = surface->pitch;
+  mrb_sdl2_parallel_for(job.h, MRB_SDL2_FILTER_GRAIN, mrb_sdl2_filter_rows_h, &job);
+  mrb_sdl2_parallel_for(job.h, MRB_SDL2_FILTER_GRAIN, mrb_sdl2_filter_rows_v, &job);
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_UnlockSurface(surface);
+  }
+  mrb_sdl2_scratch_release(mark);
+  return 0;
+}
+
+/*
+ * Resampling weights along one axis: destination coordinate i reads
+ * source pixels first[i] .. first[i] + taps - 1. Taps falling off the
+ * image are folded onto the edge pixel, so every window is in bounds.
+ */
+typedef enum mrb_sdl2_filter_scale_t {
+  MRB_SDL2_FILTER_BILINEAR,
+  MRB_SDL2_FILTER_BICUBIC,
+  MRB_SDL2_FILTER_BOX
+} mrb_sdl2_filter_scale_t;
+
+typedef struct mrb_sdl2_filter_axis_t {
+  int   *first;
+  float *weights;
+  int    taps;
+} mrb_sdl2_filter_axis_t;
+
+/* Catmull-Rom (a = -0.5) */
+static float
+mrb_sdl2_filter_cubic(float t)
+{
+  t = (t < 0.0f) ? -t : t;
+  if (t < 1.0f) {
+    return (1.5f * t - 2.5f) * t * t + 1.0f;
+  }
+  if (t < 2.0f) {
+    return ((-0.5f * t + 2.5f) * t - 4.0f) * t + 2.0f;
+  }
+  return 0.0f;
+}
+
+static void
+mrb_sdl2_filter_axis(mrb_state *mrb, mrb_sdl2_filter_axis_t *axis, mrb_sdl2_filter_scale_t filter, int src_size, int dst_size)
+{
+  float const scale = (float)src_size / (float)dst_size;
+  int taps, i, j;
+  float *w;
+  switch (filter) {
+  case MRB_SDL2_FILTER_BILINEAR:
+    taps = 2;
+    break;
+  case MRB_SDL2_FILTER_BICUBIC:
+    taps = 4;
+    break;
+  default:
+    taps = (int)ceilf(scale) + 1;
+    break;
+  }
+  w = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)taps * sizeof(float));
+  axis->taps    = SDL_min(taps, src_size);
+  axis->first   = (int *)mrb_sdl2_scratch_alloc(mrb, (size_t)dst_size * sizeof(int));
+  axis->weights = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)dst_size * axis->taps * sizeof(float));
+  for (i = 0; i < dst_size; ++i) {
+    float *out = axis->weights + (size_t)i * axis->taps;
+    float sum = 0.0f;
+    int base, start;
+    if (MRB_SDL2_FILTER_BOX == filter) {
+      /* coverage of [lo, hi) over each source pixel */
+      float const lo = (float)i * scale;
+      float const hi = lo + scale;
+      base = (int)floorf(lo);
+      for (j = 0; j < taps; ++j) {
+        float const a = SDL_max(lo, (float)(base + j));
+        float const b = SDL_min(hi, (float)(base + j + 1));
+        w[j] = (b > a) ? (b - a) : 0.0f;
+      }
+    } else {
+      float const center = ((float)i + 0.5f) * scale - 0.5f;
+      base = (int)floorf(center) - (taps / 2 - 1);
+      for (j = 0; j < taps; ++j) {
+        float const t = center - (float)(base + j);
+        if (MRB_SDL2_FILTER_BILINEAR == filter) {
+          w[j] = SDL_max(0.0f, 1.0f - ((t < 0.0f) ? -t : t));
+        } else {
+          w[j] = mrb_sdl2_filter_cubic(t);
+        }
+      }
+    }
+    start = SDL_max(0, SDL_min(base, src_size - axis->taps));
+    SDL_memset(out, 0, axis->taps * sizeof(float));
+    for (j = 0; j < taps; ++j) {
+      int const index = SDL_max(0, SDL_min(src_size - 1, base + j));
+      out[index - start] += w[j];
+      sum += w[j];
+    }
+    if (0.0f != sum) {
+      for (j = 0; j < axis->taps; ++j) {
+        out[j] /= sum;
+      }
+    }
+    axis->first[i] = start;
+  }
+}
+
+/*
+ * Horizontal pass from the source (sw x sh) into `tmp` (dw x sh floats per
+ * channel), then a vertical pass from `tmp` into the destination (dw x dh).
+ * Bicubic over- and undershoot is kept in `tmp` and only clamped on the
+ * final store. With an alpha channel each source row is premultiplied into
+ * a per-worker line first.
+ */
+typedef struct mrb_sdl2_filter_scale_job_t {
+  uint8_t const                *src;
+  int                           src_pitch;
+  uint8_t                      *dst;
+  int                           dst_pitch;
+  int                           sw;
+  int                           dw;
+  float                        *tmp;
+  uint8_t                      *lines;
+  float                        *accs;
+  int                           alpha;
+  mrb_sdl2_filter_axis_t const *ax;
+  mrb_sdl2_filter_axis_t const *ay;
+} mrb_sdl2_filter_scale_job_t;
+
+static void
+mrb_sdl2_filter_scale_rows_h(void *ctx, int begin, int end, int worker)
+{
+  mrb_sdl2_filter_scale_job_t const *job = (mrb_sdl2_filter_scale_job_t const *)ctx;
+  mrb_sdl2_filter_axis_t const *ax = job->ax;
+  int const n = job->dw * 4;
+  int y, x, k;
+  for (y = begin; y < end; ++y) {
+    uint8_t const *row = job->src + (size_t)y * job->src_pitch;
+    float *acc = job->tmp + (size_t)y * n;
+    if (0 <= job->alpha) {
+      uint8_t *line = job->lines + (size_t)worker * job->sw * 4;
+      SDL_memcpy(line, row, (size_t)job->sw * 4);
+      mrb_sdl2_filter_premultiply(line, job->sw, job->alpha);
+      row = line;
+    }
+    for (x = 0; x < job->dw; ++x) {
+      uint8_t const *p = row + (size_t)ax->first[x] * 4;
+      float const   *w = ax->weights + (size_t)x * ax->taps;
+#ifdef __SSE2__
+      __m128i const zero = _mm_setzero_si128();
+      __m128 sum = _mm_setzero_ps();
+      for (k = 0; k < ax->taps; ++k) {
+        int v;
+        __m128i px;
+        SDL_memcpy(&v, p + k * 4, 4);
+        px  = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(w[k])));
+      }
+      _mm_storeu_ps(acc + x * 4, sum);
+#else
+      float *sum = acc + x * 4;
+      sum[0] = sum[1] = sum[2] = sum[3] = 0.0f;
+      for (k = 0; k < ax->taps; ++k) {
+        sum[0] += w[k] * p[k * 4];
+        sum[1] += w[k] * p[k * 4 + 1];
+        sum[2] += w[k] * p[k * 4 + 2];
+        sum[3] += w[k] * p[k * 4 + 3];
+      }
+#endif
+    }
+  }
+}
+
+static void
+mrb_sdl2_filter_scale_rows_v(void *ctx, int begin, int end, int worker)
+{
+  mrb_sdl2_filter_scale_job_t const *job = (mrb_sdl2_filter_scale_job_t const *)ctx;
+  mrb_sdl2_filter_axis_t const *ay = job->ay;
+  int const n = job->dw * 4;
+  float *acc  = job->accs + (size_t)worker * n;
+  int y, k;
+  for (y = begin; y < end; ++y) {
+    float const *w = ay->weights + (size_t)y * ay->taps;
+    SDL_memset(acc, 0, n * sizeof(float));
+    for (k = 0; k < ay->taps; ++k) {
+      mrb_sdl2_filter_accumulate_f(acc, job->tmp + (size_t)(ay->first[y] + k) * n, n, w[k]);
+    }
+    if (0 <= job->alpha) {
+      mrb_sdl2_filter_unpremultiply(acc, job->dw, job->alpha);
+    }
+    mrb_sdl2_filter_store(job->dst + (size_t)y * job->dst_pitch, acc, n);
+  }
+}
+
+/* returns the result of locking `src`, like mrb_sdl2_filter_convolve() */
+static int
+mrb_sdl2_filter_scale(mrb_state *mrb, SDL_Surface *src, SDL_Surface *dst, mrb_sdl2_filter_scale_t filter)
+{
+  mrb_sdl2_filter_scale_job_t job;
+  mrb_sdl2_filter_axis_t ax, ay;
+  mrb_sdl2_scratch_mark_t const mark = mrb_sdl2_scratch_mark();
+  int const workers = mrb_sdl2_parallel_workers();
+  mrb_sdl2_filter_axis(mrb, &ax, filter, src->w, dst->w);
+  mrb_sdl2_filter_axis(mrb, &ay, filter, src->h, dst->h);
+  job.sw    = src->w;
+  job.dw    = dst->w;
+  job.ax    = &ax;
+  job.ay    = &ay;
+  job.alpha = mrb_sdl2_filter_alpha_index(src->format);
+  job.tmp   = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)dst->w * src->h * 4 * sizeof(float));
+  job.lines = NULL;
+  if (0 <= job.alpha) {
+    job.lines = (uint8_t *)mrb_sdl2_scratch_alloc(mrb, (size_t)workers * src->w * 4);
+  }
+  job.accs  = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)workers * dst->w * 4 * sizeof(float));
+  if (SDL_MUSTLOCK(src) && (0 != SDL_LockSurface(src))) {
+    mrb_sdl2_scratch_release(mark);
+    return -1;
+  }
+  job.src       = (uint8_t const *)src->pixels;
+  job.src_pitch = src->pitch;
+  job.dst       = (uint8_t *)dst->pixels;
+  job.dst_pitch = dst->pitch;
+  mrb_sdl2_parallel_for(src->h, MRB_SDL2_FILTER_GRAIN, mrb_sdl2_filter_scale_rows_h, &job);
+  if (SDL_MUSTLOCK(src)) {
+    SDL_UnlockSurface(src);
+  }
+  mrb_sdl2_parallel_for(dst->h, MRB_SDL2_FILTER_GRAIN, mrb_sdl2_filter_scale_rows_v, &job);
+  mrb_sdl2_scratch_release(mark);
+  return 0;
+}
+
+/* checks a kernel is an odd-length Array of numbers; returns the radius */
+static int
+mrb_sdl2_filter_kernel_radius(mrb_state *mrb, mrb_value array)
+{
+  mrb_int const n = RARRAY_LEN(array);
+  mrb_int i;
+  if ((0 == (n & 1)) || (MRB_SDL2_FILTER_MAX_TAPS < n)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "kernel needs an odd number of weights (at most 1025).");
+  }
+  for (i = 0; i < n; ++i) {
+    mrb_value const item = mrb_ary_ref(mrb, array, i);
+    if (!mrb_fixnum_p(item) && !mrb_float_p(item)) {
+      mrb_raise(mrb, E_TYPE_ERROR, "given argument is unexpected type (expected Numeric).");
+    }
+  }
+  return (int)(n / 2);
+}
+
+/* a checked kernel -> scratch floats */
+static float *
+mrb_sdl2_filter_kernel(mrb_state *mrb, mrb_value array)
+{
+  mrb_int const n = RARRAY_LEN(array);
+  float *kernel = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)n * sizeof(float));
+  mrb_int i;
+  for (i = 0; i < n; ++i) {
+    mrb_value const item = mrb_ary_ref(mrb, array, i);
+    kernel[i] = mrb_fixnum_p(item) ? (float)mrb_fixnum(item) : (float)mrb_float(item);
+  }
+  return kernel;
+}
+
+/* normalized gaussian of radius ceil(3 sigma) */
+static int
+mrb_sdl2_filter_gaussian(mrb_state *mrb, mrb_float sigma, float **kernel)
+{
+  int r, i;
+  float sum = 0.0f;
+  if (!(0.0 < sigma)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "sigma must be positive.");
+  }
+  r = (int)ceil(3.0 * sigma);
+  if (MRB_SDL2_FILTER_MAX_TAPS / 2 < r) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "sigma is too large.");
+  }
+  *kernel = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)(r * 2 + 1) * sizeof(float));
+  for (i = -r; i <= r; ++i) {
+    float const w = expf(-(float)(i * i) / (float)(2.0 * sigma * sigma));
+    (*kernel)[i + r] = w;
+    sum += w;
+  }
+  for (i = 0; i < r * 2 + 1; ++i) {
+    (*kernel)[i] /= sum;
+  }
+  return r;
+}
+
+static int
+mrb_sdl2_filter_box(mrb_state *mrb, mrb_int radius, float **kernel)
+{
+  int i;
+  if ((radius < 0) || (MRB_SDL2_FILTER_MAX_TAPS / 2 < radius)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "radius out of range.");
+  }
+  *kernel = (float *)mrb_sdl2_scratch_alloc(mrb, (size_t)(radius * 2 + 1) * sizeof(float));
+  for (i = 0; i < radius * 2 + 1; ++i) {
+    (*kernel)[i] = 1.0f / (float)(radius * 2 + 1);
+  }
+  return (int)radius;
+}
+
+static SDL_Surface *
+mrb_sdl2_filter_get_surface(mrb_state *mrb, mrb_value self)
+{
+  SDL_Surface *surface = mrb_sdl2_video_surface_get_ptr(mrb, self);
+  if (NULL == surface) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "surface is already freed.");
+  }
+  return surface;
+}
+
+/* same as above, raising for formats the filters cannot read */
+static SDL_Surface *
+mrb_sdl2_filter_get_supported(mrb_state *mrb, mrb_value self)
+{
+  SDL_Surface *surface = mrb_sdl2_filter_get_surface(mrb, self);
+  if (!mrb_sdl2_filter_supported(surface->format)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "filters need 32-bit pixels with 8-bit channels.");
+  }
+  return surface;
+}
+
+/* a new, owned surface with the same format and pixels */
+static mrb_value
+mrb_sdl2_filter_dup(mrb_state *mrb, mrb_value self)
+{
+  SDL_Surface *surface = mrb_sdl2_filter_get_surface(mrb, self);
+  SDL_Surface *copy = SDL_ConvertSurface(surface, surface->format, 0);
+  if (NULL == copy) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return mrb_sdl2_video_surface(mrb, copy, false);
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::Surface (filters)
+*
+* Separable convolutions and resampling over the whole surface, each
+* channel filtered on its own with clamped edges. Color is filtered
+* premultiplied by alpha, so transparent pixels do not bleed their color
+* into visible neighbours (and come out with zero color). Rows are
+* split across a worker pool of SDL_GetCPUCount() threads; the
+* intermediate image lives in the scratch arena, so repeated calls of one
+* size do not allocate. The bang methods work in place, the others return
+* a filtered copy.
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::Surface#convolve!(kernel_x, kernel_y = kernel_x)
+ *
+ * Weights are used as given (no normalization).
+ */
+static mrb_value
+mrb_sdl2_video_surface_convolve_bang(mrb_state *mrb, mrb_value self)
+{
+  mrb_value ax, ay;
+  float *kx, *ky;
+  int rx, ry, result;
+  mrb_sdl2_scratch_mark_t mark;
+  int const argc = mrb_get_args(mrb, "A|A", &ax, &ay);
+  SDL_Surface *surface = mrb_sdl2_filter_get_supported(mrb, self);
+  rx = mrb_sdl2_filter_kernel_radius(mrb, ax);
+  ry = (1 < argc) ? mrb_sdl2_filter_kernel_radius(mrb, ay) : rx;
+  mark = mrb_sdl2_scratch_mark();
+  kx = mrb_sdl2_filter_kernel(mrb, ax);
+  ky = (1 < argc) ? mrb_sdl2_filter_kernel(mrb, ay) : kx;
+  result = mrb_sdl2_filter_convolve(mrb, surface, kx, rx, ky, ry);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_surface_convolve(mrb_state *mrb, mrb_value self)
+{
+  return mrb_sdl2_video_surface_convolve_bang(mrb, mrb_sdl2_filter_dup(mrb, self));
+}
+
+/*
+ * SDL2::Video::Surface#gaussian_blur!(sigma)
+ */
+static mrb_value
+mrb_sdl2_video_surface_gaussian_blur_bang(mrb_state *mrb, mrb_value self)
+{
+  mrb_float sigma;
+  float *kernel;
+  int r, result;
+  mrb_sdl2_scratch_mark_t mark;
+  SDL_Surface *surface;
+  mrb_get_args(mrb, "f", &sigma);
+  surface = mrb_sdl2_filter_get_supported(mrb, self);
+  /* the kernel checks sigma before it allocates */
+  mark = mrb_sdl2_scratch_mark();
+  r = mrb_sdl2_filter_gaussian(mrb, sigma, &kernel);
+  result = mrb_sdl2_filter_convolve(mrb, surface, kernel, r, kernel, r);
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_surface_gaussian_blur(mrb_state *mrb, mrb_value self)
+{
+  return mrb_sdl2_video_surface_gaussian_blur_bang(mrb, mrb_sdl2_filter_dup(mrb, self));
+}
+
+/*
+ * SDL2::Video::Surface#box_blur!(radius)
+ */
+static mrb_value
+mrb_sdl2_video_surface_box_blur_bang(mrb_state *mrb, mrb_value self)
+{
+  mrb_int radius;
+  float *kernel;
+  int r, result = 0;
+  mrb_sdl2_scratch_mark_t mark;
+  SDL_Surface *surface;
+  mrb_get_args(mrb, "i", &radius);
+  surface = mrb_sdl2_filter_get_supported(mrb, self);
+  /* the kernel checks the radius before it allocates */
+  mark = mrb_sdl2_scratch_mark();
+  r = mrb_sdl2_filter_box(mrb, radius, &kernel);
+  if (0 < r) {
+    result = mrb_sdl2_filter_convolve(mrb, surface, kernel, r, kernel, r);
+  }
+  mrb_sdl2_scratch_release(mark);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_surface_box_blur(mrb_state *mrb, mrb_value self)
+{
+  return mrb_sdl2_video_surface_box_blur_bang(mrb, mrb_sdl2_filter_dup(mrb, self));
+}
+
+/*
+ * SDL2::Video::Surface#scale(width, height, filter = :bilinear)
+ *
+ *   filter: :bilinear, :bicubic (Catmull-Rom) or :box (area average, the
+ *           one to use for large reductions)
+ *
+ * Returns a new surface of the same format.
+ */
+static mrb_value
+mrb_sdl2_video_surface_scale(mrb_state *mrb, mrb_value self)
+{
+  mrb_int w, h;
+  mrb_sym sym = 0;
+  mrb_sdl2_filter_scale_t filter = MRB_SDL2_FILTER_BILINEAR;
+  SDL_Surface *surface, *scaled;
+  mrb_value result;
+  mrb_get_args(mrb, "ii|n", &w, &h, &sym);
+  if ((0 == sym) || (sym == mrb_intern_lit(mrb, "bilinear"))) {
+    filter = MRB_SDL2_FILTER_BILINEAR;
+  } else if (sym == mrb_intern_lit(mrb, "bicubic")) {
+    filter = MRB_SDL2_FILTER_BICUBIC;
+  } else if (sym == mrb_intern_lit(mrb, "box")) {
+    filter = MRB_SDL2_FILTER_BOX;
+  } else {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "unknown scale filter.");
+  }
+  if ((w <= 0) || (h <= 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "size must be positive.");
+  }
+  surface = mrb_sdl2_filter_get_supported(mrb, self);
+  if ((0 >= surface->w) || (0 >= surface->h)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "surface is empty.");
+  }
+  scaled = SDL_CreateRGBSurfaceWithFormat(0, (int)w, (int)h, surface->format->BitsPerPixel, surface->format->format);
+  if (NULL == scaled) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  /* owned from here on, so an exception below does not leak it */
+  result = mrb_sdl2_video_surface(mrb, scaled, false);
+  if (0 != mrb_sdl2_filter_scale(mrb, surface, scaled, filter)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return result;
+}
+
+void
+mruby_sdl2_video_surface_filter_init(mrb_state *mrb)
+{
+  struct RClass *class_Surface = mrb_class_get_under(mrb, mod_Video, "Surface");
+
+  mrb_define_method(mrb, class_Surface, "convolve!",      mrb_sdl2_video_surface_convolve_bang,      MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_Surface, "convolve",       mrb_sdl2_video_surface_convolve,           MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_Surface, "gaussian_blur!", mrb_sdl2_video_surface_gaussian_blur_bang, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Surface, "gaussian_blur",  mrb_sdl2_video_surface_gaussian_blur,      MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Surface, "box_blur!",      mrb_sdl2_video_surface_box_blur_bang,      MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Surface, "box_blur",       mrb_sdl2_video_surface_box_blur,           MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Surface, "scale",          mrb_sdl2_video_surface_scale,              MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
+}
+
+void
+mruby_sdl2_video_surface_filter_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,583 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_surface.h"
+#include "sdl2_surface_pixops.h"
+#include "misc.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_endian.h>
+#else
+#include <SDL_surface.h>
+#include <SDL_endian.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef MRB_SDL2_HAVE_AVX2_TARGET
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && (SDL_BYTEORDER == SDL_LIL_ENDIAN)
+#define MRB_SDL2_PIXOPS_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef enum mrb_sdl2_pixops_op_t {
+  MRB_SDL2_PIXOPS_GRAYSCALE,
+  MRB_SDL2_PIXOPS_INVERT,
+  MRB_SDL2_PIXOPS_TINT,
+  MRB_SDL2_PIXOPS_BRIGHTNESS,
+  MRB_SDL2_PIXOPS_THRESHOLD
+} mrb_sdl2_pixops_op_t;
+
+typedef struct mrb_sdl2_pixops_t {
+  mrb_sdl2_pixops_op_t op;
+  int     delta;   /* brightness, -255..255 */
+  int     level;   /* threshold, 0..255 */
+  uint8_t tint[4]; /* r, g, b, a factors, 255 = unchanged */
+} mrb_sdl2_pixops_t;
+
+/* luminance weights summing to 256 (BT.601) */
+#define MRB_SDL2_PIXOPS_WR 77
+#define MRB_SDL2_PIXOPS_WG 150
+#define MRB_SDL2_PIXOPS_WB 29
+
+/* round(x / 255) for x in [0, 255 * 255] */
+static inline int
+mrb_sdl2_pixops_div255(int x)
+{
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+static inline uint8_t
+mrb_sdl2_pixops_clamp(int v)
+{
+  return (uint8_t)((v < 0) ? 0 : ((v > 255) ? 255 : v));
+}
+
+/*
+ * The reference per-pixel operation. Both the vector kernels and the
+ * generic path for non 32-bit formats produce exactly these values.
+ */
+static inline void
+mrb_sdl2_pixops_rgba(mrb_sdl2_pixops_t const *ops, uint8_t *c)
+{
+  int y;
+  switch (ops->op) {
+  case MRB_SDL2_PIXOPS_GRAYSCALE:
+  case MRB_SDL2_PIXOPS_THRESHOLD:
+    y = (MRB_SDL2_PIXOPS_WR * c[0] + MRB_SDL2_PIXOPS_WG * c[1] + MRB_SDL2_PIXOPS_WB * c[2] + 128) >> 8;
+    if (MRB_SDL2_PIXOPS_THRESHOLD == ops->op) {
+      y = (y >= ops->level) ? 255 : 0;
+    }
+    c[0] = c[1] = c[2] = (uint8_t)y;
+    break;
+  case MRB_SDL2_PIXOPS_INVERT:
+    c[0] = 255 - c[0];
+    c[1] = 255 - c[1];
+    c[2] = 255 - c[2];
+    break;
+  case MRB_SDL2_PIXOPS_TINT:
+    c[0] = (uint8_t)mrb_sdl2_pixops_div255(c[0] * ops->tint[0]);
+    c[1] = (uint8_t)mrb_sdl2_pixops_div255(c[1] * ops->tint[1]);
+    c[2] = (uint8_t)mrb_sdl2_pixops_div255(c[2] * ops->tint[2]);
+    c[3] = (uint8_t)mrb_sdl2_pixops_div255(c[3] * ops->tint[3]);
+    break;
+  case MRB_SDL2_PIXOPS_BRIGHTNESS:
+    c[0] = mrb_sdl2_pixops_clamp(c[0] + ops->delta);
+    c[1] = mrb_sdl2_pixops_clamp(c[1] + ops->delta);
+    c[2] = mrb_sdl2_pixops_clamp(c[2] + ops->delta);
+    break;
+  }
+}
+
+/*
+ * Byte layout of a 32-bit format with 8-bit channels: shift[i] is the bit
+ * offset of r, g, b and a (or the padding byte of X888 formats).
+ */
+typedef struct mrb_sdl2_pixops_layout_t {
+  int      shift[4];
+  uint32_t rgb_mask;
+  bool     has_alpha;
+} mrb_sdl2_pixops_layout_t;
+
+static bool
+mrb_sdl2_pixops_layout(SDL_PixelFormat const *format, mrb_sdl2_pixops_layout_t *layout)
+{
+  uint32_t used;
+  int bit;
+  if ((4 != format->BytesPerPixel) || (NULL != format->palette) ||
+      (0 != format->Rloss) || (0 != format->Gloss) || (0 != format->Bloss) ||
+      (0 != (format->Rshift & 7)) || (0 != (format->Gshift & 7)) || (0 != (format->Bshift & 7))) {
+    return false;
+  }
+  layout->shift[0]  = format->Rshift;
+  layout->shift[1]  = format->Gshift;
+  layout->shift[2]  = format->Bshift;
+  layout->rgb_mask  = format->Rmask | format->Gmask | format->Bmask;
+  layout->has_alpha = (0 != format->Amask);
+  if (layout->has_alpha) {
+    if ((0 != format->Aloss) || (0 != (format->Ashift & 7))) {
+      return false;
+    }
+    layout->shift[3] = format->Ashift;
+    return true;
+  }
+  used = layout->rgb_mask;
+  for (bit = 0; bit < 32; bit += 8) {
+    if (0 == (used & (0xffu << bit))) {
+      layout->shift[3] = bit;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void
+mrb_sdl2_pixops_row32_scalar(mrb_sdl2_pixops_t const *ops, mrb_sdl2_pixops_layout_t const *layout, uint32_t *row, int n)
+{
+  int i, k;
+  for (i = 0; i < n; ++i) {
+    uint32_t p = row[i];
+    uint8_t c[4];
+    for (k = 0; k < 4; ++k) {
+      c[k] = (uint8_t)(p >> layout->shift[k]);
+    }
+    if (!layout->has_alpha) {
+      c[3] = 255;
+    }
+    mrb_sdl2_pixops_rgba(ops, c);
+    p &= ~layout->rgb_mask;
+    p |= ((uint32_t)c[0] << layout->shift[0]) | ((uint32_t)c[1] << layout->shift[1]) | ((uint32_t)c[2] << layout->shift[2]);
+    if (layout->has_alpha) {
+      p = (p & ~(0xffu << layout->shift[3])) | ((uint32_t)c[3] << layout->shift[3]);
+    }
+    row[i] = p;
+  }
+}
+
+#ifdef __SSE2__
+/* per byte-in-pixel constant, repeated for both pixels of a 16-bit unpack */
+static __m128i
+mrb_sdl2_pixops_lanes16(mrb_sdl2_pixops_layout_t const *layout, int const *value)
+{
+  int16_t lane[4] = { 0, 0, 0, 0 };
+  int k;
+  for (k = 0; k < 4; ++k) {
+    lane[layout->shift[k] / 8] = (int16_t)value[k];
+  }
+  return _mm_set_epi16(lane[3], lane[2], lane[1], lane[0], lane[3], lane[2], lane[1], lane[0]);
+}
+
+/* (77 r + 150 g + 29 b + 128) >> 8 of 4 pixels, one per 32-bit lane */
+static inline __m128i
+mrb_sdl2_pixops_luma4(__m128i px, __m128i weights)
+{
+  __m128i const zero = _mm_setzero_si128();
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), weights);
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), weights);
+  lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+  hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+  lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 0, 2, 0));
+  hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 0, 2, 0));
+  return _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), _mm_set1_epi32(128)), 8);
+}
+
+/* round(x / 255) of 16-bit lanes, as mrb_sdl2_pixops_div255 */
+static inline __m128i
+mrb_sdl2_pixops_div255_16(__m128i x)
+{
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/* processes whole groups of 4 pixels and returns how many were done */
+static int
+mrb_sdl2_pixops_row32_sse2(mrb_sdl2_pixops_t const *ops, mrb_sdl2_pixops_layout_t const *layout, uint32_t *row, int n)
+{
+  __m128i const rgb   = _mm_set1_epi32((int)layout->rgb_mask);
+  __m128i const keep  = _mm_set1_epi32((int)~layout->rgb_mask);
+  __m128i const zero  = _mm_setzero_si128();
+  int const weights[4] = { MRB_SDL2_PIXOPS_WR, MRB_SDL2_PIXOPS_WG, MRB_SDL2_PIXOPS_WB, 0 };
+  int const factors[4] = { ops->tint[0], ops->tint[1], ops->tint[2], layout->has_alpha ? ops->tint[3] : 255 };
+  __m128i const w     = mrb_sdl2_pixops_lanes16(layout, weights);
+  __m128i const f     = mrb_sdl2_pixops_lanes16(layout, factors);
+  __m128i const delta = _mm_and_si128(_mm_set1_epi8((char)(uint8_t)SDL_abs(ops->delta)), rgb);
+  __m128i const level = _mm_set1_epi32(ops->level - 1);
+  int i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128i px = _mm_loadu_si128((__m128i const *)(row + i));
+    __m128i y;
+    switch (ops->op) {
+    case MRB_SDL2_PIXOPS_GRAYSCALE:
+    case MRB_SDL2_PIXOPS_THRESHOLD:
+      y = mrb_sdl2_pixops_luma4(px, w);
+      if (MRB_SDL2_PIXOPS_THRESHOLD == ops->op) {
+        y = _mm_srli_epi32(_mm_cmpgt_epi32(y, level), 24);
+      }
+      /* spread the value into every byte, then keep alpha/padding */
+      y = _mm_or_si128(y, _mm_slli_epi32(y, 8));
+      y = _mm_or_si128(y, _mm_slli_epi32(y, 16));
+      px = _mm_or_si128(_mm_and_si128(y, rgb), _mm_and_si128(px, keep));
+      break;
+    case MRB_SDL2_PIXOPS_INVERT:
+      px = _mm_xor_si128(px, rgb);
+      break;
+    case MRB_SDL2_PIXOPS_TINT: {
+      __m128i lo = mrb_sdl2_pixops_div255_16(_mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), f));
+      __m128i hi = mrb_sdl2_pixops_div255_16(_mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), f));
+      px = _mm_packus_epi16(lo, hi);
+      break;
+    }
+    case MRB_SDL2_PIXOPS_BRIGHTNESS:
+      px = (0 <= ops->delta) ? _mm_adds_epu8(px, delta) : _mm_subs_epu8(px, delta);
+      break;
+    }
+    _mm_storeu_si128((__m128i *)(row + i), px);
+  }
+  return i;
+}
+#endif
+
+#ifdef MRB_SDL2_HAVE_AVX2_TARGET
+/* The AVX2 kernel is the SSE2 one on 8 pixels; unpacks and packs work per
+ * 128-bit half, so every step keeps the same pixel order. */
+__attribute__((target("avx2"))) static inline __m256i
+mrb_sdl2_pixops_lanes16_avx2(mrb_sdl2_pixops_layout_t const *layout, int const *value)
+{
+  int16_t lane[4] = { 0, 0, 0, 0 };
+  int k;
+  for (k = 0; k < 4; ++k) {
+    lane[layout->shift[k] / 8] = (int16_t)value[k];
+  }
+  return _mm256_set_epi16(lane[3], lane[2], lane[1], lane[0], lane[3], lane[2], lane[1], lane[0],
+                          lane[3], lane[2], lane[1], lane[0], lane[3], lane[2], lane[1], lane[0]);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+mrb_sdl2_pixops_luma8_avx2(__m256i px, __m256i weights)
+{
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), weights);
+  __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), weights);
+  lo = _mm256_add_epi32(lo, _mm256_srli_epi64(lo, 32));
+  hi = _mm256_add_epi32(hi, _mm256_srli_epi64(hi, 32));
+  lo = _mm256_shuffle_epi32(lo, _MM_SHUFFLE(2, 0, 2, 0));
+  hi = _mm256_shuffle_epi32(hi, _MM_SHUFFLE(2, 0, 2, 0));
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_unpacklo_epi64(lo, hi), _mm256_set1_epi32(128)), 8);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+mrb_sdl2_pixops_div255_16_avx2(__m256i x)
+{
+  x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+/* processes whole groups of 8 pixels and returns how many were done */
+__attribute__((target("avx2"))) static int
+mrb_sdl2_pixops_row32_avx2(mrb_sdl2_pixops_t const *ops, mrb_sdl2_pixops_layout_t const *layout, uint32_t *row, int n)
+{
+  __m256i const rgb   = _mm256_set1_epi32((int)layout->rgb_mask);
+  __m256i const keep  = _mm256_set1_epi32((int)~layout->rgb_mask);
+  __m256i const zero  = _mm256_setzero_si256();
+  int const weights[4] = { MRB_SDL2_PIXOPS_WR, MRB_SDL2_PIXOPS_WG, MRB_SDL2_PIXOPS_WB, 0 };
+  int const factors[4] = { ops->tint[0], ops->tint[1], ops->tint[2], layout->has_alpha ? ops->tint[3] : 255 };
+  __m256i const w     = mrb_sdl2_pixops_lanes16_avx2(layout, weights);
+  __m256i const f     = mrb_sdl2_pixops_lanes16_avx2(layout, factors);
+  __m256i const delta = _mm256_and_si256(_mm256_set1_epi8((char)(uint8_t)SDL_abs(ops->delta)), rgb);
+  __m256i const level = _mm256_set1_epi32(ops->level - 1);
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i px = _mm256_loadu_si256((__m256i const *)(row + i));
+    __m256i y;
+    switch (ops->op) {
+    case MRB_SDL2_PIXOPS_GRAYSCALE:
+    case MRB_SDL2_PIXOPS_THRESHOLD:
+      y = mrb_sdl2_pixops_luma8_avx2(px, w);
+      if (MRB_SDL2_PIXOPS_THRESHOLD == ops->op) {
+        y = _mm256_srli_epi32(_mm256_cmpgt_epi32(y, level), 24);
+      }
+      y = _mm256_or_si256(y, _mm256_slli_epi32(y, 8));
+      y = _mm256_or_si256(y, _mm256_slli_epi32(y, 16));
+      px = _mm256_or_si256(_mm256_and_si256(y, rgb), _mm256_and_si256(px, keep));
+      break;
+    case MRB_SDL2_PIXOPS_INVERT:
+      px = _mm256_xor_si256(px, rgb);
+      break;
+    case MRB_SDL2_PIXOPS_TINT: {
+      __m256i lo = mrb_sdl2_pixops_div255_16_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(px, zero), f));
+      __m256i hi = mrb_sdl2_pixops_div255_16_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(px, zero), f));
+      px = _mm256_packus_epi16(lo, hi);
+      break;
+    }
+    case MRB_SDL2_PIXOPS_BRIGHTNESS:
+      px = (0 <= ops->delta) ? _mm256_adds_epu8(px, delta) : _mm256_subs_epu8(px, delta);
+      break;
+    }
+    _mm256_storeu_si256((__m256i *)(row + i), px);
+  }
+  return i;
+}
+#endif
+
+#ifdef MRB_SDL2_PIXOPS_NEON
+/* round(x / 255) of 16-bit lanes, narrowed to bytes */
+static inline uint8x8_t
+mrb_sdl2_pixops_div255_neon(uint16x8_t x)
+{
+  x = vaddq_u16(x, vdupq_n_u16(128));
+  return vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+}
+
+/*
+ * Processes whole groups of 8 pixels and returns how many were done.
+ * vld4 splits them into one vector per byte of the pixel, so the channels
+ * are picked by their shift instead of being masked.
+ */
+static int
+mrb_sdl2_pixops_row32_neon(mrb_sdl2_pixops_t const *ops, mrb_sdl2_pixops_layout_t const *layout, uint32_t *row, int n)
+{
+  int const r = layout->shift[0] / 8, g = layout->shift[1] / 8, b = layout->shift[2] / 8, a = layout->shift[3] / 8;
+  uint8x8_t const delta = vdup_n_u8((uint8_t)SDL_abs(ops->delta));
+  uint8x8_t const level = vdup_n_u8((uint8_t)SDL_min(ops->level, 255));
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    uint8x8x4_t px = vld4_u8((uint8_t const *)(row + i));
+    uint16x8_t acc;
+    uint8x8_t y;
+    switch (ops->op) {
+    case MRB_SDL2_PIXOPS_GRAYSCALE:
+    case MRB_SDL2_PIXOPS_THRESHOLD:
+      acc = vmull_u8(px.val[r], vdup_n_u8(MRB_SDL2_PIXOPS_WR));
+      acc = vmlal_u8(acc, px.val[g], vdup_n_u8(MRB_SDL2_PIXOPS_WG));
+      acc = vmlal_u8(acc, px.val[b], vdup_n_u8(MRB_SDL2_PIXOPS_WB));
+      y = vshrn_n_u16(vaddq_u16(acc, vdupq_n_u16(128)), 8);
+      if (MRB_SDL2_PIXOPS_THRESHOLD == ops->op) {
+        y = (255 < ops->level) ? vdup_n_u8(0) : vcge_u8(y, level);
+      }
+      px.val[r] = px.val[g] = px.val[b] = y;
+      break;
+    case MRB_SDL2_PIXOPS_INVERT:
+      px.val[r] = vmvn_u8(px.val[r]);
+      px.val[g] = vmvn_u8(px.val[g]);
+      px.val[b] = vmvn_u8(px.val[b]);
+      break;
+    case MRB_SDL2_PIXOPS_TINT:
+      px.val[r] = mrb_sdl2_pixops_div255_neon(vmull_u8(px.val[r], vdup_n_u8(ops->tint[0])));
+      px.val[g] = mrb_sdl2_pixops_div255_neon(vmull_u8(px.val[g], vdup_n_u8(ops->tint[1])));
+      px.val[b] = mrb_sdl2_pixops_div255_neon(vmull_u8(px.val[b], vdup_n_u8(ops->tint[2])));
+      if (layout->has_alpha) {
+        px.val[a] = mrb_sdl2_pixops_div255_neon(vmull_u8(px.val[a], vdup_n_u8(ops->tint[3])));
+      }
+      break;
+    case MRB_SDL2_PIXOPS_BRIGHTNESS:
+      if (0 <= ops->delta) {
+        px.val[r] = vqadd_u8(px.val[r], delta);
+        px.val[g] = vqadd_u8(px.val[g], delta);
+        px.val[b] = vqadd_u8(px.val[b], delta);
+      } else {
+        px.val[r] = vqsub_u8(px.val[r], delta);
+        px.val[g] = vqsub_u8(px.val[g], delta);
+        px.val[b] = vqsub_u8(px.val[b], delta);
+      }
+      break;
+    }
+    vst4_u8((uint8_t *)(row + i), px);
+  }
+  return i;
+}
+#endif
+
+static Uint32
+mrb_sdl2_pixops_load(uint8_t const *p, int bpp)
+{
+  switch (bpp) {
+  case 1:
+    return *p;
+  case 2:
+    return *(Uint16 const *)p;
+  case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    return (Uint32)p[0] << 16 | (Uint32)p[1] << 8 | p[2];
+#else
+    return p[0] | (Uint32)p[1] << 8 | (Uint32)p[2] << 16;
+#endif
+  default:
+    return *(Uint32 const *)p;
+  }
+}
+
+static void
+mrb_sdl2_pixops_store(uint8_t *p, int bpp, Uint32 v)
+{
+  switch (bpp) {
+  case 1:
+    *p = (uint8_t)v;
+    break;
+  case 2:
+    *(Uint16 *)p = (Uint16)v;
+    break;
+  case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    p[0] = (uint8_t)(v >> 16);
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)v;
+#else
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+#endif
+    break;
+  default:
+    *(Uint32 *)p = v;
+    break;
+  }
+}
+
+/* any other format: through SDL_GetRGBA / SDL_MapRGBA per pixel */
+static void
+mrb_sdl2_pixops_row_generic(mrb_sdl2_pixops_t const *ops, SDL_PixelFormat const *format, uint8_t *row, int n)
+{
+  int const bpp = format->BytesPerPixel;
+  int i;
+  for (i = 0; i < n; ++i) {
+    uint8_t c[4];
+    SDL_GetRGBA(mrb_sdl2_pixops_load(row + i * bpp, bpp), format, &c[0], &c[1], &c[2], &c[3]);
+    mrb_sdl2_pixops_rgba(ops, c);
+    mrb_sdl2_pixops_store(row + i * bpp, bpp, SDL_MapRGBA(format, c[0], c[1], c[2], c[3]));
+  }
+}
+
+static void
+mrb_sdl2_pixops_apply(mrb_sdl2_pixops_t const *ops, SDL_Surface *surface)
+{
+  mrb_sdl2_pixops_layout_t layout;
+  bool const is_packed32 = mrb_sdl2_pixops_layout(surface->format, &layout);
+#ifdef MRB_SDL2_HAVE_AVX2_TARGET
+  bool const has_avx2 = mrb_sdl2_misc_has_avx2();
+#endif
+  int y;
+  for (y = 0; y < surface->h; ++y) {
+    uint8_t *row = (uint8_t *)surface->pixels + y * surface->pitch;
+    if (is_packed32) {
+      int done = 0;
+#ifdef MRB_SDL2_HAVE_AVX2_TARGET
+      if (has_avx2) {
+        done = mrb_sdl2_pixops_row32_avx2(ops, &layout, (uint32_t *)row, surface->w);
+      }
+#endif
+#ifdef __SSE2__
+      done += mrb_sdl2_pixops_row32_sse2(ops, &layout, (uint32_t *)row + done, surface->w - done);
+#endif
+#ifdef MRB_SDL2_PIXOPS_NEON
+      done = mrb_sdl2_pixops_row32_neon(ops, &layout, (uint32_t *)row, surface->w);
+#endif
+      mrb_sdl2_pixops_row32_scalar(ops, &layout, (uint32_t *)row + done, surface->w - done);
+    } else {
+      mrb_sdl2_pixops_row_generic(ops, surface->format, row, surface->w);
+    }
+  }
+}
+
+static mrb_int
+mrb_sdl2_pixops_arg(mrb_state *mrb, mrb_value const *argv, mrb_int argc, mrb_int index, mrb_int value, mrb_int lo, mrb_int hi)
+{
+  if (index < argc) {
+    if (!mrb_fixnum_p(argv[index])) {
+      mrb_raise(mrb, E_TYPE_ERROR, "given argument is unexpected type (expected Fixnum).");
+    }
+    value = mrb_fixnum(argv[index]);
+  }
+  return (value < lo) ? lo : ((value > hi) ? hi : value);
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::Surface (pixel operations)
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::Surface#apply!(op, *args)
+ *
+ *   apply!(:grayscale)
+ *   apply!(:invert)
+ *   apply!(:tint, r, g, b, a = 255)   # multiplies each channel by n / 255
+ *   apply!(:brightness, delta)        # adds -255..255, saturating
+ *   apply!(:threshold, level = 128)   # luminance >= level -> white
+ *
+ * Transforms the whole surface in place; only tint touches alpha. Formats
+ * with 8-bit channels in 32-bit pixels use AVX2 (picked at run time), SSE2
+ * or NEON kernels where available and a scalar loop otherwise; other
+ * formats go through SDL_GetRGBA/SDL_MapRGBA.
+ */
+static mrb_value
+mrb_sdl2_video_surface_apply(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym op;
+  mrb_value *argv;
+  mrb_int argc, max_argc = 0;
+  mrb_sdl2_pixops_t ops;
+  SDL_Surface *surface;
+  mrb_get_args(mrb, "n*", &op, &argv, &argc);
+  SDL_memset(&ops, 0, sizeof(ops));
+  if (op == mrb_intern_lit(mrb, "grayscale")) {
+    ops.op = MRB_SDL2_PIXOPS_GRAYSCALE;
+  } else if (op == mrb_intern_lit(mrb, "invert")) {
+    ops.op = MRB_SDL2_PIXOPS_INVERT;
+  } else if (op == mrb_intern_lit(mrb, "tint")) {
+    if (argc < 3) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments.");
+    }
+    ops.op      = MRB_SDL2_PIXOPS_TINT;
+    ops.tint[0] = (uint8_t)mrb_sdl2_pixops_arg(mrb, argv, argc, 0, 255, 0, 255);
+    ops.tint[1] = (uint8_t)mrb_sdl2_pixops_arg(mrb, argv, argc, 1, 255, 0, 255);
+    ops.tint[2] = (uint8_t)mrb_sdl2_pixops_arg(mrb, argv, argc, 2, 255, 0, 255);
+    ops.tint[3] = (uint8_t)mrb_sdl2_pixops_arg(mrb, argv, argc, 3, 255, 0, 255);
+    max_argc = 4;
+  } else if (op == mrb_intern_lit(mrb, "brightness")) {
+    if (argc < 1) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments.");
+    }
+    ops.op    = MRB_SDL2_PIXOPS_BRIGHTNESS;
+    ops.delta = (int)mrb_sdl2_pixops_arg(mrb, argv, argc, 0, 0, -255, 255);
+    max_argc = 1;
+  } else if (op == mrb_intern_lit(mrb, "threshold")) {
+    ops.op    = MRB_SDL2_PIXOPS_THRESHOLD;
+    ops.level = (int)mrb_sdl2_pixops_arg(mrb, argv, argc, 0, 128, 0, 256);
+    max_argc = 1;
+  } else {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "unknown pixel operation.");
+  }
+  if (argc > max_argc) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments.");
+  }
+  surface = mrb_sdl2_video_surface_get_ptr(mrb, self);
+  if (NULL == surface) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "surface is already freed.");
+  }
+  if (SDL_MUSTLOCK(surface) && (0 != SDL_LockSurface(surface))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  mrb_sdl2_pixops_apply(&ops, surface);
+  if (SDL_MUSTLOCK(surface)) {
+    SDL_UnlockSurface(surface);
+  }
+  return self;
+}
+
+void
+mruby_sdl2_video_surface_pixops_init(mrb_state *mrb)
+{
+  struct RClass *class_Surface = mrb_class_get_under(mrb, mod_Video, "Surface");
+
+  mrb_define_method(mrb, class_Surface, "apply!", mrb_sdl2_video_surface_apply, MRB_ARGS_REQ(1) | MRB_ARGS_REST());
+}
+
+void
+mruby_sdl2_video_surface_pixops_final(mrb_state *mrb)
+{
+}
@@ -4,6 +4,17 @@
 #include "sdl2_surface.h"
 #include "sdl2_video_gl.h"
 #include "sdl2_video_display.h"
+#include "sdl2_video_capture.h"
+#include "sdl2_video_atlas.h"
+#include "sdl2_video_cache.h"
+#include "sdl2_video_tilemap.h"
+#include "sdl2_video_particle.h"
+#include "sdl2_video_font.h"
+#include "sdl2_video_layer.h"
+#include "sdl2_video_loader.h"
+#include "sdl2_video_queue.h"
+#include "sdl2_surface_pixops.h"
+#include "sdl2_surface_filter.h"
 #include "mruby/class.h"
 #include "mruby/data.h"
 #include "mruby/string.h"
@@ -750,6 +761,17 @@ mruby_sdl2_video_init(mrb_state *mrb)
   mruby_sdl2_video_surface_init(mrb, mod_Video);
   mruby_sdl2_video_gl_init(mrb);
   mruby_sdl2_video_display_init(mrb);
+  mruby_sdl2_video_capture_init(mrb);
+  mruby_sdl2_video_atlas_init(mrb);
+  mruby_sdl2_video_cache_init(mrb);
+  mruby_sdl2_video_tilemap_init(mrb);
+  mruby_sdl2_video_particle_init(mrb);
+  mruby_sdl2_video_font_init(mrb);
+  mruby_sdl2_video_layer_init(mrb);
+  mruby_sdl2_video_loader_init(mrb);
+  mruby_sdl2_video_queue_init(mrb);
+  mruby_sdl2_video_surface_pixops_init(mrb);
+  mruby_sdl2_video_surface_filter_init(mrb);
 
   mrb_gc_arena_restore(mrb, arena_size);
 }
@@ -757,6 +779,17 @@ mruby_sdl2_video_init(mrb_state *mrb)
 void
 mruby_sdl2_video_final(mrb_state *mrb)
 {
+  mruby_sdl2_video_surface_filter_final(mrb);
+  mruby_sdl2_video_surface_pixops_final(mrb);
+  mruby_sdl2_video_queue_final(mrb);
+  mruby_sdl2_video_loader_final(mrb);
+  mruby_sdl2_video_layer_final(mrb);
+  mruby_sdl2_video_font_final(mrb);
+  mruby_sdl2_video_particle_final(mrb);
+  mruby_sdl2_video_tilemap_final(mrb);
+  mruby_sdl2_video_cache_final(mrb);
+  mruby_sdl2_video_atlas_final(mrb);
+  mruby_sdl2_video_capture_final(mrb);
   mruby_sdl2_video_surface_final(mrb, mod_Video);
   mruby_sdl2_video_renderer_final(mrb, mod_Video);
   mruby_sdl2_video_gl_final(mrb);
@@ -0,0 +1,513 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_rect.h"
+#include "sdl2_surface.h"
+#include "sdl2_video_atlas.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/hash.h"
+#include "mruby/variable.h"
+#include <stdlib.h>
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_surface.h>
+#else
+#include <SDL_render.h>
+#include <SDL_surface.h>
+#endif
+
+static struct RClass *class_TextureAtlas = NULL;
+
+#define MRB_SDL2_ATLAS_DEFAULT_PAGE_SIZE 2048
+
+typedef struct mrb_sdl2_video_atlas_entry_t {
+  SDL_Rect rect;
+  int      page;
+} mrb_sdl2_video_atlas_entry_t;
+
+/* one segment of the skyline: the top edge of packed space over [x, x + w) */
+typedef struct mrb_sdl2_video_atlas_skyline_t {
+  int x, y, w;
+} mrb_sdl2_video_atlas_skyline_t;
+
+typedef struct mrb_sdl2_video_atlas_data_t {
+  SDL_Renderer *renderer;
+  int           page_w;
+  int           page_h;
+  int           padding;
+  bool          is_built;
+  int           npages;
+  mrb_int       size;
+  mrb_int       capa;
+  mrb_sdl2_video_atlas_entry_t *entries;
+} mrb_sdl2_video_atlas_data_t;
+
+static void
+mrb_sdl2_video_atlas_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_atlas_data_t *data =
+    (mrb_sdl2_video_atlas_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->entries);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_atlas_data_type = {
+  "TextureAtlas", mrb_sdl2_video_atlas_data_free
+};
+
+static mrb_sdl2_video_atlas_data_t *
+mrb_sdl2_video_atlas_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_video_atlas_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_atlas_data_type);
+}
+
+/***************************************************************************
+*
+* skyline packer
+*
+***************************************************************************/
+
+typedef struct mrb_sdl2_video_atlas_packer_t {
+  mrb_sdl2_video_atlas_skyline_t *nodes;
+  int size;
+  int w, h;
+} mrb_sdl2_video_atlas_packer_t;
+
+/* lowest y at which a w-wide box starting at node i rests on the skyline */
+static int
+mrb_sdl2_video_atlas_packer_fit(mrb_sdl2_video_atlas_packer_t const *packer, int i, int w, int h)
+{
+  int x = packer->nodes[i].x;
+  int y = 0;
+  int left = w;
+  if (x + w > packer->w) {
+    return -1;
+  }
+  for (; 0 < left; ++i) {
+    y = SDL_max(y, packer->nodes[i].y);
+    if (y + h > packer->h) {
+      return -1;
+    }
+    left -= packer->nodes[i].w;
+  }
+  return y;
+}
+
+/*
+ * Finds the bottom-left-most position for a w x h box and raises the
+ * skyline over it. Returns false when the page is full.
+ */
+static bool
+mrb_sdl2_video_atlas_packer_insert(mrb_sdl2_video_atlas_packer_t *packer, int w, int h, SDL_Point *pos)
+{
+  int i, best = -1, best_y = 0, best_w = 0;
+  mrb_sdl2_video_atlas_skyline_t node;
+  for (i = 0; i < packer->size; ++i) {
+    int const y = mrb_sdl2_video_atlas_packer_fit(packer, i, w, h);
+    if (0 > y) {
+      continue;
+    }
+    if ((-1 == best) || (y < best_y) || ((y == best_y) && (packer->nodes[i].w < best_w))) {
+      best   = i;
+      best_y = y;
+      best_w = packer->nodes[i].w;
+    }
+  }
+  if (-1 == best) {
+    return false;
+  }
+  pos->x = packer->nodes[best].x;
+  pos->y = best_y;
+
+  node = (mrb_sdl2_video_atlas_skyline_t){ pos->x, best_y + h, w };
+  SDL_memmove(&packer->nodes[best + 1], &packer->nodes[best], sizeof(node) * (packer->size - best));
+  packer->nodes[best] = node;
+  ++packer->size;
+
+  /* trim the segments now covered by the new one */
+  for (i = best + 1; i < packer->size; ++i) {
+    mrb_sdl2_video_atlas_skyline_t *cur = &packer->nodes[i];
+    int const shrink = node.x + node.w - cur->x;
+    if (shrink <= 0) {
+      break;
+    }
+    if (cur->w > shrink) {
+      cur->x += shrink;
+      cur->w -= shrink;
+      break;
+    }
+    SDL_memmove(cur, cur + 1, sizeof(node) * (packer->size - i - 1));
+    --packer->size;
+    --i;
+  }
+  /* merge neighbours at the same height */
+  for (i = 0; i + 1 < packer->size; ++i) {
+    if (packer->nodes[i].y == packer->nodes[i + 1].y) {
+      packer->nodes[i].w += packer->nodes[i + 1].w;
+      SDL_memmove(&packer->nodes[i + 1], &packer->nodes[i + 2], sizeof(node) * (packer->size - i - 2));
+      --packer->size;
+      --i;
+    }
+  }
+  return true;
+}
+
+static void
+mrb_sdl2_video_atlas_packer_reset(mrb_sdl2_video_atlas_packer_t *packer)
+{
+  packer->nodes[0] = (mrb_sdl2_video_atlas_skyline_t){ 0, 0, packer->w };
+  packer->size = 1;
+}
+
+typedef struct mrb_sdl2_video_atlas_order_t {
+  mrb_int index;
+  int     w, h;
+} mrb_sdl2_video_atlas_order_t;
+
+/* tallest first, then widest: the usual order for skyline packing */
+static int
+mrb_sdl2_video_atlas_compare(void const *lhs, void const *rhs)
+{
+  mrb_sdl2_video_atlas_order_t const *a = (mrb_sdl2_video_atlas_order_t const *)lhs;
+  mrb_sdl2_video_atlas_order_t const *b = (mrb_sdl2_video_atlas_order_t const *)rhs;
+  if (a->h != b->h) {
+    return (a->h > b->h) ? -1 : 1;
+  }
+  if (a->w != b->w) {
+    return (a->w > b->w) ? -1 : 1;
+  }
+  return (a->index < b->index) ? -1 : 1;
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::TextureAtlas
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::TextureAtlas.new(renderer, page_width = nil, page_height = nil, padding = 1)
+ *
+ * Pages default to 2048x2048, clamped to the renderer's maximum texture
+ * size.
+ */
+static mrb_value
+mrb_sdl2_video_atlas_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer;
+  mrb_int page_w = MRB_SDL2_ATLAS_DEFAULT_PAGE_SIZE;
+  mrb_int page_h = MRB_SDL2_ATLAS_DEFAULT_PAGE_SIZE;
+  mrb_int padding = 1;
+  SDL_RendererInfo info;
+  mrb_sdl2_video_atlas_data_t *data =
+    (mrb_sdl2_video_atlas_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "o|iii", &renderer, &page_w, &page_h, &padding);
+  if ((page_w <= 0) || (page_h <= 0) || (padding < 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid page size or padding.");
+  }
+  if (0 != SDL_GetRendererInfo(mrb_sdl2_video_renderer_get_ptr(mrb, renderer), &info)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  if (NULL == data) {
+    data = (mrb_sdl2_video_atlas_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_atlas_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+    data->entries = NULL;
+  }
+  data->renderer = mrb_sdl2_video_renderer_get_ptr(mrb, renderer);
+  if (0 < info.max_texture_width) {
+    page_w = SDL_min(page_w, info.max_texture_width);
+  }
+  if (0 < info.max_texture_height) {
+    page_h = SDL_min(page_h, info.max_texture_height);
+  }
+  data->page_w   = (int)page_w;
+  data->page_h   = (int)page_h;
+  data->padding  = (int)padding;
+  data->is_built = false;
+  data->npages   = 0;
+  data->size     = 0;
+  data->capa     = 0;
+  mrb_free(mrb, data->entries);
+  data->entries  = NULL;
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_atlas_data_type;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), renderer);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__surfaces__"), mrb_ary_new(mrb));
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__keys__"),     mrb_hash_new(mrb));
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__textures__"), mrb_ary_new(mrb));
+  return self;
+}
+
+/* Accepts an index returned by #add or the key given to it. */
+static mrb_sdl2_video_atlas_entry_t *
+mrb_sdl2_video_atlas_lookup(mrb_state *mrb, mrb_value self, mrb_value key)
+{
+  mrb_int index;
+  mrb_sdl2_video_atlas_data_t *data = mrb_sdl2_video_atlas_get_data(mrb, self);
+  if (!data->is_built) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "atlas is not built yet.");
+  }
+  if (!mrb_fixnum_p(key)) {
+    mrb_value const keys = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__keys__"));
+    mrb_value const found = mrb_hash_fetch(mrb, keys, key, mrb_nil_value());
+    if (mrb_nil_p(found)) {
+      mrb_raise(mrb, E_KEY_ERROR, "no such sprite in atlas.");
+    }
+    key = found;
+  }
+  index = mrb_fixnum(key);
+  if ((index < 0) || (index >= data->size)) {
+    mrb_raise(mrb, E_INDEX_ERROR, "sprite index is out of range.");
+  }
+  return &data->entries[index];
+}
+
+/*
+ * SDL2::Video::TextureAtlas#add(key, surface)
+ *
+ * Queues a surface for packing and returns its index. The surface is kept
+ * until #build.
+ */
+static mrb_value
+mrb_sdl2_video_atlas_add(mrb_state *mrb, mrb_value self)
+{
+  mrb_value key, surface;
+  SDL_Surface *s;
+  mrb_sdl2_video_atlas_entry_t *entry;
+  mrb_sdl2_video_atlas_data_t *data = mrb_sdl2_video_atlas_get_data(mrb, self);
+  mrb_get_args(mrb, "oo", &key, &surface);
+  if (data->is_built) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "atlas is already built.");
+  }
+  s = mrb_sdl2_video_surface_get_ptr(mrb, surface);
+  if ((0 >= s->w) || (0 >= s->h)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "surface is empty.");
+  }
+  if ((s->w + data->padding > data->page_w) || (s->h + data->padding > data->page_h)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "surface does not fit in an atlas page.");
+  }
+  if (data->size >= data->capa) {
+    mrb_int const capa = (0 < data->capa) ? data->capa * 2 : 64;
+    data->entries = (mrb_sdl2_video_atlas_entry_t*)mrb_realloc(mrb, data->entries, sizeof(mrb_sdl2_video_atlas_entry_t) * capa);
+    data->capa = capa;
+  }
+  entry = &data->entries[data->size];
+  entry->rect = (SDL_Rect){ 0, 0, s->w, s->h };
+  entry->page = -1;
+  mrb_ary_push(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__surfaces__")), surface);
+  if (!mrb_nil_p(key)) {
+    mrb_hash_set(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__keys__")), key, mrb_fixnum_value(data->size));
+  }
+  return mrb_fixnum_value(data->size++);
+}
+
+/* Blits every entry of one page into a fresh surface and uploads it. */
+static SDL_Texture *
+mrb_sdl2_video_atlas_upload_page(mrb_state *mrb, mrb_sdl2_video_atlas_data_t *data, mrb_value surfaces, int page, int w, int h)
+{
+  mrb_int i;
+  SDL_Texture *texture;
+  SDL_Surface *target = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+  if (NULL == target) {
+    return NULL;
+  }
+  for (i = 0; i < data->size; ++i) {
+    mrb_sdl2_video_atlas_entry_t *entry = &data->entries[i];
+    SDL_Surface *s;
+    SDL_BlendMode mode;
+    SDL_Rect dst;
+    int result;
+    if (entry->page != page) {
+      continue;
+    }
+    s = mrb_sdl2_video_surface_get_ptr(mrb, mrb_ary_ref(mrb, surfaces, i));
+    dst = entry->rect;
+    /* copy alpha as is instead of blending onto the empty page */
+    SDL_GetSurfaceBlendMode(s, &mode);
+    SDL_SetSurfaceBlendMode(s, SDL_BLENDMODE_NONE);
+    result = SDL_BlitSurface(s, NULL, target, &dst);
+    SDL_SetSurfaceBlendMode(s, mode);
+    if (0 != result) {
+      SDL_FreeSurface(target);
+      return NULL;
+    }
+  }
+  texture = SDL_CreateTextureFromSurface(data->renderer, target);
+  SDL_FreeSurface(target);
+  if (NULL != texture) {
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+  }
+  return texture;
+}
+
+/*
+ * SDL2::Video::TextureAtlas#build
+ *
+ * Packs the queued surfaces onto as few pages as possible, uploads one
+ * texture per page and releases the surfaces. Returns the page count.
+ */
+static mrb_value
+mrb_sdl2_video_atlas_build(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_atlas_packer_t packer;
+  mrb_sdl2_video_atlas_order_t *order;
+  mrb_int i, placed;
+  int page;
+  mrb_value surfaces, textures;
+  mrb_sdl2_video_atlas_data_t *data = mrb_sdl2_video_atlas_get_data(mrb, self);
+  if (data->is_built) {
+    return mrb_fixnum_value(data->npages);
+  }
+  surfaces = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__surfaces__"));
+  textures = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__"));
+
+  /* start over from what a failed build left behind */
+  for (i = 0; i < data->size; ++i) {
+    data->entries[i].page = -1;
+  }
+  for (i = 0; i < RARRAY_LEN(textures); ++i) {
+    mrb_funcall(mrb, mrb_ary_ref(mrb, textures, i), "destroy", 0);
+  }
+  mrb_ary_resize(mrb, textures, 0);
+
+  order = (mrb_sdl2_video_atlas_order_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_atlas_order_t) * (data->size + 1));
+  for (i = 0; i < data->size; ++i) {
+    order[i].index = i;
+    order[i].w     = data->entries[i].rect.w;
+    order[i].h     = data->entries[i].rect.h;
+  }
+  qsort(order, data->size, sizeof(mrb_sdl2_video_atlas_order_t), mrb_sdl2_video_atlas_compare);
+
+  /* the skyline never has more segments than the page is wide */
+  packer.w = data->page_w;
+  packer.h = data->page_h;
+  packer.nodes = (mrb_sdl2_video_atlas_skyline_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_atlas_skyline_t) * (data->page_w + 1));
+
+  for (placed = 0, page = 0; placed < data->size; ++page) {
+    int used_w = 0, used_h = 0;
+    SDL_Texture *texture;
+    mrb_sdl2_video_atlas_packer_reset(&packer);
+    for (i = 0; i < data->size; ++i) {
+      mrb_sdl2_video_atlas_entry_t *entry = &data->entries[order[i].index];
+      SDL_Point pos;
+      if (0 <= entry->page) {
+        continue;
+      }
+      if (mrb_sdl2_video_atlas_packer_insert(&packer, entry->rect.w + data->padding, entry->rect.h + data->padding, &pos)) {
+        entry->rect.x = pos.x;
+        entry->rect.y = pos.y;
+        entry->page   = page;
+        used_w = SDL_max(used_w, pos.x + entry->rect.w);
+        used_h = SDL_max(used_h, pos.y + entry->rect.h);
+        ++placed;
+      }
+    }
+    texture = mrb_sdl2_video_atlas_upload_page(mrb, data, surfaces, page, SDL_max(used_w, 1), SDL_max(used_h, 1));
+    if (NULL == texture) {
+      mrb_free(mrb, packer.nodes);
+      mrb_free(mrb, order);
+      mruby_sdl2_raise_error(mrb);
+    }
+    mrb_ary_push(mrb, textures, mrb_sdl2_video_renderer_texture(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__renderer__")), texture));
+  }
+  mrb_free(mrb, packer.nodes);
+  mrb_free(mrb, order);
+
+  data->npages   = page;
+  data->is_built = true;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__surfaces__"), mrb_nil_value());
+  return mrb_fixnum_value(data->npages);
+}
+
+static mrb_value
+mrb_sdl2_video_atlas_get_rect(mrb_state *mrb, mrb_value self)
+{
+  mrb_value key;
+  mrb_get_args(mrb, "o", &key);
+  return mrb_sdl2_rect_direct(mrb, &mrb_sdl2_video_atlas_lookup(mrb, self, key)->rect);
+}
+
+static mrb_value
+mrb_sdl2_video_atlas_get_texture(mrb_state *mrb, mrb_value self)
+{
+  mrb_value key;
+  mrb_sdl2_video_atlas_entry_t *entry;
+  mrb_get_args(mrb, "o", &key);
+  entry = mrb_sdl2_video_atlas_lookup(mrb, self, key);
+  return mrb_ary_ref(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__")), entry->page);
+}
+
+/*
+ * SDL2::Video::TextureAtlas#[](key)
+ *
+ * Returns [texture, src_rect], ready for Renderer#copy.
+ */
+static mrb_value
+mrb_sdl2_video_atlas_get_at(mrb_state *mrb, mrb_value self)
+{
+  mrb_value key;
+  mrb_value pair[2];
+  mrb_sdl2_video_atlas_entry_t *entry;
+  mrb_get_args(mrb, "o", &key);
+  entry = mrb_sdl2_video_atlas_lookup(mrb, self, key);
+  pair[0] = mrb_ary_ref(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__")), entry->page);
+  pair[1] = mrb_sdl2_rect_direct(mrb, &entry->rect);
+  return mrb_ary_new_from_values(mrb, 2, pair);
+}
+
+static mrb_value
+mrb_sdl2_video_atlas_get_page(mrb_state *mrb, mrb_value self)
+{
+  mrb_value key;
+  mrb_get_args(mrb, "o", &key);
+  return mrb_fixnum_value(mrb_sdl2_video_atlas_lookup(mrb, self, key)->page);
+}
+
+static mrb_value
+mrb_sdl2_video_atlas_get_textures(mrb_state *mrb, mrb_value self)
+{
+  mrb_value const textures = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__"));
+  return mrb_ary_new_from_values(mrb, RARRAY_LEN(textures), RARRAY_PTR(textures));
+}
+
+static mrb_value
+mrb_sdl2_video_atlas_get_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_atlas_get_data(mrb, self)->size);
+}
+
+static mrb_value
+mrb_sdl2_video_atlas_is_built(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(mrb_sdl2_video_atlas_get_data(mrb, self)->is_built);
+}
+
+void
+mruby_sdl2_video_atlas_init(mrb_state *mrb)
+{
+  class_TextureAtlas = mrb_define_class_under(mrb, mod_Video, "TextureAtlas", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_TextureAtlas, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_TextureAtlas, "initialize", mrb_sdl2_video_atlas_initialize,   MRB_ARGS_REQ(1) | MRB_ARGS_OPT(3));
+  mrb_define_method(mrb, class_TextureAtlas, "add",        mrb_sdl2_video_atlas_add,          MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_TextureAtlas, "build",      mrb_sdl2_video_atlas_build,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureAtlas, "built?",     mrb_sdl2_video_atlas_is_built,     MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureAtlas, "size",       mrb_sdl2_video_atlas_get_size,     MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureAtlas, "rect",       mrb_sdl2_video_atlas_get_rect,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureAtlas, "texture",    mrb_sdl2_video_atlas_get_texture,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureAtlas, "page",       mrb_sdl2_video_atlas_get_page,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureAtlas, "textures",   mrb_sdl2_video_atlas_get_textures, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureAtlas, "[]",         mrb_sdl2_video_atlas_get_at,       MRB_ARGS_REQ(1));
+}
+
+void
+mruby_sdl2_video_atlas_final(mrb_state *mrb)
+{
+}
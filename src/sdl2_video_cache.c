@@ -0,0 +1,366 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_video_cache.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/hash.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_surface.h>
+#else
+#include <SDL_render.h>
+#include <SDL_surface.h>
+#endif
+
+static struct RClass *class_TextureCache = NULL;
+
+/*
+ * Entries live in slots: the Ruby side keeps path => slot in a Hash and
+ * the Texture of each slot in an Array, the native side keeps the slots in
+ * a doubly linked list ordered from most to least recently used.
+ */
+typedef struct mrb_sdl2_video_cache_slot_t {
+  mrb_int prev;
+  mrb_int next;
+  size_t  bytes;
+} mrb_sdl2_video_cache_slot_t;
+
+typedef struct mrb_sdl2_video_cache_data_t {
+  SDL_Renderer *renderer;
+  size_t        budget;
+  size_t        bytes;
+  mrb_int       count;
+  mrb_int       head;      /* most recently used */
+  mrb_int       tail;      /* least recently used */
+  mrb_int       free_head; /* unused slots, chained through next */
+  mrb_int       capa;
+  mrb_int       hits;
+  mrb_int       misses;
+  mrb_int       evictions;
+  mrb_sdl2_video_cache_slot_t *slots;
+} mrb_sdl2_video_cache_data_t;
+
+static void
+mrb_sdl2_video_cache_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_cache_data_t *data =
+    (mrb_sdl2_video_cache_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->slots);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_cache_data_type = {
+  "TextureCache", mrb_sdl2_video_cache_data_free
+};
+
+static mrb_sdl2_video_cache_data_t *
+mrb_sdl2_video_cache_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_video_cache_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_cache_data_type);
+}
+
+static void
+mrb_sdl2_video_cache_unlink(mrb_sdl2_video_cache_data_t *data, mrb_int i)
+{
+  mrb_sdl2_video_cache_slot_t *slot = &data->slots[i];
+  if (-1 != slot->prev) {
+    data->slots[slot->prev].next = slot->next;
+  } else {
+    data->head = slot->next;
+  }
+  if (-1 != slot->next) {
+    data->slots[slot->next].prev = slot->prev;
+  } else {
+    data->tail = slot->prev;
+  }
+  slot->prev = slot->next = -1;
+}
+
+static void
+mrb_sdl2_video_cache_link_front(mrb_sdl2_video_cache_data_t *data, mrb_int i)
+{
+  mrb_sdl2_video_cache_slot_t *slot = &data->slots[i];
+  slot->prev = -1;
+  slot->next = data->head;
+  if (-1 != data->head) {
+    data->slots[data->head].prev = i;
+  } else {
+    data->tail = i;
+  }
+  data->head = i;
+}
+
+static mrb_int
+mrb_sdl2_video_cache_alloc_slot(mrb_state *mrb, mrb_sdl2_video_cache_data_t *data)
+{
+  mrb_int i;
+  if (-1 == data->free_head) {
+    mrb_int const capa = (0 < data->capa) ? data->capa * 2 : 32;
+    data->slots = (mrb_sdl2_video_cache_slot_t*)mrb_realloc(mrb, data->slots, sizeof(mrb_sdl2_video_cache_slot_t) * capa);
+    for (i = data->capa; i < capa; ++i) {
+      data->slots[i].next = (i + 1 < capa) ? i + 1 : -1;
+    }
+    data->free_head = data->capa;
+    data->capa = capa;
+  }
+  i = data->free_head;
+  data->free_head = data->slots[i].next;
+  return i;
+}
+
+/*
+ * Drops slot i from the cache and destroys its Texture: the cache created
+ * it, and leaving it to the GC would keep the memory alive past the budget
+ * for as long as anything still references it.
+ */
+static void
+mrb_sdl2_video_cache_remove(mrb_state *mrb, mrb_value self, mrb_sdl2_video_cache_data_t *data, mrb_int i)
+{
+  mrb_value const keys     = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__keys__"));
+  mrb_value const textures = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__"));
+  mrb_value const paths    = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__paths__"));
+  mrb_funcall(mrb, mrb_ary_ref(mrb, textures, i), "destroy", 0);
+  mrb_hash_delete_key(mrb, paths, mrb_ary_ref(mrb, keys, i));
+  mrb_ary_set(mrb, keys, i, mrb_nil_value());
+  mrb_ary_set(mrb, textures, i, mrb_nil_value());
+  mrb_sdl2_video_cache_unlink(data, i);
+  data->bytes -= data->slots[i].bytes;
+  data->slots[i].next = data->free_head;
+  data->free_head = i;
+  --data->count;
+}
+
+/* Evicts from the LRU end until within budget, always keeping `keep`. */
+static void
+mrb_sdl2_video_cache_trim(mrb_state *mrb, mrb_value self, mrb_sdl2_video_cache_data_t *data, mrb_int keep)
+{
+  while ((data->bytes > data->budget) && (-1 != data->tail) && (keep != data->tail)) {
+    mrb_sdl2_video_cache_remove(mrb, self, data, data->tail);
+    ++data->evictions;
+  }
+}
+
+static size_t
+mrb_sdl2_video_cache_texture_bytes(SDL_Texture *texture)
+{
+  uint32_t format;
+  int w, h;
+  if (0 != SDL_QueryTexture(texture, &format, NULL, &w, &h)) {
+    return 0;
+  }
+  if (SDL_ISPIXELFORMAT_FOURCC(format)) {
+    /* planar YUV: a full luma plane plus subsampled chroma */
+    return (size_t)w * h * 3 / 2;
+  }
+  return (size_t)w * h * SDL_BYTESPERPIXEL(format);
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::TextureCache
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::TextureCache.new(renderer, budget)
+ *
+ * `budget` is the estimated texture memory, in bytes, kept alive by the
+ * cache. Textures are destroyed when they are evicted, deleted or cleared,
+ * so a Texture returned by #fetch should not be kept across fetches.
+ */
+static mrb_value
+mrb_sdl2_video_cache_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer;
+  mrb_int budget;
+  mrb_sdl2_video_cache_data_t *data =
+    (mrb_sdl2_video_cache_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "oi", &renderer, &budget);
+  if (budget < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "budget must not be negative.");
+  }
+  if (NULL == data) {
+    data = (mrb_sdl2_video_cache_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_cache_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+    data->slots = NULL;
+  }
+  mrb_free(mrb, data->slots);
+  SDL_memset(data, 0, sizeof(*data));
+  data->renderer  = mrb_sdl2_video_renderer_get_ptr(mrb, renderer);
+  data->budget    = (size_t)budget;
+  data->head      = -1;
+  data->tail      = -1;
+  data->free_head = -1;
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_cache_data_type;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), renderer);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__paths__"),    mrb_hash_new(mrb));
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__keys__"),     mrb_ary_new(mrb));
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__textures__"), mrb_ary_new(mrb));
+  return self;
+}
+
+/*
+ * SDL2::Video::TextureCache#fetch(path)
+ *
+ * Returns the cached Texture for the BMP at `path`, loading and uploading
+ * it on a miss. Least recently used entries are evicted while the cache
+ * is over budget; the entry just fetched is never evicted.
+ */
+static mrb_value
+mrb_sdl2_video_cache_fetch(mrb_state *mrb, mrb_value self)
+{
+  mrb_value path, found, texture;
+  SDL_Surface *surface;
+  SDL_Texture *t;
+  mrb_int i;
+  mrb_sdl2_video_cache_data_t *data = mrb_sdl2_video_cache_get_data(mrb, self);
+  mrb_get_args(mrb, "S", &path);
+
+  found = mrb_hash_fetch(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__paths__")), path, mrb_nil_value());
+  if (!mrb_nil_p(found)) {
+    i = mrb_fixnum(found);
+    ++data->hits;
+    if (data->head != i) {
+      mrb_sdl2_video_cache_unlink(data, i);
+      mrb_sdl2_video_cache_link_front(data, i);
+    }
+    return mrb_ary_ref(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__")), i);
+  }
+
+  ++data->misses;
+  surface = SDL_LoadBMP(mrb_string_value_cstr(mrb, &path));
+  if (NULL == surface) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  t = SDL_CreateTextureFromSurface(data->renderer, surface);
+  SDL_FreeSurface(surface);
+  if (NULL == t) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  texture = mrb_sdl2_video_renderer_texture(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__renderer__")), t);
+
+  i = mrb_sdl2_video_cache_alloc_slot(mrb, data);
+  data->slots[i].bytes = mrb_sdl2_video_cache_texture_bytes(t);
+  data->bytes += data->slots[i].bytes;
+  ++data->count;
+  mrb_sdl2_video_cache_link_front(data, i);
+  path = mrb_str_dup(mrb, path);
+  mrb_ary_set(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__keys__")), i, path);
+  mrb_ary_set(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__")), i, texture);
+  mrb_hash_set(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__paths__")), path, mrb_fixnum_value(i));
+
+  mrb_sdl2_video_cache_trim(mrb, self, data, i);
+  return texture;
+}
+
+static mrb_value
+mrb_sdl2_video_cache_include(mrb_state *mrb, mrb_value self)
+{
+  mrb_value path;
+  mrb_get_args(mrb, "S", &path);
+  return mrb_bool_value(!mrb_nil_p(mrb_hash_fetch(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__paths__")), path, mrb_nil_value())));
+}
+
+static mrb_value
+mrb_sdl2_video_cache_delete(mrb_state *mrb, mrb_value self)
+{
+  mrb_value path, found;
+  mrb_sdl2_video_cache_data_t *data = mrb_sdl2_video_cache_get_data(mrb, self);
+  mrb_get_args(mrb, "S", &path);
+  found = mrb_hash_fetch(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__paths__")), path, mrb_nil_value());
+  if (mrb_nil_p(found)) {
+    return mrb_false_value();
+  }
+  mrb_sdl2_video_cache_remove(mrb, self, data, mrb_fixnum(found));
+  return mrb_true_value();
+}
+
+static mrb_value
+mrb_sdl2_video_cache_clear(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_cache_data_t *data = mrb_sdl2_video_cache_get_data(mrb, self);
+  while (-1 != data->head) {
+    mrb_sdl2_video_cache_remove(mrb, self, data, data->head);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_cache_get_budget(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value((mrb_int)mrb_sdl2_video_cache_get_data(mrb, self)->budget);
+}
+
+static mrb_value
+mrb_sdl2_video_cache_set_budget(mrb_state *mrb, mrb_value self)
+{
+  mrb_int budget;
+  mrb_sdl2_video_cache_data_t *data = mrb_sdl2_video_cache_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &budget);
+  if (budget < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "budget must not be negative.");
+  }
+  data->budget = (size_t)budget;
+  mrb_sdl2_video_cache_trim(mrb, self, data, -1);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_cache_get_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_cache_get_data(mrb, self)->count);
+}
+
+static mrb_value
+mrb_sdl2_video_cache_get_bytes(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value((mrb_int)mrb_sdl2_video_cache_get_data(mrb, self)->bytes);
+}
+
+static mrb_value
+mrb_sdl2_video_cache_get_stats(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_cache_data_t *data = mrb_sdl2_video_cache_get_data(mrb, self);
+  mrb_value hash = mrb_hash_new(mrb);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "size")),      mrb_fixnum_value(data->count));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "bytes")),     mrb_fixnum_value((mrb_int)data->bytes));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "budget")),    mrb_fixnum_value((mrb_int)data->budget));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "hits")),      mrb_fixnum_value(data->hits));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "misses")),    mrb_fixnum_value(data->misses));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_lit(mrb, "evictions")), mrb_fixnum_value(data->evictions));
+  return hash;
+}
+
+void
+mruby_sdl2_video_cache_init(mrb_state *mrb)
+{
+  class_TextureCache = mrb_define_class_under(mrb, mod_Video, "TextureCache", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_TextureCache, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_TextureCache, "initialize", mrb_sdl2_video_cache_initialize, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_TextureCache, "fetch",      mrb_sdl2_video_cache_fetch,      MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureCache, "[]",         mrb_sdl2_video_cache_fetch,      MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureCache, "include?",   mrb_sdl2_video_cache_include,    MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureCache, "delete",     mrb_sdl2_video_cache_delete,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureCache, "clear",      mrb_sdl2_video_cache_clear,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureCache, "budget",     mrb_sdl2_video_cache_get_budget, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureCache, "budget=",    mrb_sdl2_video_cache_set_budget, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TextureCache, "size",       mrb_sdl2_video_cache_get_size,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureCache, "bytes",      mrb_sdl2_video_cache_get_bytes,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TextureCache, "stats",      mrb_sdl2_video_cache_get_stats,  MRB_ARGS_NONE());
+}
+
+void
+mruby_sdl2_video_cache_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,397 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_video_capture.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#else
+#include <SDL_render.h>
+#include <SDL_surface.h>
+#include <SDL_thread.h>
+#include <SDL_mutex.h>
+#endif
+
+static struct RClass *class_FrameCapture = NULL;
+
+/*
+ * Capture slots are handed out in ring order: the main thread reads back
+ * into slots[head], the worker writes out slots[tail]. A slot that is
+ * still pending when the ring wraps makes the capture drop the frame.
+ */
+enum {
+  MRB_SDL2_CAPTURE_SLOT_FREE = 0,
+  MRB_SDL2_CAPTURE_SLOT_PENDING,
+  MRB_SDL2_CAPTURE_SLOT_WRITING
+};
+
+typedef struct mrb_sdl2_video_capture_slot_t {
+  SDL_Surface *surface;
+  char        *path;
+  int          state;
+} mrb_sdl2_video_capture_slot_t;
+
+typedef struct mrb_sdl2_video_capture_data_t {
+  SDL_Thread   *thread;
+  SDL_mutex    *mutex;
+  SDL_cond     *wakeup;
+  SDL_cond     *done;
+  bool          quit;
+  int           nslots;
+  int           head;
+  int           tail;
+  mrb_int       pending;
+  mrb_int       captured;
+  mrb_int       dropped;
+  mrb_int       written;
+  mrb_int       failed;
+  mrb_sdl2_video_capture_slot_t *slots;
+} mrb_sdl2_video_capture_data_t;
+
+static int
+mrb_sdl2_video_capture_worker(void *arg)
+{
+  mrb_sdl2_video_capture_data_t *data = (mrb_sdl2_video_capture_data_t*)arg;
+  SDL_LockMutex(data->mutex);
+  for (;;) {
+    mrb_sdl2_video_capture_slot_t *slot = &data->slots[data->tail];
+    int result;
+    while (!data->quit && (MRB_SDL2_CAPTURE_SLOT_PENDING != slot->state)) {
+      SDL_CondWait(data->wakeup, data->mutex);
+    }
+    if (MRB_SDL2_CAPTURE_SLOT_PENDING != slot->state) {
+      break;
+    }
+    slot->state = MRB_SDL2_CAPTURE_SLOT_WRITING;
+    SDL_UnlockMutex(data->mutex);
+
+    result = SDL_SaveBMP(slot->surface, slot->path);
+
+    SDL_LockMutex(data->mutex);
+    SDL_free(slot->path);
+    slot->path  = NULL;
+    slot->state = MRB_SDL2_CAPTURE_SLOT_FREE;
+    data->tail  = (data->tail + 1) % data->nslots;
+    --data->pending;
+    if (0 == result) {
+      ++data->written;
+    } else {
+      ++data->failed;
+    }
+    SDL_CondBroadcast(data->done);
+  }
+  SDL_UnlockMutex(data->mutex);
+  return 0;
+}
+
+/* Writes out what is queued, then stops the worker and frees the slots. */
+static void
+mrb_sdl2_video_capture_close(mrb_state *mrb, mrb_sdl2_video_capture_data_t *data)
+{
+  int i;
+  if (NULL != data->thread) {
+    SDL_LockMutex(data->mutex);
+    data->quit = true;
+    SDL_CondSignal(data->wakeup);
+    SDL_UnlockMutex(data->mutex);
+    SDL_WaitThread(data->thread, NULL);
+    data->thread = NULL;
+  }
+  if (NULL != data->slots) {
+    for (i = 0; i < data->nslots; ++i) {
+      if (NULL != data->slots[i].surface) {
+        SDL_FreeSurface(data->slots[i].surface);
+      }
+      if (NULL != data->slots[i].path) {
+        SDL_free(data->slots[i].path);
+      }
+    }
+    mrb_free(mrb, data->slots);
+    data->slots = NULL;
+  }
+  if (NULL != data->done) {
+    SDL_DestroyCond(data->done);
+    data->done = NULL;
+  }
+  if (NULL != data->wakeup) {
+    SDL_DestroyCond(data->wakeup);
+    data->wakeup = NULL;
+  }
+  if (NULL != data->mutex) {
+    SDL_DestroyMutex(data->mutex);
+    data->mutex = NULL;
+  }
+}
+
+static void
+mrb_sdl2_video_capture_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_capture_data_t *data =
+    (mrb_sdl2_video_capture_data_t*)p;
+  if (NULL != data) {
+    mrb_sdl2_video_capture_close(mrb, data);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_capture_data_type = {
+  "FrameCapture", mrb_sdl2_video_capture_data_free
+};
+
+static mrb_sdl2_video_capture_data_t *
+mrb_sdl2_video_capture_get_data(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data =
+    (mrb_sdl2_video_capture_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_capture_data_type);
+  if (NULL == data->thread) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "frame capture is already closed.");
+  }
+  return data;
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::FrameCapture
+*
+***************************************************************************/
+
+/*
+ * Size of what SDL_RenderReadPixels reads: the target texture while one is
+ * set, the renderer output otherwise.
+ */
+static int
+mrb_sdl2_video_capture_read_size(SDL_Renderer *renderer, int *w, int *h)
+{
+  SDL_Texture *target = SDL_GetRenderTarget(renderer);
+  if (NULL != target) {
+    return SDL_QueryTexture(target, NULL, NULL, w, h);
+  }
+  return SDL_GetRendererOutputSize(renderer, w, h);
+}
+
+/*
+ * SDL2::Video::FrameCapture.new(renderer, slots = 3)
+ *
+ * Preallocates `slots` ARGB8888 surfaces of the renderer output size and
+ * starts a worker thread that writes captured frames as BMP files.
+ */
+static mrb_value
+mrb_sdl2_video_capture_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer;
+  mrb_int nslots = 3;
+  int i, w, h;
+  mrb_sdl2_video_capture_data_t *data =
+    (mrb_sdl2_video_capture_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "o|i", &renderer, &nslots);
+  if (nslots <= 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "slots must be positive.");
+  }
+  if (NULL != data) {
+    mrb_sdl2_video_capture_data_free(mrb, data);
+    DATA_PTR(self) = NULL;
+  }
+  data = (mrb_sdl2_video_capture_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_capture_data_t));
+  if (NULL == data) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+  SDL_memset(data, 0, sizeof(*data));
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_capture_data_type;
+
+  if (0 != mrb_sdl2_video_capture_read_size(mrb_sdl2_video_renderer_get_ptr(mrb, renderer), &w, &h)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  data->slots = (mrb_sdl2_video_capture_slot_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_capture_slot_t) * nslots);
+  SDL_memset(data->slots, 0, sizeof(mrb_sdl2_video_capture_slot_t) * nslots);
+  data->nslots = (int)nslots;
+  for (i = 0; i < data->nslots; ++i) {
+    data->slots[i].surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (NULL == data->slots[i].surface) {
+      mruby_sdl2_raise_error(mrb);
+    }
+  }
+  data->mutex  = SDL_CreateMutex();
+  data->wakeup = SDL_CreateCond();
+  data->done   = SDL_CreateCond();
+  if ((NULL == data->mutex) || (NULL == data->wakeup) || (NULL == data->done)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  data->thread = SDL_CreateThread(mrb_sdl2_video_capture_worker, "FrameCapture", data);
+  if (NULL == data->thread) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), renderer);
+  return self;
+}
+
+/*
+ * SDL2::Video::FrameCapture#capture(path)
+ *
+ * Reads back the current render target into the next free slot and queues
+ * it to be written to `path`. Returns false (and counts a dropped frame)
+ * when every slot is still waiting on the worker.
+ */
+static mrb_value
+mrb_sdl2_video_capture_capture(mrb_state *mrb, mrb_value self)
+{
+  mrb_value path;
+  mrb_sdl2_video_capture_slot_t *slot;
+  SDL_Renderer *renderer;
+  SDL_Surface *surface;
+  int w, h, state;
+  mrb_sdl2_video_capture_data_t *data = mrb_sdl2_video_capture_get_data(mrb, self);
+  mrb_get_args(mrb, "S", &path);
+
+  SDL_LockMutex(data->mutex);
+  slot  = &data->slots[data->head];
+  state = slot->state;
+  if (MRB_SDL2_CAPTURE_SLOT_FREE != state) {
+    ++data->dropped;
+  }
+  SDL_UnlockMutex(data->mutex);
+  if (MRB_SDL2_CAPTURE_SLOT_FREE != state) {
+    return mrb_false_value();
+  }
+
+  /* the worker does not touch a free slot, so it is ours until queued */
+  renderer = mrb_sdl2_video_renderer_get_flushed_ptr(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__renderer__")));
+  if (0 != mrb_sdl2_video_capture_read_size(renderer, &w, &h)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  if ((slot->surface->w != w) || (slot->surface->h != h)) {
+    surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (NULL == surface) {
+      mruby_sdl2_raise_error(mrb);
+    }
+    SDL_FreeSurface(slot->surface);
+    slot->surface = surface;
+  }
+  if (0 != SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, slot->surface->pixels, slot->surface->pitch)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  slot->path = SDL_strdup(mrb_string_value_cstr(mrb, &path));
+  if (NULL == slot->path) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+
+  SDL_LockMutex(data->mutex);
+  slot->state = MRB_SDL2_CAPTURE_SLOT_PENDING;
+  data->head  = (data->head + 1) % data->nslots;
+  ++data->pending;
+  ++data->captured;
+  SDL_CondSignal(data->wakeup);
+  SDL_UnlockMutex(data->mutex);
+  return mrb_true_value();
+}
+
+/*
+ * SDL2::Video::FrameCapture#flush
+ *
+ * Blocks until every queued frame has been written.
+ */
+static mrb_value
+mrb_sdl2_video_capture_flush(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data = mrb_sdl2_video_capture_get_data(mrb, self);
+  SDL_LockMutex(data->mutex);
+  while (0 < data->pending) {
+    SDL_CondWait(data->done, data->mutex);
+  }
+  SDL_UnlockMutex(data->mutex);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_capture_close_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data =
+    (mrb_sdl2_video_capture_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_capture_data_type);
+  mrb_sdl2_video_capture_close(mrb, data);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), mrb_nil_value());
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_capture_is_closed(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data =
+    (mrb_sdl2_video_capture_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_capture_data_type);
+  return mrb_bool_value(NULL == data->thread);
+}
+
+/* the worker updates pending/written/failed, so reads go through the mutex */
+static mrb_value
+mrb_sdl2_video_capture_read_counter(mrb_sdl2_video_capture_data_t *data, mrb_int const *counter)
+{
+  mrb_int value;
+  SDL_LockMutex(data->mutex);
+  value = *counter;
+  SDL_UnlockMutex(data->mutex);
+  return mrb_fixnum_value(value);
+}
+
+static mrb_value
+mrb_sdl2_video_capture_get_pending(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data = mrb_sdl2_video_capture_get_data(mrb, self);
+  return mrb_sdl2_video_capture_read_counter(data, &data->pending);
+}
+
+static mrb_value
+mrb_sdl2_video_capture_get_captured(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data = mrb_sdl2_video_capture_get_data(mrb, self);
+  return mrb_sdl2_video_capture_read_counter(data, &data->captured);
+}
+
+static mrb_value
+mrb_sdl2_video_capture_get_dropped(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data = mrb_sdl2_video_capture_get_data(mrb, self);
+  return mrb_sdl2_video_capture_read_counter(data, &data->dropped);
+}
+
+static mrb_value
+mrb_sdl2_video_capture_get_written(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data = mrb_sdl2_video_capture_get_data(mrb, self);
+  return mrb_sdl2_video_capture_read_counter(data, &data->written);
+}
+
+static mrb_value
+mrb_sdl2_video_capture_get_failed(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_capture_data_t *data = mrb_sdl2_video_capture_get_data(mrb, self);
+  return mrb_sdl2_video_capture_read_counter(data, &data->failed);
+}
+
+void
+mruby_sdl2_video_capture_init(mrb_state *mrb)
+{
+  class_FrameCapture = mrb_define_class_under(mrb, mod_Video, "FrameCapture", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_FrameCapture, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_FrameCapture, "initialize", mrb_sdl2_video_capture_initialize,   MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_FrameCapture, "capture",    mrb_sdl2_video_capture_capture,      MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_FrameCapture, "flush",      mrb_sdl2_video_capture_flush,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_FrameCapture, "close",      mrb_sdl2_video_capture_close_m,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_FrameCapture, "closed?",    mrb_sdl2_video_capture_is_closed,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_FrameCapture, "pending",    mrb_sdl2_video_capture_get_pending,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_FrameCapture, "captured",   mrb_sdl2_video_capture_get_captured, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_FrameCapture, "dropped",    mrb_sdl2_video_capture_get_dropped,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_FrameCapture, "written",    mrb_sdl2_video_capture_get_written,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_FrameCapture, "failed",     mrb_sdl2_video_capture_get_failed,   MRB_ARGS_NONE());
+}
+
+void
+mruby_sdl2_video_capture_final(mrb_state *mrb)
+{
+}
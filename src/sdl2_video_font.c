@@ -0,0 +1,632 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_surface.h"
+#include "sdl2_video_font.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/hash.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#else
+#include <SDL_render.h>
+#endif
+
+#define MRB_SDL2_FONT_DENSE_GLYPHS  256
+#define MRB_SDL2_FONT_CACHE_LIMIT   64
+
+static struct RClass *class_BitmapFont = NULL;
+
+typedef struct mrb_sdl2_video_font_glyph_t {
+  uint32_t codepoint;
+  int16_t  x, y;
+  int16_t  w, h;
+  int16_t  advance;
+  bool     defined;
+} mrb_sdl2_video_font_glyph_t;
+
+/*
+ * Glyphs of the first 256 codepoints are looked up directly, the rest
+ * live in an array sorted by codepoint.
+ */
+typedef struct mrb_sdl2_video_font_data_t {
+  SDL_Renderer *renderer;
+  int           line_height;
+  SDL_Color     color;
+  mrb_sdl2_video_font_glyph_t dense[MRB_SDL2_FONT_DENSE_GLYPHS];
+  mrb_sdl2_video_font_glyph_t *sparse;
+  size_t        sparse_count;
+  size_t        sparse_capa;
+  mrb_int       cache_count;
+} mrb_sdl2_video_font_data_t;
+
+static void
+mrb_sdl2_video_font_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_font_data_t *data =
+    (mrb_sdl2_video_font_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->sparse);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_font_data_type = {
+  "BitmapFont", mrb_sdl2_video_font_data_free
+};
+
+static mrb_sdl2_video_font_data_t *
+mrb_sdl2_video_font_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_video_font_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_font_data_type);
+}
+
+static SDL_Texture *
+mrb_sdl2_video_font_sheet(mrb_state *mrb, mrb_value self)
+{
+  SDL_Texture *sheet = mrb_sdl2_video_texture_get_ptr(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__sheet__")));
+  if (NULL == sheet) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "texture is already destroyed.");
+  }
+  return sheet;
+}
+
+/*
+ * Destroys the Textures of the draw_cached cache and empties it: the font
+ * created them, so nothing else should hold on to them.
+ */
+static void
+mrb_sdl2_video_font_drop_cache(mrb_state *mrb, mrb_value self, mrb_sdl2_video_font_data_t *data)
+{
+  mrb_value const cache = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__cache__"));
+  mrb_value const textures = mrb_hash_values(mrb, cache);
+  mrb_int i;
+  for (i = 0; i < RARRAY_LEN(textures); ++i) {
+    mrb_funcall(mrb, mrb_ary_ref(mrb, textures, i), "destroy", 0);
+  }
+  mrb_hash_clear(mrb, cache);
+  data->cache_count = 0;
+}
+
+static mrb_sdl2_video_font_glyph_t const *
+mrb_sdl2_video_font_find(mrb_sdl2_video_font_data_t const *data, uint32_t codepoint)
+{
+  size_t lo = 0, hi = data->sparse_count;
+  if (codepoint < MRB_SDL2_FONT_DENSE_GLYPHS) {
+    return data->dense[codepoint].defined ? &data->dense[codepoint] : NULL;
+  }
+  while (lo < hi) {
+    size_t const mid = (lo + hi) / 2;
+    if (data->sparse[mid].codepoint < codepoint) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return ((lo < data->sparse_count) && (data->sparse[lo].codepoint == codepoint)) ? &data->sparse[lo] : NULL;
+}
+
+/* glyph drawn for characters missing from the font, if any */
+static mrb_sdl2_video_font_glyph_t const *
+mrb_sdl2_video_font_lookup(mrb_sdl2_video_font_data_t const *data, uint32_t codepoint)
+{
+  mrb_sdl2_video_font_glyph_t const *glyph = mrb_sdl2_video_font_find(data, codepoint);
+  return (NULL != glyph) ? glyph : mrb_sdl2_video_font_find(data, '?');
+}
+
+static void
+mrb_sdl2_video_font_define(mrb_state *mrb, mrb_sdl2_video_font_data_t *data, mrb_sdl2_video_font_glyph_t const *glyph)
+{
+  size_t lo = 0, hi = data->sparse_count;
+  if (glyph->codepoint < MRB_SDL2_FONT_DENSE_GLYPHS) {
+    data->dense[glyph->codepoint] = *glyph;
+    return;
+  }
+  while (lo < hi) {
+    size_t const mid = (lo + hi) / 2;
+    if (data->sparse[mid].codepoint < glyph->codepoint) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if ((lo < data->sparse_count) && (data->sparse[lo].codepoint == glyph->codepoint)) {
+    data->sparse[lo] = *glyph;
+    return;
+  }
+  if (data->sparse_count == data->sparse_capa) {
+    size_t const capa = (0 == data->sparse_capa) ? 64 : data->sparse_capa * 2;
+    data->sparse = (mrb_sdl2_video_font_glyph_t*)mrb_realloc(mrb, data->sparse, sizeof(mrb_sdl2_video_font_glyph_t) * capa);
+    data->sparse_capa = capa;
+  }
+  SDL_memmove(&data->sparse[lo + 1], &data->sparse[lo], sizeof(mrb_sdl2_video_font_glyph_t) * (data->sparse_count - lo));
+  data->sparse[lo] = *glyph;
+  ++data->sparse_count;
+}
+
+/* smallest codepoint that needs n continuation bytes */
+static uint32_t const mrb_sdl2_video_font_utf8_min[4] = { 0, 0x80, 0x800, 0x10000 };
+
+/*
+ * Decodes one UTF-8 sequence at *p, advancing it. Malformed input, overlong
+ * forms, surrogates and values above U+10FFFF yield U+FFFD and consume a
+ * single byte.
+ */
+static uint32_t
+mrb_sdl2_video_font_next_codepoint(uint8_t const **p, uint8_t const *end)
+{
+  uint8_t const *s = *p;
+  uint32_t c = s[0];
+  int n, i;
+  if (c < 0x80) {
+    *p = s + 1;
+    return c;
+  } else if ((c & 0xe0) == 0xc0) {
+    n = 1;
+    c &= 0x1f;
+  } else if ((c & 0xf0) == 0xe0) {
+    n = 2;
+    c &= 0x0f;
+  } else if ((c & 0xf8) == 0xf0) {
+    n = 3;
+    c &= 0x07;
+  } else {
+    *p = s + 1;
+    return 0xfffd;
+  }
+  if (end - s <= n) {
+    *p = s + 1;
+    return 0xfffd;
+  }
+  for (i = 1; i <= n; ++i) {
+    if ((s[i] & 0xc0) != 0x80) {
+      *p = s + 1;
+      return 0xfffd;
+    }
+    c = (c << 6) | (s[i] & 0x3f);
+  }
+  if ((c < mrb_sdl2_video_font_utf8_min[n]) || ((0xd800 <= c) && (c <= 0xdfff)) || (0x10ffff < c)) {
+    *p = s + 1;
+    return 0xfffd;
+  }
+  *p = s + n + 1;
+  return c;
+}
+
+/*
+ * Lays out `text` with its top left corner at (x, y) and copies every
+ * glyph from `sheet`. A NULL renderer only measures. Returns -1 on SDL
+ * errors.
+ */
+static int
+mrb_sdl2_video_font_layout(SDL_Renderer *renderer, SDL_Texture *sheet, mrb_sdl2_video_font_data_t const *data, mrb_value text, int x, int y, int *width, int *height)
+{
+  uint8_t const *p   = (uint8_t const*)RSTRING_PTR(text);
+  uint8_t const *end = p + RSTRING_LEN(text);
+  int pen_x = x, pen_y = y, max_x = x;
+  while (p < end) {
+    uint32_t const c = mrb_sdl2_video_font_next_codepoint(&p, end);
+    mrb_sdl2_video_font_glyph_t const *glyph;
+    if ('\n' == c) {
+      pen_x = x;
+      pen_y += data->line_height;
+      continue;
+    }
+    if ('\r' == c) {
+      continue;
+    }
+    glyph = mrb_sdl2_video_font_lookup(data, c);
+    if (NULL == glyph) {
+      continue;
+    }
+    if ((NULL != renderer) && (0 < glyph->w) && (0 < glyph->h)) {
+      SDL_Rect const src = { glyph->x, glyph->y, glyph->w, glyph->h };
+      SDL_Rect const dst = { pen_x, pen_y, glyph->w, glyph->h };
+      if (0 != SDL_RenderCopy(renderer, sheet, &src, &dst)) {
+        return -1;
+      }
+    }
+    pen_x += glyph->advance;
+    if (max_x < pen_x) {
+      max_x = pen_x;
+    }
+  }
+  if (NULL != width) {
+    *width = max_x - x;
+  }
+  if (NULL != height) {
+    *height = pen_y - y + data->line_height;
+  }
+  return 0;
+}
+
+/* Sets color as the modulation of texture, saving the previous one. */
+static int
+mrb_sdl2_video_font_apply_color(SDL_Texture *texture, SDL_Color color, SDL_Color *saved)
+{
+  if ((0 != SDL_GetTextureColorMod(texture, &saved->r, &saved->g, &saved->b)) ||
+      (0 != SDL_GetTextureAlphaMod(texture, &saved->a))) {
+    return -1;
+  }
+  if (0 != SDL_SetTextureColorMod(texture, color.r, color.g, color.b)) {
+    return -1;
+  }
+  return SDL_SetTextureAlphaMod(texture, color.a);
+}
+
+static void
+mrb_sdl2_video_font_restore_color(SDL_Texture *texture, SDL_Color saved)
+{
+  SDL_SetTextureColorMod(texture, saved.r, saved.g, saved.b);
+  SDL_SetTextureAlphaMod(texture, saved.a);
+}
+
+/*
+ * Renders `text` into a new target texture with straight (non blended)
+ * glyph copies so that the texture keeps the sheet's alpha channel.
+ */
+static SDL_Texture *
+mrb_sdl2_video_font_render_texture(mrb_state *mrb, mrb_value renderer_value, SDL_Texture *sheet, mrb_sdl2_video_font_data_t const *data, mrb_value text, SDL_Color color)
+{
+  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_flushed_ptr(mrb, renderer_value);
+  SDL_Texture *previous = SDL_GetRenderTarget(renderer);
+  SDL_Texture *texture;
+  SDL_BlendMode sheet_blend;
+  SDL_Color sheet_color = { 255, 255, 255, 255 };
+  int w, h, result;
+  mrb_sdl2_video_font_layout(NULL, NULL, data, text, 0, 0, &w, &h);
+  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, SDL_max(w, 1), SDL_max(h, 1));
+  if (NULL == texture) {
+    return NULL;
+  }
+  SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+  SDL_GetTextureBlendMode(sheet, &sheet_blend);
+  result = SDL_SetRenderTarget(renderer, texture);
+  if (0 == result) {
+    result = SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+  }
+  if (0 == result) {
+    result = SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+  }
+  if (0 == result) {
+    result = SDL_RenderClear(renderer);
+  }
+  if (0 == result) {
+    result = SDL_SetTextureBlendMode(sheet, SDL_BLENDMODE_NONE);
+  }
+  if (0 == result) {
+    result = mrb_sdl2_video_font_apply_color(sheet, color, &sheet_color);
+  }
+  if (0 == result) {
+    result = mrb_sdl2_video_font_layout(renderer, sheet, data, text, 0, 0, NULL, NULL);
+  }
+  SDL_SetTextureBlendMode(sheet, sheet_blend);
+  mrb_sdl2_video_font_restore_color(sheet, sheet_color);
+  if (0 != SDL_SetRenderTarget(renderer, previous)) {
+    result = -1;
+  }
+  /* target, draw color and blend mode were changed behind the cache */
+  mrb_sdl2_video_renderer_restore_state(mrb, renderer_value);
+  if (0 != result) {
+    SDL_DestroyTexture(texture);
+    return NULL;
+  }
+  return texture;
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::BitmapFont
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::BitmapFont.new(renderer, sheet, glyph_width, glyph_height, first = 32)
+ *
+ * `sheet` is a Texture or Surface holding fixed size glyphs in a grid,
+ * left to right and top to bottom, starting at codepoint `first`. Glyphs
+ * can be redefined with proportional metrics using #set_glyph.
+ */
+static mrb_value
+mrb_sdl2_video_font_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer_value, sheet;
+  mrb_int glyph_w, glyph_h, first = 32;
+  SDL_Renderer *renderer;
+  SDL_Texture *texture;
+  int tex_w, tex_h, columns, rows, i;
+  mrb_sdl2_video_font_data_t *data =
+    (mrb_sdl2_video_font_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "ooii|i", &renderer_value, &sheet, &glyph_w, &glyph_h, &first);
+  if ((glyph_w <= 0) || (glyph_h <= 0) || (glyph_w > INT16_MAX) || (glyph_h > INT16_MAX)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid glyph size.");
+  }
+  if (first < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "first codepoint must not be negative.");
+  }
+  renderer = mrb_sdl2_video_renderer_get_ptr(mrb, renderer_value);
+  if (mrb_obj_is_kind_of(mrb, sheet, mrb_class_get_under(mrb, mod_Video, "Surface"))) {
+    texture = SDL_CreateTextureFromSurface(renderer, mrb_sdl2_video_surface_get_ptr(mrb, sheet));
+    if (NULL == texture) {
+      mruby_sdl2_raise_error(mrb);
+    }
+    sheet = mrb_sdl2_video_renderer_texture(mrb, renderer_value, texture);
+  } else {
+    texture = mrb_sdl2_video_texture_get_ptr(mrb, sheet);
+  }
+  if (0 != SDL_QueryTexture(texture, NULL, NULL, &tex_w, &tex_h)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  if ((tex_w > INT16_MAX) || (tex_h > INT16_MAX)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "glyph sheet is too large.");
+  }
+  if (NULL == data) {
+    data = (mrb_sdl2_video_font_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_font_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+  } else {
+    mrb_free(mrb, data->sparse);
+  }
+  SDL_memset(data, 0, sizeof(*data));
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_font_data_type;
+  data->renderer    = renderer;
+  data->line_height = (int)glyph_h;
+  data->color       = (SDL_Color){ 255, 255, 255, 255 };
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__sheet__"), sheet);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__cache__"), mrb_hash_new(mrb));
+
+  columns = tex_w / (int)glyph_w;
+  rows    = tex_h / (int)glyph_h;
+  for (i = 0; i < columns * rows; ++i) {
+    mrb_sdl2_video_font_glyph_t glyph;
+    glyph.codepoint = (uint32_t)(first + i);
+    glyph.x         = (int16_t)((i % columns) * glyph_w);
+    glyph.y         = (int16_t)((i / columns) * glyph_h);
+    glyph.w         = (int16_t)glyph_w;
+    glyph.h         = (int16_t)glyph_h;
+    glyph.advance   = (int16_t)glyph_w;
+    glyph.defined   = true;
+    mrb_sdl2_video_font_define(mrb, data, &glyph);
+  }
+  return self;
+}
+
+/*
+ * SDL2::Video::BitmapFont#set_glyph(codepoint, x, y, w, h, advance = w)
+ */
+static mrb_value
+mrb_sdl2_video_font_set_glyph(mrb_state *mrb, mrb_value self)
+{
+  mrb_int codepoint, x, y, w, h, advance = -1;
+  mrb_sdl2_video_font_glyph_t glyph;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  int const argc = mrb_get_args(mrb, "iiiii|i", &codepoint, &x, &y, &w, &h, &advance);
+  if ((codepoint < 0) || (codepoint > 0x10ffff)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "codepoint is out of range.");
+  }
+  if (6 > argc) {
+    advance = w;
+  }
+  if ((x < 0) || (y < 0) || (w < 0) || (h < 0) ||
+      (x > INT16_MAX) || (y > INT16_MAX) || (w > INT16_MAX) || (h > INT16_MAX) ||
+      (advance < INT16_MIN) || (advance > INT16_MAX)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "glyph metrics are out of range.");
+  }
+  glyph.codepoint = (uint32_t)codepoint;
+  glyph.x         = (int16_t)x;
+  glyph.y         = (int16_t)y;
+  glyph.w         = (int16_t)w;
+  glyph.h         = (int16_t)h;
+  glyph.advance   = (int16_t)advance;
+  glyph.defined   = true;
+  mrb_sdl2_video_font_define(mrb, data, &glyph);
+  mrb_sdl2_video_font_drop_cache(mrb, self, data);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_font_get_glyph(mrb_state *mrb, mrb_value self)
+{
+  mrb_int codepoint;
+  mrb_value values[5];
+  mrb_sdl2_video_font_glyph_t const *glyph;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &codepoint);
+  glyph = (codepoint < 0) ? NULL : mrb_sdl2_video_font_find(data, (uint32_t)codepoint);
+  if (NULL == glyph) {
+    return mrb_nil_value();
+  }
+  values[0] = mrb_fixnum_value(glyph->x);
+  values[1] = mrb_fixnum_value(glyph->y);
+  values[2] = mrb_fixnum_value(glyph->w);
+  values[3] = mrb_fixnum_value(glyph->h);
+  values[4] = mrb_fixnum_value(glyph->advance);
+  return mrb_ary_new_from_values(mrb, 5, values);
+}
+
+static mrb_value
+mrb_sdl2_video_font_get_line_height(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_font_get_data(mrb, self)->line_height);
+}
+
+static mrb_value
+mrb_sdl2_video_font_set_line_height(mrb_state *mrb, mrb_value self)
+{
+  mrb_int line_height;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &line_height);
+  data->line_height = (int)line_height;
+  mrb_sdl2_video_font_drop_cache(mrb, self, data);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_font_set_color(mrb_state *mrb, mrb_value self)
+{
+  mrb_int r, g, b, a = 255;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  mrb_get_args(mrb, "iii|i", &r, &g, &b, &a);
+  data->color = (SDL_Color){ (Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a };
+  return self;
+}
+
+/*
+ * SDL2::Video::BitmapFont#text_size(text)
+ *
+ * Returns [width, height] of the laid out text.
+ */
+static mrb_value
+mrb_sdl2_video_font_text_size(mrb_state *mrb, mrb_value self)
+{
+  mrb_value text;
+  mrb_value values[2];
+  int w, h;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  mrb_get_args(mrb, "S", &text);
+  mrb_sdl2_video_font_layout(NULL, NULL, data, text, 0, 0, &w, &h);
+  values[0] = mrb_fixnum_value(w);
+  values[1] = mrb_fixnum_value(h);
+  return mrb_ary_new_from_values(mrb, 2, values);
+}
+
+/*
+ * SDL2::Video::BitmapFont#draw_text(renderer, text, x, y)
+ *
+ * Draws a UTF-8 string in the font color; "\n" starts a new line at x.
+ */
+static mrb_value
+mrb_sdl2_video_font_draw_text(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer_value, text;
+  mrb_int x, y;
+  SDL_Renderer *renderer;
+  SDL_Texture *sheet;
+  SDL_Color saved;
+  int result;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  mrb_get_args(mrb, "oSii", &renderer_value, &text, &x, &y);
+  renderer = mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer_value, "BitmapFont#draw_text cannot be recorded.");
+  sheet = mrb_sdl2_video_font_sheet(mrb, self);
+  if (0 != mrb_sdl2_video_font_apply_color(sheet, data->color, &saved)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  result = mrb_sdl2_video_font_layout(renderer, sheet, data, text, (int)x, (int)y, NULL, NULL);
+  mrb_sdl2_video_font_restore_color(sheet, saved);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+/*
+ * SDL2::Video::BitmapFont#render_to_texture(renderer, text)
+ *
+ * Returns a new Texture with the text drawn in the font color on a
+ * transparent background.
+ */
+static mrb_value
+mrb_sdl2_video_font_render_to_texture(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer_value, text;
+  SDL_Texture *texture;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  mrb_get_args(mrb, "oS", &renderer_value, &text);
+  texture = mrb_sdl2_video_font_render_texture(mrb, renderer_value, mrb_sdl2_video_font_sheet(mrb, self), data, text, data->color);
+  if (NULL == texture) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return mrb_sdl2_video_renderer_texture(mrb, renderer_value, texture);
+}
+
+/*
+ * SDL2::Video::BitmapFont#draw_cached(renderer, text, x, y)
+ *
+ * Like #draw_text, but renders each distinct string once into a texture
+ * and then draws it with a single copy. Meant for labels that rarely
+ * change; the cache holds at most 64 strings and is emptied when full.
+ */
+static mrb_value
+mrb_sdl2_video_font_draw_cached(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer_value, text, cache, cached;
+  mrb_int x, y;
+  SDL_Renderer *renderer;
+  SDL_Texture *texture;
+  SDL_Rect dst;
+  SDL_Color saved;
+  int result;
+  mrb_sdl2_video_font_data_t *data = mrb_sdl2_video_font_get_data(mrb, self);
+  mrb_get_args(mrb, "oSii", &renderer_value, &text, &x, &y);
+  renderer = mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer_value, "BitmapFont#draw_cached cannot be recorded.");
+  cache = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__cache__"));
+  if (renderer != data->renderer) {
+    mrb_sdl2_video_font_drop_cache(mrb, self, data);
+    data->renderer = renderer;
+  }
+  cached = mrb_hash_fetch(mrb, cache, text, mrb_nil_value());
+  if (mrb_nil_p(cached)) {
+    SDL_Color const white = { 255, 255, 255, 255 };
+    texture = mrb_sdl2_video_font_render_texture(mrb, renderer_value, mrb_sdl2_video_font_sheet(mrb, self), data, text, white);
+    if (NULL == texture) {
+      mruby_sdl2_raise_error(mrb);
+    }
+    if (MRB_SDL2_FONT_CACHE_LIMIT <= data->cache_count) {
+      mrb_sdl2_video_font_drop_cache(mrb, self, data);
+    }
+    cached = mrb_sdl2_video_renderer_texture(mrb, renderer_value, texture);
+    mrb_hash_set(mrb, cache, mrb_str_dup(mrb, text), cached);
+    ++data->cache_count;
+  } else {
+    texture = mrb_sdl2_video_texture_get_ptr(mrb, cached);
+  }
+  dst.x = (int)x;
+  dst.y = (int)y;
+  if ((0 != SDL_QueryTexture(texture, NULL, NULL, &dst.w, &dst.h)) ||
+      (0 != mrb_sdl2_video_font_apply_color(texture, data->color, &saved))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  result = SDL_RenderCopy(renderer, texture, NULL, &dst);
+  mrb_sdl2_video_font_restore_color(texture, saved);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_font_clear_cache(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_font_drop_cache(mrb, self, mrb_sdl2_video_font_get_data(mrb, self));
+  return self;
+}
+
+void
+mruby_sdl2_video_font_init(mrb_state *mrb)
+{
+  class_BitmapFont = mrb_define_class_under(mrb, mod_Video, "BitmapFont", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_BitmapFont, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_BitmapFont, "initialize",        mrb_sdl2_video_font_initialize,        MRB_ARGS_REQ(4) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_BitmapFont, "set_glyph",         mrb_sdl2_video_font_set_glyph,         MRB_ARGS_REQ(5) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_BitmapFont, "glyph",             mrb_sdl2_video_font_get_glyph,         MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_BitmapFont, "line_height",       mrb_sdl2_video_font_get_line_height,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_BitmapFont, "line_height=",      mrb_sdl2_video_font_set_line_height,   MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_BitmapFont, "set_color",         mrb_sdl2_video_font_set_color,         MRB_ARGS_REQ(3) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_BitmapFont, "text_size",         mrb_sdl2_video_font_text_size,         MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_BitmapFont, "draw_text",         mrb_sdl2_video_font_draw_text,         MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, class_BitmapFont, "render_to_texture", mrb_sdl2_video_font_render_to_texture, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_BitmapFont, "draw_cached",       mrb_sdl2_video_font_draw_cached,       MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, class_BitmapFont, "clear_cache",       mrb_sdl2_video_font_clear_cache,       MRB_ARGS_NONE());
+}
+
+void
+mruby_sdl2_video_font_final(mrb_state *mrb)
+{
+}
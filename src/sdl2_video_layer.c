@@ -0,0 +1,407 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_video_layer.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#else
+#include <SDL_render.h>
+#endif
+
+static struct RClass *class_RenderLayer = NULL;
+static struct RClass *class_Compositor  = NULL;
+
+/*
+ * A layer owns a render target texture holding its last painted content.
+ * The painter block only runs again after the layer was invalidated.
+ */
+typedef struct mrb_sdl2_video_layer_data_t {
+  int      x, y;
+  int      w, h;
+  bool     is_dirty;
+  bool     is_visible;
+  mrb_int  repaints;
+} mrb_sdl2_video_layer_data_t;
+
+static void
+mrb_sdl2_video_layer_data_free(mrb_state *mrb, void *p)
+{
+  mrb_free(mrb, p);
+}
+
+static struct mrb_data_type const mrb_sdl2_video_layer_data_type = {
+  "RenderLayer", mrb_sdl2_video_layer_data_free
+};
+
+static mrb_sdl2_video_layer_data_t *
+mrb_sdl2_video_layer_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_video_layer_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_layer_data_type);
+}
+
+/* args: [renderer, texture, painter] */
+static mrb_value
+mrb_sdl2_video_layer_paint_body(mrb_state *mrb, mrb_value args)
+{
+  mrb_value const renderer = mrb_ary_ref(mrb, args, 0);
+  SDL_Renderer *r;
+  mrb_funcall(mrb, renderer, "target=", 1, mrb_ary_ref(mrb, args, 1));
+  r = mrb_sdl2_video_renderer_get_flushed_ptr(mrb, renderer);
+  if ((0 != SDL_SetRenderDrawColor(r, 0, 0, 0, 0)) || (0 != SDL_RenderClear(r))) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  mrb_sdl2_video_renderer_restore_state(mrb, renderer);
+  return mrb_yield(mrb, mrb_ary_ref(mrb, args, 2), renderer);
+}
+
+/* args: [renderer, previous target] */
+static mrb_value
+mrb_sdl2_video_layer_paint_ensure(mrb_state *mrb, mrb_value args)
+{
+  return mrb_funcall(mrb, mrb_ary_ref(mrb, args, 0), "target=", 1, mrb_ary_ref(mrb, args, 1));
+}
+
+/*
+ * Repaints the layer if it is dirty and has a painter. The renderer's
+ * target is switched through Renderer#target= and restored even when
+ * the painter raises.
+ */
+static bool
+mrb_sdl2_video_layer_refresh(mrb_state *mrb, mrb_value self, mrb_sdl2_video_layer_data_t *data, mrb_value renderer)
+{
+  mrb_value painter = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__painter__"));
+  mrb_value body[3], ensure[2];
+  if (!data->is_dirty || mrb_nil_p(painter)) {
+    return false;
+  }
+  body[0]   = renderer;
+  body[1]   = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__texture__"));
+  body[2]   = painter;
+  ensure[0] = renderer;
+  ensure[1] = mrb_funcall(mrb, renderer, "target", 0);
+  mrb_ensure(mrb, mrb_sdl2_video_layer_paint_body, mrb_ary_new_from_values(mrb, 3, body),
+                  mrb_sdl2_video_layer_paint_ensure, mrb_ary_new_from_values(mrb, 2, ensure));
+  data->is_dirty = false;
+  ++data->repaints;
+  return true;
+}
+
+static void
+mrb_sdl2_video_layer_composite(mrb_state *mrb, mrb_value self, mrb_sdl2_video_layer_data_t const *data, mrb_value renderer)
+{
+  SDL_Rect const dst = { data->x, data->y, data->w, data->h };
+  SDL_Texture *texture = mrb_sdl2_video_texture_get_ptr(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__texture__")));
+  if (!data->is_visible) {
+    return;
+  }
+  if (0 != SDL_RenderCopy(mrb_sdl2_video_renderer_get_flushed_ptr(mrb, renderer), texture, NULL, &dst)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::RenderLayer
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::RenderLayer.new(renderer, width, height) { |renderer| ... }
+ *
+ * The block paints the layer's content into its texture, with the texture
+ * as the renderer's target and cleared to transparent black.
+ */
+static mrb_value
+mrb_sdl2_video_layer_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer, painter = mrb_nil_value();
+  mrb_int w, h;
+  SDL_Texture *texture;
+  mrb_sdl2_video_layer_data_t *data =
+    (mrb_sdl2_video_layer_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "oii&", &renderer, &w, &h, &painter);
+  if ((w <= 0) || (h <= 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "layer size must be positive.");
+  }
+  texture = SDL_CreateTexture(mrb_sdl2_video_renderer_get_ptr(mrb, renderer), SDL_PIXELFORMAT_ARGB8888,
+                              SDL_TEXTUREACCESS_TARGET, (int)w, (int)h);
+  if (NULL == texture) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+  if (NULL == data) {
+    data = (mrb_sdl2_video_layer_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_layer_data_t));
+    if (NULL == data) {
+      SDL_DestroyTexture(texture);
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+  }
+  data->x          = 0;
+  data->y          = 0;
+  data->w          = (int)w;
+  data->h          = (int)h;
+  data->is_dirty   = true;
+  data->is_visible = true;
+  data->repaints   = 0;
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_layer_data_type;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__texture__"), mrb_sdl2_video_renderer_texture(mrb, renderer, texture));
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__painter__"), painter);
+  return self;
+}
+
+/*
+ * SDL2::Video::RenderLayer#update(renderer) { |renderer| ... }
+ *
+ * Repaints the layer if it was invalidated; a block given here replaces
+ * the painter. Returns true when the painter ran.
+ */
+static mrb_value
+mrb_sdl2_video_layer_update(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer, painter = mrb_nil_value();
+  mrb_sdl2_video_layer_data_t *data = mrb_sdl2_video_layer_get_data(mrb, self);
+  mrb_get_args(mrb, "o&", &renderer, &painter);
+  mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer, "RenderLayer#update cannot be recorded.");
+  if (!mrb_nil_p(painter)) {
+    mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__painter__"), painter);
+  }
+  return mrb_bool_value(mrb_sdl2_video_layer_refresh(mrb, self, data, renderer));
+}
+
+/*
+ * SDL2::Video::RenderLayer#draw(renderer)
+ *
+ * Repaints the layer if needed and copies it to the current target at
+ * its position. Returns true when the painter ran.
+ */
+static mrb_value
+mrb_sdl2_video_layer_draw(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer;
+  bool repainted;
+  mrb_sdl2_video_layer_data_t *data = mrb_sdl2_video_layer_get_data(mrb, self);
+  mrb_get_args(mrb, "o", &renderer);
+  mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer, "RenderLayer#draw cannot be recorded.");
+  repainted = mrb_sdl2_video_layer_refresh(mrb, self, data, renderer);
+  mrb_sdl2_video_layer_composite(mrb, self, data, renderer);
+  return mrb_bool_value(repainted);
+}
+
+/*
+ * SDL2::Video::RenderLayer#invalidate
+ *
+ * Marks the content as changed. Also needed after the renderer reported
+ * that render targets were reset.
+ */
+static mrb_value
+mrb_sdl2_video_layer_invalidate(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_layer_get_data(mrb, self)->is_dirty = true;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_layer_is_dirty(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(mrb_sdl2_video_layer_get_data(mrb, self)->is_dirty);
+}
+
+static mrb_value
+mrb_sdl2_video_layer_is_visible(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(mrb_sdl2_video_layer_get_data(mrb, self)->is_visible);
+}
+
+static mrb_value
+mrb_sdl2_video_layer_set_visible(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool is_visible;
+  mrb_get_args(mrb, "b", &is_visible);
+  mrb_sdl2_video_layer_get_data(mrb, self)->is_visible = is_visible;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_layer_get_x(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_layer_get_data(mrb, self)->x);
+}
+
+static mrb_value
+mrb_sdl2_video_layer_set_x(mrb_state *mrb, mrb_value self)
+{
+  mrb_int x;
+  mrb_get_args(mrb, "i", &x);
+  mrb_sdl2_video_layer_get_data(mrb, self)->x = (int)x;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_layer_get_y(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_layer_get_data(mrb, self)->y);
+}
+
+static mrb_value
+mrb_sdl2_video_layer_set_y(mrb_state *mrb, mrb_value self)
+{
+  mrb_int y;
+  mrb_get_args(mrb, "i", &y);
+  mrb_sdl2_video_layer_get_data(mrb, self)->y = (int)y;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_layer_get_width(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_layer_get_data(mrb, self)->w);
+}
+
+static mrb_value
+mrb_sdl2_video_layer_get_height(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_layer_get_data(mrb, self)->h);
+}
+
+static mrb_value
+mrb_sdl2_video_layer_get_repaints(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_layer_get_data(mrb, self)->repaints);
+}
+
+static mrb_value
+mrb_sdl2_video_layer_get_texture(mrb_state *mrb, mrb_value self)
+{
+  return mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__texture__"));
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::Compositor
+*
+***************************************************************************/
+
+static mrb_value
+mrb_sdl2_video_compositor_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer;
+  mrb_get_args(mrb, "o", &renderer);
+  mrb_sdl2_video_renderer_get_ptr(mrb, renderer);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), renderer);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__layers__"), mrb_ary_new(mrb));
+  return self;
+}
+
+/*
+ * SDL2::Video::Compositor#add(layer)
+ *
+ * Layers are composited in the order they were added, back to front.
+ */
+static mrb_value
+mrb_sdl2_video_compositor_add(mrb_state *mrb, mrb_value self)
+{
+  mrb_value layer;
+  mrb_get_args(mrb, "o", &layer);
+  mrb_sdl2_video_layer_get_data(mrb, layer);
+  mrb_ary_push(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__layers__")), layer);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_compositor_remove(mrb_state *mrb, mrb_value self)
+{
+  mrb_value layer;
+  mrb_get_args(mrb, "o", &layer);
+  return mrb_funcall(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__layers__")), "delete", 1, layer);
+}
+
+static mrb_value
+mrb_sdl2_video_compositor_get_layers(mrb_state *mrb, mrb_value self)
+{
+  return mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__layers__"));
+}
+
+/*
+ * SDL2::Video::Compositor#invalidate
+ *
+ * Marks every layer dirty, e.g. after render targets were reset.
+ */
+static mrb_value
+mrb_sdl2_video_compositor_invalidate(mrb_state *mrb, mrb_value self)
+{
+  mrb_value layers = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__layers__"));
+  mrb_int i;
+  for (i = 0; i < RARRAY_LEN(layers); ++i) {
+    mrb_sdl2_video_layer_get_data(mrb, RARRAY_PTR(layers)[i])->is_dirty = true;
+  }
+  return self;
+}
+
+/*
+ * SDL2::Video::Compositor#draw
+ *
+ * Repaints the dirty layers, then copies every visible layer to the
+ * renderer's current target. Returns the number of layers repainted.
+ */
+static mrb_value
+mrb_sdl2_video_compositor_draw(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__renderer__"));
+  mrb_value layers = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__layers__"));
+  mrb_int i, repainted = 0;
+  mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer, "Compositor#draw cannot be recorded.");
+  /* painters may change the array, so index it afresh every time */
+  for (i = 0; i < RARRAY_LEN(layers); ++i) {
+    mrb_value const layer = RARRAY_PTR(layers)[i];
+    if (mrb_sdl2_video_layer_refresh(mrb, layer, mrb_sdl2_video_layer_get_data(mrb, layer), renderer)) {
+      ++repainted;
+    }
+  }
+  for (i = 0; i < RARRAY_LEN(layers); ++i) {
+    mrb_value const layer = RARRAY_PTR(layers)[i];
+    mrb_sdl2_video_layer_composite(mrb, layer, mrb_sdl2_video_layer_get_data(mrb, layer), renderer);
+  }
+  return mrb_fixnum_value(repainted);
+}
+
+void
+mruby_sdl2_video_layer_init(mrb_state *mrb)
+{
+  class_RenderLayer = mrb_define_class_under(mrb, mod_Video, "RenderLayer", mrb->object_class);
+  class_Compositor  = mrb_define_class_under(mrb, mod_Video, "Compositor",  mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_RenderLayer, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_RenderLayer, "initialize", mrb_sdl2_video_layer_initialize,   MRB_ARGS_REQ(3) | MRB_ARGS_BLOCK());
+  mrb_define_method(mrb, class_RenderLayer, "update",     mrb_sdl2_video_layer_update,       MRB_ARGS_REQ(1) | MRB_ARGS_BLOCK());
+  mrb_define_method(mrb, class_RenderLayer, "draw",       mrb_sdl2_video_layer_draw,         MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_RenderLayer, "invalidate", mrb_sdl2_video_layer_invalidate,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "dirty?",     mrb_sdl2_video_layer_is_dirty,     MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "visible?",   mrb_sdl2_video_layer_is_visible,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "visible=",   mrb_sdl2_video_layer_set_visible,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_RenderLayer, "x",          mrb_sdl2_video_layer_get_x,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "x=",         mrb_sdl2_video_layer_set_x,        MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_RenderLayer, "y",          mrb_sdl2_video_layer_get_y,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "y=",         mrb_sdl2_video_layer_set_y,        MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_RenderLayer, "width",      mrb_sdl2_video_layer_get_width,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "height",     mrb_sdl2_video_layer_get_height,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "repaints",   mrb_sdl2_video_layer_get_repaints, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderLayer, "texture",    mrb_sdl2_video_layer_get_texture,  MRB_ARGS_NONE());
+
+  mrb_define_method(mrb, class_Compositor, "initialize", mrb_sdl2_video_compositor_initialize, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Compositor, "add",        mrb_sdl2_video_compositor_add,        MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Compositor, "remove",     mrb_sdl2_video_compositor_remove,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_Compositor, "layers",     mrb_sdl2_video_compositor_get_layers, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Compositor, "invalidate", mrb_sdl2_video_compositor_invalidate, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_Compositor, "draw",       mrb_sdl2_video_compositor_draw,       MRB_ARGS_NONE());
+}
+
+void
+mruby_sdl2_video_layer_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,450 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_video_loader.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#else
+#include <SDL_render.h>
+#include <SDL_surface.h>
+#include <SDL_thread.h>
+#include <SDL_mutex.h>
+#endif
+
+static struct RClass *class_AssetLoader = NULL;
+
+/*
+ * Jobs move from `queue` (waiting for a worker) to `ready` (decoded,
+ * waiting for #pump on the main thread). Both are FIFO lists guarded by
+ * the mutex; a job being decoded belongs to its worker.
+ */
+typedef struct mrb_sdl2_video_loader_job_t {
+  struct mrb_sdl2_video_loader_job_t *next;
+  mrb_int      id;
+  char        *path;
+  SDL_Surface *surface; /* NULL when loading failed */
+  char        *error;
+} mrb_sdl2_video_loader_job_t;
+
+typedef struct mrb_sdl2_video_loader_list_t {
+  mrb_sdl2_video_loader_job_t *head;
+  mrb_sdl2_video_loader_job_t *tail;
+} mrb_sdl2_video_loader_list_t;
+
+typedef struct mrb_sdl2_video_loader_data_t {
+  uint32_t      format;
+  SDL_mutex    *mutex;
+  SDL_cond     *wakeup;
+  SDL_cond     *done;
+  bool          quit;
+  int           nthreads;
+  SDL_Thread  **threads;
+  mrb_sdl2_video_loader_list_t queue;
+  mrb_sdl2_video_loader_list_t ready;
+  mrb_int       busy;
+  mrb_int       next_id;
+  mrb_int       pending;  /* loaded but not yet returned by #pump */
+  mrb_int       uploaded;
+  mrb_int       failed;
+} mrb_sdl2_video_loader_data_t;
+
+static void
+mrb_sdl2_video_loader_list_push(mrb_sdl2_video_loader_list_t *list, mrb_sdl2_video_loader_job_t *job)
+{
+  job->next = NULL;
+  if (NULL == list->tail) {
+    list->head = job;
+  } else {
+    list->tail->next = job;
+  }
+  list->tail = job;
+}
+
+static mrb_sdl2_video_loader_job_t *
+mrb_sdl2_video_loader_list_shift(mrb_sdl2_video_loader_list_t *list)
+{
+  mrb_sdl2_video_loader_job_t *job = list->head;
+  if (NULL != job) {
+    list->head = job->next;
+    if (NULL == list->head) {
+      list->tail = NULL;
+    }
+  }
+  return job;
+}
+
+static void
+mrb_sdl2_video_loader_job_free(mrb_sdl2_video_loader_job_t *job)
+{
+  if (NULL != job->surface) {
+    SDL_FreeSurface(job->surface);
+  }
+  SDL_free(job->path);
+  SDL_free(job->error);
+  SDL_free(job);
+}
+
+static int
+mrb_sdl2_video_loader_worker(void *arg)
+{
+  mrb_sdl2_video_loader_data_t *data = (mrb_sdl2_video_loader_data_t*)arg;
+  SDL_LockMutex(data->mutex);
+  for (;;) {
+    mrb_sdl2_video_loader_job_t *job;
+    SDL_Surface *loaded;
+    while (!data->quit && (NULL == data->queue.head)) {
+      SDL_CondWait(data->wakeup, data->mutex);
+    }
+    if (data->quit) {
+      break;
+    }
+    job = mrb_sdl2_video_loader_list_shift(&data->queue);
+    ++data->busy;
+    SDL_UnlockMutex(data->mutex);
+
+    /* SDL keeps the error message per thread */
+    loaded = SDL_LoadBMP(job->path);
+    if (NULL != loaded) {
+      job->surface = SDL_ConvertSurfaceFormat(loaded, data->format, 0);
+      SDL_FreeSurface(loaded);
+    }
+    if (NULL == job->surface) {
+      job->error = SDL_strdup(SDL_GetError());
+    }
+
+    SDL_LockMutex(data->mutex);
+    mrb_sdl2_video_loader_list_push(&data->ready, job);
+    --data->busy;
+    SDL_CondBroadcast(data->done);
+  }
+  SDL_UnlockMutex(data->mutex);
+  return 0;
+}
+
+/* Stops the workers after their current file and drops unfinished jobs. */
+static void
+mrb_sdl2_video_loader_close(mrb_state *mrb, mrb_sdl2_video_loader_data_t *data)
+{
+  mrb_sdl2_video_loader_job_t *job;
+  int i;
+  if (NULL != data->threads) {
+    SDL_LockMutex(data->mutex);
+    data->quit = true;
+    SDL_CondBroadcast(data->wakeup);
+    SDL_UnlockMutex(data->mutex);
+    for (i = 0; i < data->nthreads; ++i) {
+      if (NULL != data->threads[i]) {
+        SDL_WaitThread(data->threads[i], NULL);
+      }
+    }
+    mrb_free(mrb, data->threads);
+    data->threads = NULL;
+  }
+  while (NULL != (job = mrb_sdl2_video_loader_list_shift(&data->queue))) {
+    mrb_sdl2_video_loader_job_free(job);
+  }
+  while (NULL != (job = mrb_sdl2_video_loader_list_shift(&data->ready))) {
+    mrb_sdl2_video_loader_job_free(job);
+  }
+  data->pending = 0;
+  if (NULL != data->done) {
+    SDL_DestroyCond(data->done);
+    data->done = NULL;
+  }
+  if (NULL != data->wakeup) {
+    SDL_DestroyCond(data->wakeup);
+    data->wakeup = NULL;
+  }
+  if (NULL != data->mutex) {
+    SDL_DestroyMutex(data->mutex);
+    data->mutex = NULL;
+  }
+}
+
+static void
+mrb_sdl2_video_loader_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_loader_data_t *data =
+    (mrb_sdl2_video_loader_data_t*)p;
+  if (NULL != data) {
+    mrb_sdl2_video_loader_close(mrb, data);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_loader_data_type = {
+  "AssetLoader", mrb_sdl2_video_loader_data_free
+};
+
+static mrb_sdl2_video_loader_data_t *
+mrb_sdl2_video_loader_get_data(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_loader_data_t *data =
+    (mrb_sdl2_video_loader_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_loader_data_type);
+  if (NULL == data->threads) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "asset loader is already closed.");
+  }
+  return data;
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::AssetLoader
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::AssetLoader.new(renderer, threads = 2)
+ *
+ * Starts `threads` workers that load BMP files and convert them to the
+ * renderer's preferred texture format, so that #pump only has to upload.
+ */
+static mrb_value
+mrb_sdl2_video_loader_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer;
+  mrb_int nthreads = 2;
+  SDL_RendererInfo info;
+  int i;
+  mrb_sdl2_video_loader_data_t *data =
+    (mrb_sdl2_video_loader_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "o|i", &renderer, &nthreads);
+  if ((nthreads <= 0) || (nthreads > 64)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "threads must be between 1 and 64.");
+  }
+  if (0 != SDL_GetRendererInfo(mrb_sdl2_video_renderer_get_ptr(mrb, renderer), &info)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  if (NULL != data) {
+    mrb_sdl2_video_loader_data_free(mrb, data);
+    DATA_PTR(self) = NULL;
+  }
+  data = (mrb_sdl2_video_loader_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_loader_data_t));
+  if (NULL == data) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+  SDL_memset(data, 0, sizeof(*data));
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_loader_data_type;
+
+  data->format   = SDL_PIXELFORMAT_ARGB8888;
+  if ((0 < info.num_texture_formats) && !SDL_ISPIXELFORMAT_FOURCC(info.texture_formats[0])) {
+    data->format = info.texture_formats[0];
+  }
+  data->mutex    = SDL_CreateMutex();
+  data->wakeup   = SDL_CreateCond();
+  data->done     = SDL_CreateCond();
+  if ((NULL == data->mutex) || (NULL == data->wakeup) || (NULL == data->done)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  data->threads = (SDL_Thread**)mrb_calloc(mrb, (size_t)nthreads, sizeof(SDL_Thread*));
+  data->nthreads = (int)nthreads;
+  for (i = 0; i < data->nthreads; ++i) {
+    data->threads[i] = SDL_CreateThread(mrb_sdl2_video_loader_worker, "AssetLoader", data);
+    if (NULL == data->threads[i]) {
+      mruby_sdl2_raise_error(mrb);
+    }
+  }
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), renderer);
+  return self;
+}
+
+/*
+ * SDL2::Video::AssetLoader#load(path)
+ *
+ * Queues a BMP file and returns an id that #pump reports it under.
+ */
+static mrb_value
+mrb_sdl2_video_loader_load(mrb_state *mrb, mrb_value self)
+{
+  mrb_value path;
+  mrb_sdl2_video_loader_job_t *job;
+  mrb_sdl2_video_loader_data_t *data = mrb_sdl2_video_loader_get_data(mrb, self);
+  mrb_get_args(mrb, "S", &path);
+  job = (mrb_sdl2_video_loader_job_t*)SDL_calloc(1, sizeof(mrb_sdl2_video_loader_job_t));
+  if (NULL == job) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+  job->path = SDL_strdup(mrb_string_value_cstr(mrb, &path));
+  if (NULL == job->path) {
+    SDL_free(job);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+  }
+  job->id = data->next_id++;
+  SDL_LockMutex(data->mutex);
+  mrb_sdl2_video_loader_list_push(&data->queue, job);
+  ++data->pending;
+  SDL_CondSignal(data->wakeup);
+  SDL_UnlockMutex(data->mutex);
+  return mrb_fixnum_value(job->id);
+}
+
+/*
+ * SDL2::Video::AssetLoader#pump(byte_budget = 0) { |id, texture, error| ... }
+ *
+ * Uploads decoded files as textures, in the order they finished, until
+ * `byte_budget` bytes of pixels were uploaded (0 means no limit). At least
+ * one file is uploaded per call so that large ones still make progress.
+ * Failed files yield a nil texture and the SDL error message. Returns an
+ * array of [id, texture, error] for the files handled by this call.
+ */
+static mrb_value
+mrb_sdl2_video_loader_pump(mrb_state *mrb, mrb_value self)
+{
+  mrb_int budget = 0;
+  mrb_value block = mrb_nil_value();
+  mrb_value results = mrb_ary_new(mrb);
+  size_t bytes = 0;
+  int const arena = mrb_gc_arena_save(mrb);
+  mrb_sdl2_video_loader_data_t *data = mrb_sdl2_video_loader_get_data(mrb, self);
+  mrb_value const renderer_value = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__renderer__"));
+  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, renderer_value);
+  mrb_get_args(mrb, "|i&", &budget, &block);
+  /* decoded files stay queued until the loader is pumped with a live renderer */
+  if (NULL == renderer) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "renderer is already destroyed.");
+  }
+  for (;;) {
+    mrb_sdl2_video_loader_job_t *job;
+    mrb_value entry[3];
+    SDL_Texture *texture = NULL;
+    if ((0 < budget) && ((size_t)budget <= bytes)) {
+      break;
+    }
+    SDL_LockMutex(data->mutex);
+    job = mrb_sdl2_video_loader_list_shift(&data->ready);
+    if (NULL != job) {
+      --data->pending;
+    }
+    SDL_UnlockMutex(data->mutex);
+    if (NULL == job) {
+      break;
+    }
+    entry[0] = mrb_fixnum_value(job->id);
+    entry[1] = mrb_nil_value();
+    entry[2] = mrb_nil_value();
+    if (NULL != job->surface) {
+      texture = SDL_CreateTextureFromSurface(renderer, job->surface);
+      if (NULL == texture) {
+        entry[2] = mrb_str_new_cstr(mrb, SDL_GetError());
+      } else {
+        entry[1] = mrb_sdl2_video_renderer_texture(mrb, renderer_value, texture);
+        bytes += (size_t)job->surface->h * job->surface->pitch;
+      }
+    } else {
+      entry[2] = mrb_str_new_cstr(mrb, (NULL != job->error) ? job->error : "could not load file.");
+    }
+    if (NULL == texture) {
+      ++data->failed;
+    } else {
+      ++data->uploaded;
+    }
+    mrb_sdl2_video_loader_job_free(job);
+    mrb_ary_push(mrb, results, mrb_ary_new_from_values(mrb, 3, entry));
+    mrb_gc_arena_restore(mrb, arena);
+  }
+  if (!mrb_nil_p(block)) {
+    mrb_int i;
+    for (i = 0; i < RARRAY_LEN(results); ++i) {
+      mrb_value const entry = RARRAY_PTR(results)[i];
+      mrb_yield_argv(mrb, block, 3, RARRAY_PTR(entry));
+    }
+  }
+  return results;
+}
+
+/*
+ * SDL2::Video::AssetLoader#wait
+ *
+ * Blocks until every queued file has been decoded (not uploaded).
+ */
+static mrb_value
+mrb_sdl2_video_loader_wait(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_loader_data_t *data = mrb_sdl2_video_loader_get_data(mrb, self);
+  SDL_LockMutex(data->mutex);
+  while ((NULL != data->queue.head) || (0 < data->busy)) {
+    SDL_CondWait(data->done, data->mutex);
+  }
+  SDL_UnlockMutex(data->mutex);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_loader_close_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_loader_data_t *data =
+    (mrb_sdl2_video_loader_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_loader_data_type);
+  mrb_sdl2_video_loader_close(mrb, data);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__renderer__"), mrb_nil_value());
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_loader_is_closed(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_loader_data_t *data =
+    (mrb_sdl2_video_loader_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_loader_data_type);
+  return mrb_bool_value(NULL == data->threads);
+}
+
+static mrb_value
+mrb_sdl2_video_loader_get_format(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_loader_get_data(mrb, self)->format);
+}
+
+static mrb_value
+mrb_sdl2_video_loader_get_pending(mrb_state *mrb, mrb_value self)
+{
+  mrb_int value;
+  mrb_sdl2_video_loader_data_t *data = mrb_sdl2_video_loader_get_data(mrb, self);
+  SDL_LockMutex(data->mutex);
+  value = data->pending;
+  SDL_UnlockMutex(data->mutex);
+  return mrb_fixnum_value(value);
+}
+
+static mrb_value
+mrb_sdl2_video_loader_get_uploaded(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_loader_get_data(mrb, self)->uploaded);
+}
+
+static mrb_value
+mrb_sdl2_video_loader_get_failed(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_loader_get_data(mrb, self)->failed);
+}
+
+void
+mruby_sdl2_video_loader_init(mrb_state *mrb)
+{
+  class_AssetLoader = mrb_define_class_under(mrb, mod_Video, "AssetLoader", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_AssetLoader, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_AssetLoader, "initialize", mrb_sdl2_video_loader_initialize,   MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_AssetLoader, "load",       mrb_sdl2_video_loader_load,         MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_AssetLoader, "pump",       mrb_sdl2_video_loader_pump,         MRB_ARGS_OPT(1) | MRB_ARGS_BLOCK());
+  mrb_define_method(mrb, class_AssetLoader, "wait",       mrb_sdl2_video_loader_wait,         MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_AssetLoader, "close",      mrb_sdl2_video_loader_close_m,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_AssetLoader, "closed?",    mrb_sdl2_video_loader_is_closed,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_AssetLoader, "format",     mrb_sdl2_video_loader_get_format,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_AssetLoader, "pending",    mrb_sdl2_video_loader_get_pending,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_AssetLoader, "uploaded",   mrb_sdl2_video_loader_get_uploaded, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_AssetLoader, "failed",     mrb_sdl2_video_loader_get_failed,   MRB_ARGS_NONE());
+}
+
+void
+mruby_sdl2_video_loader_final(mrb_state *mrb)
+{
+}
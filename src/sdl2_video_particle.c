@@ -0,0 +1,515 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_video_particle.h"
+#include "misc.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#else
+#include <SDL_render.h>
+#endif
+
+static struct RClass *class_ParticleEmitter = NULL;
+
+/*
+ * Particle state is kept as one array per attribute so that the update
+ * loops run over contiguous floats. Live particles occupy [0, count);
+ * dead ones are swapped out with the last live particle.
+ */
+typedef struct mrb_sdl2_video_particle_data_t {
+  mrb_int   capacity;
+  mrb_int   count;
+  float    *x, *y;
+  float    *vx, *vy;
+  float    *life;
+  SDL_Rect *rects;
+  /* emission parameters */
+  float     origin_x, origin_y;
+  float     min_vx, max_vx, min_vy, max_vy;
+  float     min_life, max_life;
+  float     gravity_x, gravity_y;
+  int       size;
+  SDL_Color color;
+  uint32_t  seed;
+} mrb_sdl2_video_particle_data_t;
+
+static void
+mrb_sdl2_video_particle_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_particle_data_t *data =
+    (mrb_sdl2_video_particle_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->x);
+    mrb_free(mrb, data->rects);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_particle_data_type = {
+  "ParticleEmitter", mrb_sdl2_video_particle_data_free
+};
+
+static mrb_sdl2_video_particle_data_t *
+mrb_sdl2_video_particle_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_video_particle_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_particle_data_type);
+}
+
+/* xorshift32, mapped to [lo, hi) */
+static float
+mrb_sdl2_video_particle_random(mrb_sdl2_video_particle_data_t *data, float lo, float hi)
+{
+  uint32_t s = data->seed;
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  data->seed = s;
+  return lo + (hi - lo) * (float)(s >> 8) * (1.0f / 16777216.0f);
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::ParticleEmitter
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::ParticleEmitter.new(capacity)
+ */
+static mrb_value
+mrb_sdl2_video_particle_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_int capacity;
+  float *block;
+  mrb_sdl2_video_particle_data_t *data =
+    (mrb_sdl2_video_particle_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "i", &capacity);
+  if ((capacity <= 0) || (capacity > (mrb_int)(SDL_MAX_SINT32 / (5 * sizeof(float))))) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "capacity is out of range.");
+  }
+  if (NULL == data) {
+    data = (mrb_sdl2_video_particle_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_particle_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+  } else {
+    mrb_free(mrb, data->x);
+    mrb_free(mrb, data->rects);
+  }
+  SDL_memset(data, 0, sizeof(*data));
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_particle_data_type;
+  block = (float*)mrb_malloc(mrb, sizeof(float) * 5 * capacity);
+  data->x     = block;
+  data->y     = block + capacity;
+  data->vx    = block + capacity * 2;
+  data->vy    = block + capacity * 3;
+  data->life  = block + capacity * 4;
+  data->rects = (SDL_Rect*)mrb_malloc(mrb, sizeof(SDL_Rect) * capacity);
+  data->capacity = capacity;
+  data->min_vx   = -1.0f;
+  data->max_vx   = 1.0f;
+  data->min_vy   = -1.0f;
+  data->max_vy   = 1.0f;
+  data->min_life = 1.0f;
+  data->max_life = 1.0f;
+  data->size     = 1;
+  data->color    = (SDL_Color){ 255, 255, 255, 255 };
+  data->seed     = 0x9e3779b9u;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_get_capacity(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_particle_get_data(mrb, self)->capacity);
+}
+
+static mrb_value
+mrb_sdl2_video_particle_get_count(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_particle_get_data(mrb, self)->count);
+}
+
+static mrb_value
+mrb_sdl2_video_particle_clear(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_particle_get_data(mrb, self)->count = 0;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_set_position(mrb_state *mrb, mrb_value self)
+{
+  mrb_float x, y;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "ff", &x, &y);
+  data->origin_x = (float)x;
+  data->origin_y = (float)y;
+  return self;
+}
+
+/*
+ * SDL2::Video::ParticleEmitter#set_velocity(min_vx, max_vx, min_vy, max_vy)
+ *
+ * New particles get a velocity drawn uniformly from these ranges, in
+ * pixels per second.
+ */
+static mrb_value
+mrb_sdl2_video_particle_set_velocity(mrb_state *mrb, mrb_value self)
+{
+  mrb_float min_vx, max_vx, min_vy, max_vy;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "ffff", &min_vx, &max_vx, &min_vy, &max_vy);
+  data->min_vx = (float)min_vx;
+  data->max_vx = (float)max_vx;
+  data->min_vy = (float)min_vy;
+  data->max_vy = (float)max_vy;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_set_lifetime(mrb_state *mrb, mrb_value self)
+{
+  mrb_float min_life, max_life;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "ff", &min_life, &max_life);
+  if ((min_life <= 0) || (max_life < min_life)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid lifetime range.");
+  }
+  data->min_life = (float)min_life;
+  data->max_life = (float)max_life;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_set_gravity(mrb_state *mrb, mrb_value self)
+{
+  mrb_float x, y;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "ff", &x, &y);
+  data->gravity_x = (float)x;
+  data->gravity_y = (float)y;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_set_color(mrb_state *mrb, mrb_value self)
+{
+  mrb_int r, g, b, a = 255;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "iii|i", &r, &g, &b, &a);
+  data->color = (SDL_Color){ (Uint8)r, (Uint8)g, (Uint8)b, (Uint8)a };
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_get_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_particle_get_data(mrb, self)->size);
+}
+
+static mrb_value
+mrb_sdl2_video_particle_set_size(mrb_state *mrb, mrb_value self)
+{
+  mrb_int size;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &size);
+  if (size <= 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "size must be positive.");
+  }
+  data->size = (int)size;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_get_texture(mrb_state *mrb, mrb_value self)
+{
+  return mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__texture__"));
+}
+
+/*
+ * SDL2::Video::ParticleEmitter#texture=(texture)
+ *
+ * With a texture, every particle is drawn as a size x size copy of it,
+ * modulated by the emitter color. With nil, particles are filled rects.
+ */
+static mrb_value
+mrb_sdl2_video_particle_set_texture(mrb_state *mrb, mrb_value self)
+{
+  mrb_value texture;
+  mrb_get_args(mrb, "o", &texture);
+  /* type check only, the pointer is read again at each render */
+  mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__texture__"), texture);
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_particle_set_seed(mrb_state *mrb, mrb_value self)
+{
+  mrb_int seed;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &seed);
+  /* xorshift never leaves the all-zero state */
+  data->seed = (0 == (uint32_t)seed) ? 0x9e3779b9u : (uint32_t)seed;
+  return self;
+}
+
+/*
+ * SDL2::Video::ParticleEmitter#emit(count)
+ *
+ * Spawns up to `count` particles at the emitter position and returns how
+ * many fit into the remaining capacity.
+ */
+static mrb_value
+mrb_sdl2_video_particle_emit(mrb_state *mrb, mrb_value self)
+{
+  mrb_int n, i, end;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &n);
+  if (n < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "count must not be negative.");
+  }
+  if (n > data->capacity - data->count) {
+    n = data->capacity - data->count;
+  }
+  end = data->count + n;
+  for (i = data->count; i < end; ++i) {
+    data->x[i]    = data->origin_x;
+    data->y[i]    = data->origin_y;
+    data->vx[i]   = mrb_sdl2_video_particle_random(data, data->min_vx, data->max_vx);
+    data->vy[i]   = mrb_sdl2_video_particle_random(data, data->min_vy, data->max_vy);
+    data->life[i] = mrb_sdl2_video_particle_random(data, data->min_life, data->max_life);
+  }
+  data->count = end;
+  return mrb_fixnum_value(n);
+}
+
+/*
+ * SDL2::Video::ParticleEmitter#update(seconds)
+ *
+ * Advances every particle by `seconds`, drops expired ones and returns the
+ * number still alive.
+ */
+static mrb_value
+mrb_sdl2_video_particle_update(mrb_state *mrb, mrb_value self)
+{
+  mrb_float seconds;
+  mrb_int i, n;
+  float dt;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  float *restrict x    = data->x;
+  float *restrict y    = data->y;
+  float *restrict vx   = data->vx;
+  float *restrict vy   = data->vy;
+  float *restrict life = data->life;
+  mrb_get_args(mrb, "f", &seconds);
+  dt = (float)seconds;
+  n = data->count;
+
+  /* branch-free loops over contiguous arrays; the compiler vectorizes these */
+  {
+    float const gx = data->gravity_x * dt;
+    float const gy = data->gravity_y * dt;
+    for (i = 0; i < n; ++i) {
+      vx[i] += gx;
+      vy[i] += gy;
+    }
+    for (i = 0; i < n; ++i) {
+      x[i] += vx[i] * dt;
+      y[i] += vy[i] * dt;
+      life[i] -= dt;
+    }
+  }
+
+  for (i = 0; i < n; ) {
+    if (life[i] > 0.0f) {
+      ++i;
+      continue;
+    }
+    --n;
+    x[i]    = x[n];
+    y[i]    = y[n];
+    vx[i]   = vx[n];
+    vy[i]   = vy[n];
+    life[i] = life[n];
+  }
+  data->count = n;
+  return mrb_fixnum_value(n);
+}
+
+/*
+ * The texture set by #texture=, read from the instance variable at every
+ * render so a Texture destroyed since then raises instead of reaching SDL
+ * as a dangling pointer. NULL when particles are drawn as rects.
+ */
+static SDL_Texture *
+mrb_sdl2_video_particle_texture(mrb_state *mrb, mrb_value self)
+{
+  mrb_value const texture = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__texture__"));
+  SDL_Texture *t;
+  if (mrb_nil_p(texture)) {
+    return NULL;
+  }
+  t = mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  if (NULL == t) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "texture is already destroyed.");
+  }
+  return t;
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+/*
+ * Two textured triangles per particle rect, colored with the emitter
+ * color, for a single SDL_RenderGeometry call. Vertices and indices share
+ * one scratch allocation; the indices follow the 4 * n vertices.
+ */
+static SDL_Vertex *
+mrb_sdl2_video_particle_quads(mrb_state *mrb, mrb_sdl2_video_particle_data_t const *data, mrb_int n)
+{
+  SDL_Vertex *vertices = (SDL_Vertex *)mrb_sdl2_scratch_alloc(mrb, (sizeof(SDL_Vertex) * 4 + sizeof(int) * 6) * (size_t)n);
+  int *indices = (int *)(vertices + 4 * n);
+  mrb_int i;
+  for (i = 0; i < n; ++i) {
+    SDL_Rect const *r = &data->rects[i];
+    SDL_Vertex *v = &vertices[i * 4];
+    int *index = &indices[i * 6];
+    int const base = (int)(i * 4);
+    v[0].position = (SDL_FPoint){ (float)r->x,          (float)r->y };
+    v[1].position = (SDL_FPoint){ (float)(r->x + r->w), (float)r->y };
+    v[2].position = (SDL_FPoint){ (float)(r->x + r->w), (float)(r->y + r->h) };
+    v[3].position = (SDL_FPoint){ (float)r->x,          (float)(r->y + r->h) };
+    v[0].tex_coord = (SDL_FPoint){ 0.0f, 0.0f };
+    v[1].tex_coord = (SDL_FPoint){ 1.0f, 0.0f };
+    v[2].tex_coord = (SDL_FPoint){ 1.0f, 1.0f };
+    v[3].tex_coord = (SDL_FPoint){ 0.0f, 1.0f };
+    v[0].color = v[1].color = v[2].color = v[3].color = data->color;
+    index[0] = base;
+    index[1] = base + 1;
+    index[2] = base + 2;
+    index[3] = base;
+    index[4] = base + 2;
+    index[5] = base + 3;
+  }
+  return vertices;
+}
+#endif
+
+/*
+ * SDL2::Video::ParticleEmitter#render(renderer)
+ *
+ * Without a texture all live particles go out in one SDL_RenderFillRects
+ * call; with one, in one SDL_RenderGeometry call where SDL has it (2.0.18)
+ * and one copy each otherwise. The emitter sets the draw color or texture
+ * modulation itself and restores it afterwards.
+ */
+static mrb_value
+mrb_sdl2_video_particle_render(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer_value;
+  SDL_Renderer *renderer;
+  SDL_Texture *texture;
+  mrb_int i, n;
+  int result = 0;
+  mrb_sdl2_video_particle_data_t *data = mrb_sdl2_video_particle_get_data(mrb, self);
+  float const half = data->size * 0.5f;
+  int const size = data->size;
+  mrb_get_args(mrb, "o", &renderer_value);
+  texture = mrb_sdl2_video_particle_texture(mrb, self);
+  renderer = mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer_value, "ParticleEmitter#render cannot be recorded.");
+  n = data->count;
+  if (0 == n) {
+    return self;
+  }
+  for (i = 0; i < n; ++i) {
+    data->rects[i].x = (int)(data->x[i] - half);
+    data->rects[i].y = (int)(data->y[i] - half);
+    data->rects[i].w = size;
+    data->rects[i].h = size;
+  }
+  if (NULL == texture) {
+    result = SDL_SetRenderDrawColor(renderer, data->color.r, data->color.g, data->color.b, data->color.a);
+    if (0 == result) {
+      result = SDL_RenderFillRects(renderer, data->rects, (int)n);
+    }
+    /* the draw color was changed behind the renderer's state cache */
+    mrb_sdl2_video_renderer_restore_state(mrb, renderer_value);
+  } else {
+    /* the texture may be shared, give its modulation back afterwards */
+    uint8_t r, g, b, a;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    mrb_sdl2_scratch_mark_t const mark = mrb_sdl2_scratch_mark();
+    SDL_Vertex const *vertices = mrb_sdl2_video_particle_quads(mrb, data, n);
+#endif
+    result = SDL_GetTextureColorMod(texture, &r, &g, &b);
+    if (0 == result) {
+      result = SDL_GetTextureAlphaMod(texture, &a);
+    }
+    if (0 != result) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+      mrb_sdl2_scratch_release(mark);
+#endif
+      mruby_sdl2_raise_error(mrb);
+    }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    /* the vertex colors carry the emitter color, keep the texture neutral */
+    result = SDL_SetTextureColorMod(texture, 255, 255, 255);
+    if (0 == result) {
+      result = SDL_SetTextureAlphaMod(texture, 255);
+    }
+    if (0 == result) {
+      result = SDL_RenderGeometry(renderer, texture, vertices, (int)(n * 4), (int const *)(vertices + n * 4), (int)(n * 6));
+    }
+    mrb_sdl2_scratch_release(mark);
+#else
+    result = SDL_SetTextureColorMod(texture, data->color.r, data->color.g, data->color.b);
+    if (0 == result) {
+      result = SDL_SetTextureAlphaMod(texture, data->color.a);
+    }
+    for (i = 0; (0 == result) && (i < n); ++i) {
+      result = SDL_RenderCopy(renderer, texture, NULL, &data->rects[i]);
+    }
+#endif
+    SDL_SetTextureColorMod(texture, r, g, b);
+    SDL_SetTextureAlphaMod(texture, a);
+  }
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+void
+mruby_sdl2_video_particle_init(mrb_state *mrb)
+{
+  class_ParticleEmitter = mrb_define_class_under(mrb, mod_Video, "ParticleEmitter", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_ParticleEmitter, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_ParticleEmitter, "initialize",   mrb_sdl2_video_particle_initialize,   MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_ParticleEmitter, "capacity",     mrb_sdl2_video_particle_get_capacity, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_ParticleEmitter, "count",        mrb_sdl2_video_particle_get_count,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_ParticleEmitter, "clear",        mrb_sdl2_video_particle_clear,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_ParticleEmitter, "set_position", mrb_sdl2_video_particle_set_position, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_ParticleEmitter, "set_velocity", mrb_sdl2_video_particle_set_velocity, MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, class_ParticleEmitter, "set_lifetime", mrb_sdl2_video_particle_set_lifetime, MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_ParticleEmitter, "set_gravity",  mrb_sdl2_video_particle_set_gravity,  MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_ParticleEmitter, "set_color",    mrb_sdl2_video_particle_set_color,    MRB_ARGS_REQ(3) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_ParticleEmitter, "size",         mrb_sdl2_video_particle_get_size,     MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_ParticleEmitter, "size=",        mrb_sdl2_video_particle_set_size,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_ParticleEmitter, "texture",      mrb_sdl2_video_particle_get_texture,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_ParticleEmitter, "texture=",     mrb_sdl2_video_particle_set_texture,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_ParticleEmitter, "seed=",        mrb_sdl2_video_particle_set_seed,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_ParticleEmitter, "emit",         mrb_sdl2_video_particle_emit,         MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_ParticleEmitter, "update",       mrb_sdl2_video_particle_update,       MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_ParticleEmitter, "render",       mrb_sdl2_video_particle_render,       MRB_ARGS_REQ(1));
+}
+
+void
+mruby_sdl2_video_particle_final(mrb_state *mrb)
+{
+}
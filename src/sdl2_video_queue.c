@@ -0,0 +1,403 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_rect.h"
+#include "sdl2_video_queue.h"
+#include "misc.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#else
+#include <SDL_render.h>
+#endif
+
+static struct RClass *class_RenderQueue = NULL;
+
+#define MRB_SDL2_QUEUE_HAS_SRC    0x01
+#define MRB_SDL2_QUEUE_HAS_DST    0x02
+#define MRB_SDL2_QUEUE_HAS_CENTER 0x04
+#define MRB_SDL2_QUEUE_EX         0x08
+
+/* texture slots are 16 bits wide in the sort key */
+#define MRB_SDL2_QUEUE_MAX_TEXTURES 0x10000
+/* key = biased layer (32 bits) << 16 | texture slot, sorted a byte at a time */
+#define MRB_SDL2_QUEUE_KEY_BYTES    6
+
+typedef struct mrb_sdl2_video_queue_entry_t {
+  SDL_Rect  src;
+  SDL_Rect  dst;
+  SDL_Point center;
+  double    angle;
+  uint16_t  slot;
+  uint8_t   flags;
+  uint8_t   flip;
+} mrb_sdl2_video_queue_entry_t;
+
+typedef struct mrb_sdl2_video_queue_key_t {
+  uint64_t key;
+  uint32_t index;
+} mrb_sdl2_video_queue_key_t;
+
+/*
+ * Entries are stored in push order next to their sort keys. Textures get
+ * a slot number the first time they are pushed; `table` is an open
+ * addressing hash from the Texture object to its slot (-1 when empty).
+ * Slots index `__textures__`, which keeps the objects alive; the SDL
+ * textures are only looked up at draw time, so one destroyed in between
+ * raises instead of being drawn.
+ */
+typedef struct mrb_sdl2_video_queue_data_t {
+  mrb_sdl2_video_queue_entry_t *entries;
+  mrb_sdl2_video_queue_key_t   *keys;
+  mrb_sdl2_video_queue_key_t   *tmp;
+  mrb_int       size;
+  mrb_int       capa;
+  void        **textures;
+  mrb_int       texture_count;
+  mrb_int       texture_capa;
+  int32_t      *table;
+  mrb_int       table_capa;
+} mrb_sdl2_video_queue_data_t;
+
+static void
+mrb_sdl2_video_queue_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_queue_data_t *data =
+    (mrb_sdl2_video_queue_data_t*)p;
+  if (NULL != data) {
+    mrb_free(mrb, data->entries);
+    mrb_free(mrb, data->keys);
+    mrb_free(mrb, data->tmp);
+    mrb_free(mrb, data->textures);
+    mrb_free(mrb, data->table);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_queue_data_type = {
+  "RenderQueue", mrb_sdl2_video_queue_data_free
+};
+
+static mrb_sdl2_video_queue_data_t *
+mrb_sdl2_video_queue_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_video_queue_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_queue_data_type);
+}
+
+static void
+mrb_sdl2_video_queue_reserve(mrb_state *mrb, mrb_sdl2_video_queue_data_t *data, mrb_int capa)
+{
+  if (capa <= data->capa) {
+    return;
+  }
+  data->entries = (mrb_sdl2_video_queue_entry_t*)mrb_realloc(mrb, data->entries, sizeof(mrb_sdl2_video_queue_entry_t) * capa);
+  data->keys    = (mrb_sdl2_video_queue_key_t*)mrb_realloc(mrb, data->keys, sizeof(mrb_sdl2_video_queue_key_t) * capa);
+  data->tmp     = (mrb_sdl2_video_queue_key_t*)mrb_realloc(mrb, data->tmp, sizeof(mrb_sdl2_video_queue_key_t) * capa);
+  data->capa    = capa;
+}
+
+static inline mrb_int
+mrb_sdl2_video_queue_hash(void const *texture, mrb_int mask)
+{
+  uintptr_t const p = (uintptr_t)texture;
+  return (mrb_int)(((uint32_t)(p >> 4) ^ (uint32_t)((uint64_t)p >> 36)) * 0x9e3779b1u >> 8) & mask;
+}
+
+static void
+mrb_sdl2_video_queue_rehash(mrb_state *mrb, mrb_sdl2_video_queue_data_t *data, mrb_int capa)
+{
+  mrb_int i;
+  data->table = (int32_t*)mrb_realloc(mrb, data->table, sizeof(int32_t) * capa);
+  data->table_capa = capa;
+  SDL_memset(data->table, 0xff, sizeof(int32_t) * capa);
+  for (i = 0; i < data->texture_count; ++i) {
+    mrb_int h = mrb_sdl2_video_queue_hash(data->textures[i], capa - 1);
+    while (data->table[h] >= 0) {
+      h = (h + 1) & (capa - 1);
+    }
+    data->table[h] = (int32_t)i;
+  }
+}
+
+/*
+ * Returns the slot of the texture, assigning the next one (and keeping
+ * the texture object referenced until the queue is drawn) when new.
+ */
+static uint16_t
+mrb_sdl2_video_queue_slot(mrb_state *mrb, mrb_value self, mrb_sdl2_video_queue_data_t *data, mrb_value texture)
+{
+  void *t;
+  mrb_sym const key = mrb_intern_lit(mrb, "__textures__");
+  mrb_value refs;
+  mrb_int h, mask;
+  /* type check; the object itself is the hash key */
+  mrb_sdl2_video_texture_get_ptr(mrb, texture);
+  t = mrb_ptr(texture);
+  if (data->table_capa < (data->texture_count + 1) * 2) {
+    mrb_sdl2_video_queue_rehash(mrb, data, (0 < data->table_capa) ? data->table_capa * 2 : 64);
+  }
+  mask = data->table_capa - 1;
+  for (h = mrb_sdl2_video_queue_hash(t, mask); data->table[h] >= 0; h = (h + 1) & mask) {
+    if (data->textures[data->table[h]] == t) {
+      return (uint16_t)data->table[h];
+    }
+  }
+  if (data->texture_count >= MRB_SDL2_QUEUE_MAX_TEXTURES) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "too many textures in one queue.");
+  }
+  if (data->texture_count >= data->texture_capa) {
+    data->texture_capa = (0 < data->texture_capa) ? data->texture_capa * 2 : 32;
+    data->textures = (void**)mrb_realloc(mrb, data->textures, sizeof(void*) * data->texture_capa);
+  }
+  data->textures[data->texture_count] = t;
+  data->table[h] = (int32_t)data->texture_count;
+  refs = mrb_iv_get(mrb, self, key);
+  if (mrb_nil_p(refs)) {
+    refs = mrb_ary_new(mrb);
+    mrb_iv_set(mrb, self, key, refs);
+  }
+  mrb_ary_push(mrb, refs, texture);
+  return (uint16_t)data->texture_count++;
+}
+
+static void
+mrb_sdl2_video_queue_reset(mrb_state *mrb, mrb_value self, mrb_sdl2_video_queue_data_t *data)
+{
+  mrb_value const refs = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__"));
+  data->size = 0;
+  data->texture_count = 0;
+  if (NULL != data->table) {
+    SDL_memset(data->table, 0xff, sizeof(int32_t) * data->table_capa);
+  }
+  if (!mrb_nil_p(refs)) {
+    mrb_ary_resize(mrb, refs, 0);
+  }
+}
+
+/*
+ * Stable LSD radix sort of the keys, one byte per pass. A single histogram
+ * pass counts every digit, and passes where all keys share the digit are
+ * skipped, so a queue using few layers and textures costs two or three
+ * scatters. Returns whichever buffer holds the result.
+ */
+static mrb_sdl2_video_queue_key_t *
+mrb_sdl2_video_queue_sort(mrb_sdl2_video_queue_key_t *keys, mrb_sdl2_video_queue_key_t *tmp, mrb_int n)
+{
+  uint32_t counts[MRB_SDL2_QUEUE_KEY_BYTES][256];
+  mrb_int i;
+  int pass;
+  SDL_memset(counts, 0, sizeof(counts));
+  for (i = 0; i < n; ++i) {
+    uint64_t const k = keys[i].key;
+    for (pass = 0; pass < MRB_SDL2_QUEUE_KEY_BYTES; ++pass) {
+      ++counts[pass][(k >> (pass * 8)) & 0xff];
+    }
+  }
+  for (pass = 0; pass < MRB_SDL2_QUEUE_KEY_BYTES; ++pass) {
+    uint32_t *count = counts[pass];
+    uint32_t offset = 0;
+    int const shift = pass * 8;
+    int d;
+    mrb_sdl2_video_queue_key_t *swap;
+    if (count[(keys[0].key >> shift) & 0xff] == (uint32_t)n) {
+      continue;
+    }
+    for (d = 0; d < 256; ++d) {
+      uint32_t const c = count[d];
+      count[d] = offset;
+      offset += c;
+    }
+    for (i = 0; i < n; ++i) {
+      tmp[count[(keys[i].key >> shift) & 0xff]++] = keys[i];
+    }
+    swap = keys;
+    keys = tmp;
+    tmp  = swap;
+  }
+  return keys;
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::RenderQueue
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::RenderQueue.new(capacity = 1024)
+ *
+ * The queue grows past `capacity` as needed; it only sizes the first
+ * allocation.
+ */
+static mrb_value
+mrb_sdl2_video_queue_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_int capacity = 1024;
+  mrb_sdl2_video_queue_data_t *data =
+    (mrb_sdl2_video_queue_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "|i", &capacity);
+  if ((capacity <= 0) || (capacity > (mrb_int)(SDL_MAX_SINT32 / sizeof(mrb_sdl2_video_queue_entry_t)))) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "capacity is out of range.");
+  }
+  if (NULL == data) {
+    data = (mrb_sdl2_video_queue_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_queue_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+    SDL_memset(data, 0, sizeof(*data));
+  }
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_queue_data_type;
+  mrb_sdl2_video_queue_reset(mrb, self, data);
+  mrb_sdl2_video_queue_reserve(mrb, data, capacity);
+  return self;
+}
+
+/*
+ * SDL2::Video::RenderQueue#push(layer, texture, src_rect, dst_rect, flip = 0, angle = 0.0, center = nil)
+ *
+ * Either rect may be nil, as for Renderer#copy. Entries with a flip,
+ * angle or center are drawn with SDL_RenderCopyEx.
+ */
+static mrb_value
+mrb_sdl2_video_queue_push(mrb_state *mrb, mrb_value self)
+{
+  mrb_int layer, flip = SDL_FLIP_NONE;
+  mrb_float angle = 0.0;
+  mrb_value texture, src_rect, dst_rect;
+  mrb_value center = mrb_nil_value();
+  SDL_Rect const *sr, *dr;
+  SDL_Point const *c;
+  mrb_sdl2_video_queue_entry_t *entry;
+  mrb_sdl2_video_queue_key_t *key;
+  mrb_sdl2_video_queue_data_t *data = mrb_sdl2_video_queue_get_data(mrb, self);
+  uint16_t slot;
+  mrb_get_args(mrb, "ioo|ifo", &layer, &texture, &src_rect, &dst_rect, &flip, &angle, &center);
+  if ((layer < (mrb_int)INT32_MIN) || (layer > (mrb_int)INT32_MAX)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "layer is out of range.");
+  }
+  sr = mrb_sdl2_rect_get_ptr(mrb, src_rect);
+  dr = mrb_sdl2_rect_get_ptr(mrb, dst_rect);
+  c  = mrb_sdl2_point_get_ptr(mrb, center);
+  slot = mrb_sdl2_video_queue_slot(mrb, self, data, texture);
+  if (data->size >= data->capa) {
+    mrb_sdl2_video_queue_reserve(mrb, data, data->capa * 2);
+  }
+  entry = &data->entries[data->size];
+  entry->slot  = slot;
+  entry->flags = 0;
+  entry->flip  = (uint8_t)flip;
+  entry->angle = (double)angle;
+  if (NULL != sr) {
+    entry->src = *sr;
+    entry->flags |= MRB_SDL2_QUEUE_HAS_SRC;
+  }
+  if (NULL != dr) {
+    entry->dst = *dr;
+    entry->flags |= MRB_SDL2_QUEUE_HAS_DST;
+  }
+  if (NULL != c) {
+    entry->center = *c;
+    entry->flags |= MRB_SDL2_QUEUE_HAS_CENTER;
+  }
+  if ((NULL != c) || (SDL_FLIP_NONE != flip) || (0.0 != angle)) {
+    entry->flags |= MRB_SDL2_QUEUE_EX;
+  }
+  key = &data->keys[data->size];
+  key->key   = ((uint64_t)((uint32_t)(int32_t)layer ^ 0x80000000u) << 16) | slot;
+  key->index = (uint32_t)data->size;
+  ++data->size;
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_queue_get_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_queue_get_data(mrb, self)->size);
+}
+
+static mrb_value
+mrb_sdl2_video_queue_clear(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_queue_reset(mrb, self, mrb_sdl2_video_queue_get_data(mrb, self));
+  return self;
+}
+
+/*
+ * SDL2::Video::RenderQueue#draw(renderer)
+ *
+ * Sorts the entries by layer, then by texture (in the order textures were
+ * first pushed), keeping push order among equal keys, copies them and
+ * empties the queue. Overlapping sprites on one layer are only drawn in
+ * push order when they share a texture.
+ */
+static mrb_value
+mrb_sdl2_video_queue_draw(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer_value, refs;
+  SDL_Renderer *renderer;
+  SDL_Texture **textures;
+  mrb_sdl2_video_queue_key_t const *sorted;
+  mrb_int i, n;
+  int result = 0;
+  mrb_sdl2_video_queue_data_t *data = mrb_sdl2_video_queue_get_data(mrb, self);
+  mrb_sdl2_scratch_mark_t mark;
+  mrb_get_args(mrb, "o", &renderer_value);
+  renderer = mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer_value, "RenderQueue#draw cannot be recorded.");
+  n = data->size;
+  if (0 == n) {
+    return self;
+  }
+  refs = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__textures__"));
+  mark = mrb_sdl2_scratch_mark();
+  textures = (SDL_Texture**)mrb_sdl2_scratch_alloc(mrb, sizeof(SDL_Texture*) * data->texture_count);
+  for (i = 0; i < data->texture_count; ++i) {
+    textures[i] = mrb_sdl2_video_texture_get_ptr(mrb, mrb_ary_ref(mrb, refs, i));
+    if (NULL == textures[i]) {
+      mrb_sdl2_scratch_release(mark);
+      mrb_raise(mrb, E_RUNTIME_ERROR, "texture is already destroyed.");
+    }
+  }
+  sorted = mrb_sdl2_video_queue_sort(data->keys, data->tmp, n);
+  for (i = 0; (0 == result) && (i < n); ++i) {
+    mrb_sdl2_video_queue_entry_t const *e = &data->entries[sorted[i].index];
+    SDL_Texture *t = textures[e->slot];
+    SDL_Rect const *sr = (e->flags & MRB_SDL2_QUEUE_HAS_SRC) ? &e->src : NULL;
+    SDL_Rect const *dr = (e->flags & MRB_SDL2_QUEUE_HAS_DST) ? &e->dst : NULL;
+    if (e->flags & MRB_SDL2_QUEUE_EX) {
+      result = SDL_RenderCopyEx(renderer, t, sr, dr, e->angle,
+                                (e->flags & MRB_SDL2_QUEUE_HAS_CENTER) ? &e->center : NULL,
+                                (SDL_RendererFlip)e->flip);
+    } else {
+      result = SDL_RenderCopy(renderer, t, sr, dr);
+    }
+  }
+  mrb_sdl2_scratch_release(mark);
+  mrb_sdl2_video_queue_reset(mrb, self, data);
+  if (0 != result) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return self;
+}
+
+void
+mruby_sdl2_video_queue_init(mrb_state *mrb)
+{
+  class_RenderQueue = mrb_define_class_under(mrb, mod_Video, "RenderQueue", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_RenderQueue, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_RenderQueue, "initialize", mrb_sdl2_video_queue_initialize, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, class_RenderQueue, "push",       mrb_sdl2_video_queue_push,       MRB_ARGS_REQ(4) | MRB_ARGS_OPT(3));
+  mrb_define_method(mrb, class_RenderQueue, "size",       mrb_sdl2_video_queue_get_size,   MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderQueue, "clear",      mrb_sdl2_video_queue_clear,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_RenderQueue, "draw",       mrb_sdl2_video_queue_draw,       MRB_ARGS_REQ(1));
+}
+
+void
+mruby_sdl2_video_queue_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,487 @@
+#include "sdl2.h"
+#include "sdl2_video.h"
+#include "sdl2_render.h"
+#include "sdl2_video_tilemap.h"
+#include "misc.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/variable.h"
+#ifdef __APPLE__
+#include <SDL2/SDL_render.h>
+#else
+#include <SDL_render.h>
+#endif
+
+static struct RClass *class_TileLayer = NULL;
+
+/*
+ * Tiles are 16-bit ids in row-major order. 0 is an empty cell, id n is the
+ * (n - 1)th tile of the tileset, counted left to right, top to bottom.
+ */
+typedef struct mrb_sdl2_video_tilemap_data_t {
+  uint16_t     *tiles;
+  int           map_w, map_h;
+  int           tile_w, tile_h;
+  int           columns;
+  /* chunk cache: chunk_size x chunk_size tiles per render target */
+  int           chunk_size;
+  int           chunks_x, chunks_y;
+  SDL_Renderer *chunk_renderer;
+  SDL_Texture **chunks;
+  uint8_t      *dirty;
+} mrb_sdl2_video_tilemap_data_t;
+
+static void
+mrb_sdl2_video_tilemap_free_chunks(mrb_state *mrb, mrb_sdl2_video_tilemap_data_t *data)
+{
+  mrb_free(mrb, data->chunks);
+  mrb_free(mrb, data->dirty);
+  data->chunks = NULL;
+  data->dirty  = NULL;
+  data->chunks_x = data->chunks_y = 0;
+  data->chunk_renderer = NULL;
+}
+
+static void
+mrb_sdl2_video_tilemap_data_free(mrb_state *mrb, void *p)
+{
+  mrb_sdl2_video_tilemap_data_t *data =
+    (mrb_sdl2_video_tilemap_data_t*)p;
+  if (NULL != data) {
+    mrb_sdl2_video_tilemap_free_chunks(mrb, data);
+    mrb_free(mrb, data->tiles);
+    mrb_free(mrb, data);
+  }
+}
+
+static struct mrb_data_type const mrb_sdl2_video_tilemap_data_type = {
+  "TileLayer", mrb_sdl2_video_tilemap_data_free
+};
+
+static mrb_sdl2_video_tilemap_data_t *
+mrb_sdl2_video_tilemap_get_data(mrb_state *mrb, mrb_value self)
+{
+  return (mrb_sdl2_video_tilemap_data_t*)mrb_data_get_ptr(mrb, self, &mrb_sdl2_video_tilemap_data_type);
+}
+
+/*
+ * Drops the cached chunk textures. They are owned by Texture objects in
+ * an instance variable, so the GC destroys them.
+ */
+static void
+mrb_sdl2_video_tilemap_drop_chunks(mrb_state *mrb, mrb_value self, mrb_sdl2_video_tilemap_data_t *data)
+{
+  mrb_sdl2_video_tilemap_free_chunks(mrb, data);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__chunks__"), mrb_nil_value());
+}
+
+static void
+mrb_sdl2_video_tilemap_mark_dirty(mrb_sdl2_video_tilemap_data_t *data, int x, int y)
+{
+  if (NULL != data->dirty) {
+    data->dirty[(y / data->chunk_size) * data->chunks_x + (x / data->chunk_size)] = 1;
+  }
+}
+
+/*
+ * The tileset texture, read from the instance variable on every draw so a
+ * Texture destroyed since TileLayer.new raises instead of reaching SDL as
+ * a dangling pointer.
+ */
+static SDL_Texture *
+mrb_sdl2_video_tilemap_tileset(mrb_state *mrb, mrb_value self)
+{
+  SDL_Texture *tileset = mrb_sdl2_video_texture_get_ptr(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__tileset__")));
+  if (NULL == tileset) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "texture is already destroyed.");
+  }
+  return tileset;
+}
+
+/*
+ * Copies the non-empty tiles of [tx0, tx1) x [ty0, ty1) so that tile
+ * (tx0, ty0) lands at (ox, oy). Returns the number of tiles drawn, or -1.
+ */
+static int
+mrb_sdl2_video_tilemap_draw_tiles(SDL_Renderer *renderer, SDL_Texture *tileset, mrb_sdl2_video_tilemap_data_t const *data, int tx0, int ty0, int tx1, int ty1, int ox, int oy)
+{
+  int tx, ty, drawn = 0;
+  for (ty = ty0; ty < ty1; ++ty) {
+    uint16_t const *row = &data->tiles[ty * data->map_w];
+    SDL_Rect dst = { ox, oy + (ty - ty0) * data->tile_h, data->tile_w, data->tile_h };
+    for (tx = tx0; tx < tx1; ++tx, dst.x += data->tile_w) {
+      int const id = row[tx];
+      SDL_Rect src;
+      if (0 == id) {
+        continue;
+      }
+      src.x = ((id - 1) % data->columns) * data->tile_w;
+      src.y = ((id - 1) / data->columns) * data->tile_h;
+      src.w = data->tile_w;
+      src.h = data->tile_h;
+      if (0 != SDL_RenderCopy(renderer, tileset, &src, &dst)) {
+        return -1;
+      }
+      ++drawn;
+    }
+  }
+  return drawn;
+}
+
+/***************************************************************************
+*
+* class SDL2::Video::TileLayer
+*
+***************************************************************************/
+
+/*
+ * SDL2::Video::TileLayer.new(tileset, map_width, map_height, tile_width, tile_height)
+ */
+static mrb_value
+mrb_sdl2_video_tilemap_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value tileset;
+  mrb_int map_w, map_h, tile_w, tile_h;
+  int tex_w;
+  SDL_Texture *texture;
+  mrb_sdl2_video_tilemap_data_t *data =
+    (mrb_sdl2_video_tilemap_data_t*)DATA_PTR(self);
+  mrb_get_args(mrb, "oiiii", &tileset, &map_w, &map_h, &tile_w, &tile_h);
+  if ((map_w <= 0) || (map_h <= 0) || (tile_w <= 0) || (tile_h <= 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "map and tile sizes must be positive.");
+  }
+  texture = mrb_sdl2_video_texture_get_ptr(mrb, tileset);
+  if (0 != SDL_QueryTexture(texture, NULL, NULL, &tex_w, NULL)) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  if (tex_w < tile_w) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "tileset is narrower than a tile.");
+  }
+  if (NULL == data) {
+    data = (mrb_sdl2_video_tilemap_data_t*)mrb_malloc(mrb, sizeof(mrb_sdl2_video_tilemap_data_t));
+    if (NULL == data) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "insufficient memory.");
+    }
+  } else {
+    mrb_sdl2_video_tilemap_free_chunks(mrb, data);
+    mrb_free(mrb, data->tiles);
+  }
+  SDL_memset(data, 0, sizeof(*data));
+  DATA_PTR(self) = data;
+  DATA_TYPE(self) = &mrb_sdl2_video_tilemap_data_type;
+  data->tiles = (uint16_t*)mrb_calloc(mrb, (size_t)map_w * map_h, sizeof(uint16_t));
+  data->map_w   = (int)map_w;
+  data->map_h   = (int)map_h;
+  data->tile_w  = (int)tile_w;
+  data->tile_h  = (int)tile_h;
+  data->columns = tex_w / (int)tile_w;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__tileset__"), tileset);
+  return self;
+}
+
+static uint16_t *
+mrb_sdl2_video_tilemap_cell(mrb_state *mrb, mrb_sdl2_video_tilemap_data_t *data, mrb_int x, mrb_int y)
+{
+  if ((x < 0) || (y < 0) || (x >= data->map_w) || (y >= data->map_h)) {
+    mrb_raise(mrb, E_INDEX_ERROR, "tile position is out of range.");
+  }
+  return &data->tiles[y * data->map_w + x];
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_get_at(mrb_state *mrb, mrb_value self)
+{
+  mrb_int x, y;
+  mrb_sdl2_video_tilemap_data_t *data = mrb_sdl2_video_tilemap_get_data(mrb, self);
+  mrb_get_args(mrb, "ii", &x, &y);
+  return mrb_fixnum_value(*mrb_sdl2_video_tilemap_cell(mrb, data, x, y));
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_set_at(mrb_state *mrb, mrb_value self)
+{
+  mrb_int x, y, id;
+  uint16_t *cell;
+  mrb_sdl2_video_tilemap_data_t *data = mrb_sdl2_video_tilemap_get_data(mrb, self);
+  mrb_get_args(mrb, "iii", &x, &y, &id);
+  if ((id < 0) || (id > 0xffff)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "tile id is out of range.");
+  }
+  cell = mrb_sdl2_video_tilemap_cell(mrb, data, x, y);
+  if (*cell != (uint16_t)id) {
+    *cell = (uint16_t)id;
+    mrb_sdl2_video_tilemap_mark_dirty(data, (int)x, (int)y);
+  }
+  return mrb_fixnum_value(id);
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_fill(mrb_state *mrb, mrb_value self)
+{
+  mrb_int id;
+  size_t i, n;
+  mrb_sdl2_video_tilemap_data_t *data = mrb_sdl2_video_tilemap_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &id);
+  if ((id < 0) || (id > 0xffff)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "tile id is out of range.");
+  }
+  n = (size_t)data->map_w * data->map_h;
+  for (i = 0; i < n; ++i) {
+    data->tiles[i] = (uint16_t)id;
+  }
+  if (NULL != data->dirty) {
+    SDL_memset(data->dirty, 1, (size_t)data->chunks_x * data->chunks_y);
+  }
+  return self;
+}
+
+/*
+ * SDL2::Video::TileLayer#load(bytes)
+ *
+ * Replaces the tiles from a String or SDL2::Buffer of native-endian uint16
+ * ids in row-major order, e.g. Array#pack('S*') output.
+ */
+static mrb_value
+mrb_sdl2_video_tilemap_load(mrb_state *mrb, mrb_value self)
+{
+  mrb_value bytes;
+  size_t size;
+  void const *ptr;
+  mrb_sdl2_video_tilemap_data_t *data = mrb_sdl2_video_tilemap_get_data(mrb, self);
+  size_t const need = (size_t)data->map_w * data->map_h * sizeof(uint16_t);
+  mrb_get_args(mrb, "o", &bytes);
+  ptr = mrb_sdl2_misc_bytes_get_ptr(mrb, bytes, &size);
+  if (size < need) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "buffer is smaller than the map.");
+  }
+  SDL_memcpy(data->tiles, ptr, need);
+  if (NULL != data->dirty) {
+    SDL_memset(data->dirty, 1, (size_t)data->chunks_x * data->chunks_y);
+  }
+  return self;
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_get_chunk_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_tilemap_get_data(mrb, self)->chunk_size);
+}
+
+/*
+ * SDL2::Video::TileLayer#chunk_size=(tiles)
+ *
+ * With a non-zero size, #render caches blocks of tiles x tiles cells in
+ * render target textures and redraws a block only after one of its cells
+ * changed. Suited to static layers; 0 (the default) draws tiles directly.
+ */
+static mrb_value
+mrb_sdl2_video_tilemap_set_chunk_size(mrb_state *mrb, mrb_value self)
+{
+  mrb_int size;
+  mrb_sdl2_video_tilemap_data_t *data = mrb_sdl2_video_tilemap_get_data(mrb, self);
+  mrb_get_args(mrb, "i", &size);
+  if (size < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "chunk size must not be negative.");
+  }
+  if (size != data->chunk_size) {
+    mrb_sdl2_video_tilemap_drop_chunks(mrb, self, data);
+    data->chunk_size = (int)size;
+  }
+  return self;
+}
+
+/*
+ * SDL2::Video::TileLayer#invalidate
+ *
+ * Marks every cached chunk for redraw, e.g. after the renderer reported
+ * that render targets were reset.
+ */
+static mrb_value
+mrb_sdl2_video_tilemap_invalidate(mrb_state *mrb, mrb_value self)
+{
+  mrb_sdl2_video_tilemap_data_t *data = mrb_sdl2_video_tilemap_get_data(mrb, self);
+  if (NULL != data->dirty) {
+    SDL_memset(data->dirty, 1, (size_t)data->chunks_x * data->chunks_y);
+  }
+  return self;
+}
+
+/*
+ * Redraws chunk (cx, cy) into its target texture, creating it if needed.
+ * The target is switched through Renderer#target= so that queued draws
+ * are flushed first and the cached clip rect and view port stay in sync.
+ */
+static int
+mrb_sdl2_video_tilemap_build_chunk(mrb_state *mrb, mrb_value self, mrb_sdl2_video_tilemap_data_t *data, mrb_value renderer_value, SDL_Texture *tileset, int cx, int cy)
+{
+  int const index = cy * data->chunks_x + cx;
+  int const tx0 = cx * data->chunk_size;
+  int const ty0 = cy * data->chunk_size;
+  int const tx1 = SDL_min(tx0 + data->chunk_size, data->map_w);
+  int const ty1 = SDL_min(ty0 + data->chunk_size, data->map_h);
+  SDL_Renderer *renderer = mrb_sdl2_video_renderer_get_ptr(mrb, renderer_value);
+  mrb_value const chunks = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__chunks__"));
+  mrb_value const previous = mrb_funcall(mrb, renderer_value, "target", 0);
+  int result;
+  if (NULL == data->chunks[index]) {
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                             (tx1 - tx0) * data->tile_w, (ty1 - ty0) * data->tile_h);
+    if (NULL == texture) {
+      return -1;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    mrb_ary_set(mrb, chunks, index, mrb_sdl2_video_renderer_texture(mrb, renderer_value, texture));
+    data->chunks[index] = texture;
+  }
+  mrb_funcall(mrb, renderer_value, "target=", 1, mrb_ary_ref(mrb, chunks, index));
+  result = SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+  if (0 == result) {
+    result = SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+  }
+  if (0 == result) {
+    result = SDL_RenderClear(renderer);
+  }
+  if ((0 == result) && (0 > mrb_sdl2_video_tilemap_draw_tiles(renderer, tileset, data, tx0, ty0, tx1, ty1, 0, 0))) {
+    result = -1;
+  }
+  mrb_funcall(mrb, renderer_value, "target=", 1, previous);
+  data->dirty[index] = 0;
+  return result;
+}
+
+/*
+ * SDL2::Video::TileLayer#render(renderer, camera_x, camera_y)
+ *
+ * Draws the part of the layer visible through the renderer's view port,
+ * with map pixel (camera_x, camera_y) at the view port's top left corner.
+ * Returns the number of copies issued.
+ */
+static mrb_value
+mrb_sdl2_video_tilemap_render(mrb_state *mrb, mrb_value self)
+{
+  mrb_value renderer_value;
+  mrb_int camera_x, camera_y;
+  SDL_Renderer *renderer;
+  SDL_Texture *tileset;
+  SDL_Rect view;
+  int tx0, ty0, tx1, ty1, drawn = 0;
+  mrb_sdl2_video_tilemap_data_t *data = mrb_sdl2_video_tilemap_get_data(mrb, self);
+  mrb_get_args(mrb, "oii", &renderer_value, &camera_x, &camera_y);
+  tileset = mrb_sdl2_video_tilemap_tileset(mrb, self);
+  renderer = mrb_sdl2_video_renderer_get_draw_ptr(mrb, renderer_value, "TileLayer#render cannot be recorded.");
+  SDL_RenderGetViewport(renderer, &view);
+
+  if (0 == data->chunk_size) {
+    tx0 = SDL_max(0, (int)(camera_x / data->tile_w) - (camera_x < 0));
+    ty0 = SDL_max(0, (int)(camera_y / data->tile_h) - (camera_y < 0));
+    tx1 = SDL_min(data->map_w, (int)((camera_x + view.w + data->tile_w - 1) / data->tile_w));
+    ty1 = SDL_min(data->map_h, (int)((camera_y + view.h + data->tile_h - 1) / data->tile_h));
+    if ((tx0 < tx1) && (ty0 < ty1)) {
+      drawn = mrb_sdl2_video_tilemap_draw_tiles(renderer, tileset, data, tx0, ty0, tx1, ty1,
+                                                tx0 * data->tile_w - (int)camera_x,
+                                                ty0 * data->tile_h - (int)camera_y);
+    }
+  } else {
+    int const chunk_w = data->chunk_size * data->tile_w;
+    int const chunk_h = data->chunk_size * data->tile_h;
+    int cx, cy;
+    bool rebuilt = false;
+    if ((NULL != data->chunks) && (data->chunk_renderer != renderer)) {
+      mrb_sdl2_video_tilemap_drop_chunks(mrb, self, data);
+    }
+    if (NULL == data->chunks) {
+      data->chunks_x = (data->map_w + data->chunk_size - 1) / data->chunk_size;
+      data->chunks_y = (data->map_h + data->chunk_size - 1) / data->chunk_size;
+      data->chunks = (SDL_Texture**)mrb_calloc(mrb, (size_t)data->chunks_x * data->chunks_y, sizeof(SDL_Texture*));
+      data->dirty  = (uint8_t*)mrb_malloc(mrb, (size_t)data->chunks_x * data->chunks_y);
+      SDL_memset(data->dirty, 1, (size_t)data->chunks_x * data->chunks_y);
+      data->chunk_renderer = renderer;
+      mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__chunks__"), mrb_ary_new_capa(mrb, data->chunks_x * data->chunks_y));
+    }
+    tx0 = SDL_max(0, (int)(camera_x / chunk_w) - (camera_x < 0));
+    ty0 = SDL_max(0, (int)(camera_y / chunk_h) - (camera_y < 0));
+    tx1 = SDL_min(data->chunks_x, (int)((camera_x + view.w + chunk_w - 1) / chunk_w));
+    ty1 = SDL_min(data->chunks_y, (int)((camera_y + view.h + chunk_h - 1) / chunk_h));
+    for (cy = ty0; (0 <= drawn) && (cy < ty1); ++cy) {
+      for (cx = tx0; cx < tx1; ++cx) {
+        int const index = cy * data->chunks_x + cx;
+        SDL_Rect dst;
+        if (data->dirty[index]) {
+          rebuilt = true;
+          if (0 != mrb_sdl2_video_tilemap_build_chunk(mrb, self, data, renderer_value, tileset, cx, cy)) {
+            drawn = -1;
+            break;
+          }
+        }
+        SDL_QueryTexture(data->chunks[index], NULL, NULL, &dst.w, &dst.h);
+        dst.x = cx * chunk_w - (int)camera_x;
+        dst.y = cy * chunk_h - (int)camera_y;
+        if (0 != SDL_RenderCopy(renderer, data->chunks[index], NULL, &dst)) {
+          drawn = -1;
+          break;
+        }
+        ++drawn;
+      }
+    }
+    if (rebuilt) {
+      /* draw color and blend mode were changed behind the cache */
+      mrb_sdl2_video_renderer_restore_state(mrb, renderer_value);
+    }
+  }
+  if (0 > drawn) {
+    mruby_sdl2_raise_error(mrb);
+  }
+  return mrb_fixnum_value(drawn);
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_get_width(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_tilemap_get_data(mrb, self)->map_w);
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_get_height(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_tilemap_get_data(mrb, self)->map_h);
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_get_tile_width(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_tilemap_get_data(mrb, self)->tile_w);
+}
+
+static mrb_value
+mrb_sdl2_video_tilemap_get_tile_height(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_sdl2_video_tilemap_get_data(mrb, self)->tile_h);
+}
+
+void
+mruby_sdl2_video_tilemap_init(mrb_state *mrb)
+{
+  class_TileLayer = mrb_define_class_under(mrb, mod_Video, "TileLayer", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(class_TileLayer, MRB_TT_DATA);
+
+  mrb_define_method(mrb, class_TileLayer, "initialize",  mrb_sdl2_video_tilemap_initialize,      MRB_ARGS_REQ(5));
+  mrb_define_method(mrb, class_TileLayer, "width",       mrb_sdl2_video_tilemap_get_width,       MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TileLayer, "height",      mrb_sdl2_video_tilemap_get_height,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TileLayer, "tile_width",  mrb_sdl2_video_tilemap_get_tile_width,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TileLayer, "tile_height", mrb_sdl2_video_tilemap_get_tile_height, MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TileLayer, "[]",          mrb_sdl2_video_tilemap_get_at,          MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, class_TileLayer, "[]=",         mrb_sdl2_video_tilemap_set_at,          MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, class_TileLayer, "fill",        mrb_sdl2_video_tilemap_fill,            MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TileLayer, "load",        mrb_sdl2_video_tilemap_load,            MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TileLayer, "chunk_size",  mrb_sdl2_video_tilemap_get_chunk_size,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TileLayer, "chunk_size=", mrb_sdl2_video_tilemap_set_chunk_size,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, class_TileLayer, "invalidate",  mrb_sdl2_video_tilemap_invalidate,      MRB_ARGS_NONE());
+  mrb_define_method(mrb, class_TileLayer, "render",      mrb_sdl2_video_tilemap_render,          MRB_ARGS_REQ(3));
+}
+
+void
+mruby_sdl2_video_tilemap_final(mrb_state *mrb)
+{
+}
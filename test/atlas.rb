@@ -0,0 +1,96 @@
+##
+# SDL2::Video::TextureAtlas test
+
+SDL2::init
+begin
+  def atlas_surface(w, h)
+    SDL2::Video::Surface.new(w, h, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+  end
+
+  def atlas_overlap?(a, b, padding)
+    a.x < b.x + b.w + padding && b.x < a.x + a.w + padding &&
+      a.y < b.y + b.h + padding && b.y < a.y + a.h + padding
+  end
+
+  target   = atlas_surface(16, 16)
+  renderer = SDL2::Video::Renderer.new(target)
+
+  assert('SDL2::Video::TextureAtlas#build packs without overlap') do
+    atlas = SDL2::Video::TextureAtlas.new(renderer, 64, 64, 1)
+    sizes = [[20, 10], [10, 20], [8, 8], [30, 5], [5, 30], [12, 12], [1, 1], [16, 3]]
+    sizes.each_with_index { |(w, h), i| atlas.add(i, atlas_surface(w, h)) }
+    pages = atlas.build
+    rects = (0...sizes.size).map { |i| atlas.rect(i) }
+    ok = pages == 1
+    rects.each_with_index do |r, i|
+      ok &&= r.w == sizes[i][0] && r.h == sizes[i][1]
+      ok &&= r.x >= 0 && r.y >= 0 && r.x + r.w <= 64 && r.y + r.h <= 64
+      (i + 1...rects.size).each { |j| ok &&= !atlas_overlap?(r, rects[j], 1) }
+    end
+    ok
+  end
+
+  assert('SDL2::Video::TextureAtlas#build places the tallest sprite first') do
+    atlas = SDL2::Video::TextureAtlas.new(renderer, 64, 64, 0)
+    atlas.add(:short, atlas_surface(10, 4))
+    atlas.add(:tall,  atlas_surface(10, 20))
+    atlas.build
+    r = atlas.rect(:tall)
+    r.x == 0 && r.y == 0 && atlas.rect(:short).y == 0
+  end
+
+  assert('SDL2::Video::TextureAtlas#build fills the lowest skyline gap') do
+    atlas = SDL2::Video::TextureAtlas.new(renderer, 32, 64, 0)
+    atlas.add(:a, atlas_surface(16, 20))
+    atlas.add(:b, atlas_surface(16, 10))
+    atlas.add(:c, atlas_surface(16, 10))
+    atlas.build
+    a, b, c = atlas.rect(:a), atlas.rect(:b), atlas.rect(:c)
+    a.x == 0 && a.y == 0 && b.x == 16 && b.y == 0 && c.x == 16 && c.y == 10
+  end
+
+  assert('SDL2::Video::TextureAtlas#build opens a new page when full') do
+    atlas = SDL2::Video::TextureAtlas.new(renderer, 32, 32, 0)
+    5.times { |i| atlas.add(i, atlas_surface(16, 16)) }
+    pages = atlas.build
+    counts = [0, 0]
+    5.times { |i| counts[atlas.page(i)] += 1 }
+    pages == 2 && counts == [4, 1] && atlas.textures.size == 2
+  end
+
+  assert('SDL2::Video::TextureAtlas#add rejects oversized surfaces') do
+    atlas = SDL2::Video::TextureAtlas.new(renderer, 32, 32, 1)
+    begin
+      atlas.add(:big, atlas_surface(32, 8))
+      false
+    rescue ArgumentError
+      true
+    end
+  end
+
+  assert('SDL2::Video::TextureAtlas#add rejects empty surfaces') do
+    atlas = SDL2::Video::TextureAtlas.new(renderer, 32, 32, 1)
+    [[0, 8], [8, 0]].all? do |w, h|
+      begin
+        atlas.add(:empty, atlas_surface(w, h))
+        false
+      rescue ArgumentError
+        true
+      end
+    end
+  end
+
+  assert('SDL2::Video::TextureAtlas#rect raises on unknown keys') do
+    atlas = SDL2::Video::TextureAtlas.new(renderer, 32, 32, 0)
+    atlas.add(:a, atlas_surface(4, 4))
+    atlas.build
+    key_error = begin atlas.rect(:b); false rescue KeyError; true end
+    index_error = begin atlas.rect(1); false rescue IndexError; true end
+    key_error && index_error
+  end
+
+  renderer.destroy
+  target.destroy
+ensure
+  SDL2::quit
+end
@@ -0,0 +1,58 @@
+##
+# SDL2::Video::TextureCache test
+
+SDL2::init
+begin
+  # writes a w x h BMP and returns its path
+  def cache_bmp(name, w, h)
+    path = "/tmp/mruby_sdl2_cache_#{name}.bmp"
+    SDL2::Video::Surface.save_bmp(SDL2::Video::Surface.new(w, h, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888), path)
+    path
+  end
+
+  target   = SDL2::Video::Surface.new(4, 4, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+  renderer = SDL2::Video::Renderer.new(target)
+  a = cache_bmp('a', 4, 4)
+  b = cache_bmp('b', 4, 4)
+  c = cache_bmp('c', 4, 4)
+
+  assert('SDL2::Video::TextureCache#fetch evicts the least recently used entry') do
+    cache = SDL2::Video::TextureCache.new(renderer, 1 << 20)
+    cache.fetch(a)
+    per_texture = cache.bytes
+    cache.budget = per_texture * 2
+    cache.fetch(b)
+    cache.fetch(a)
+    cache.fetch(c)
+    stats = cache.stats
+    kept = cache.include?(a) && !cache.include?(b) && cache.include?(c)
+    cache.clear
+    kept && stats[:size] == 2 && stats[:bytes] == per_texture * 2 &&
+      stats[:hits] == 1 && stats[:misses] == 3 && stats[:evictions] == 1
+  end
+
+  assert('SDL2::Video::TextureCache#fetch keeps the entry just fetched') do
+    cache = SDL2::Video::TextureCache.new(renderer, 0)
+    texture = cache.fetch(a)
+    usable = texture.width == 4
+    fetched = cache.include?(a) && cache.size == 1
+    cache.fetch(b)
+    replaced = !cache.include?(a) && cache.include?(b) && cache.size == 1
+    cache.clear
+    usable && fetched && replaced
+  end
+
+  assert('SDL2::Video::TextureCache#budget= evicts down to the new budget') do
+    cache = SDL2::Video::TextureCache.new(renderer, 1 << 20)
+    [a, b, c].each { |path| cache.fetch(path) }
+    cache.budget = cache.bytes / 3
+    left = cache.size == 1 && cache.include?(c) && cache.stats[:evictions] == 2
+    cache.clear
+    left && cache.size == 0 && cache.bytes == 0
+  end
+
+  renderer.destroy
+  target.destroy
+ensure
+  SDL2::quit
+end
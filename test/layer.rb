@@ -0,0 +1,82 @@
+##
+# SDL2::Video::RenderLayer / SDL2::Video::Compositor test
+
+SDL2::init
+begin
+  red_pixel   = 0xffff0000
+  green_pixel = 0xff00ff00
+  black_pixel = 0xff000000
+
+  def layer_row(s)
+    (0...s.width).map { |x| s.get_pixel(x, 0) }
+  end
+
+  target   = SDL2::Video::Surface.new(4, 1, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+  renderer = SDL2::Video::Renderer.new(target)
+
+  # clears the target to black, draws the compositor and returns the target's pixels
+  composited = lambda do |compositor|
+    renderer.set_draw_color(0, 0, 0, 255)
+    renderer.clear
+    compositor.draw
+    renderer.present
+    layer_row(target)
+  end
+
+  assert('SDL2::Video::Compositor#draw composites layers back to front') do
+    back = SDL2::Video::RenderLayer.new(renderer, 3, 1) do |r|
+      r.set_draw_color(255, 0, 0, 255)
+      r.fill_rect(SDL2::Rect.new(0, 0, 3, 1))
+    end
+    # the right half stays transparent
+    front = SDL2::Video::RenderLayer.new(renderer, 2, 1) do |r|
+      r.set_draw_color(0, 255, 0, 255)
+      r.fill_rect(SDL2::Rect.new(0, 0, 1, 1))
+    end
+    front.x = 1
+    compositor = SDL2::Video::Compositor.new(renderer)
+    compositor.add(back)
+    compositor.add(front)
+    row = composited.call(compositor)
+    back.texture.destroy
+    front.texture.destroy
+    row == [red_pixel, green_pixel, red_pixel, black_pixel]
+  end
+
+  assert('SDL2::Video::Compositor#draw repaints only dirty layers') do
+    color = [255, 0, 0]
+    layer = SDL2::Video::RenderLayer.new(renderer, 1, 1) do |r|
+      r.set_draw_color(color[0], color[1], color[2], 255)
+      r.fill_rect(SDL2::Rect.new(0, 0, 1, 1))
+    end
+    compositor = SDL2::Video::Compositor.new(renderer)
+    compositor.add(layer)
+    first = composited.call(compositor)
+    color = [0, 255, 0]
+    cached = composited.call(compositor)
+    layer.invalidate
+    repainted = composited.call(compositor)
+    layer.texture.destroy
+    first[0] == red_pixel && cached[0] == red_pixel && repainted[0] == green_pixel &&
+      layer.repaints == 2 && !layer.dirty?
+  end
+
+  assert('SDL2::Video::Compositor#draw skips hidden layers and restores the target') do
+    layer = SDL2::Video::RenderLayer.new(renderer, 1, 1) do |r|
+      r.set_draw_color(255, 0, 0, 255)
+      r.fill_rect(SDL2::Rect.new(0, 0, 1, 1))
+    end
+    layer.visible = false
+    compositor = SDL2::Video::Compositor.new(renderer)
+    compositor.add(layer)
+    row = composited.call(compositor)
+    repaints = layer.repaints
+    layer.texture.destroy
+    row[0] == black_pixel && repaints == 1 && renderer.target.nil?
+  end
+
+  renderer.destroy
+  target.destroy
+ensure
+  SDL2::quit
+end
@@ -0,0 +1,75 @@
+##
+# SDL2::Video::AssetLoader test
+
+SDL2::init
+begin
+  # writes a w x h BMP and returns its path
+  def loader_bmp(name, w, h)
+    path = "/tmp/mruby_sdl2_loader_#{name}.bmp"
+    SDL2::Video::Surface.save_bmp(SDL2::Video::Surface.new(w, h, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888), path)
+    path
+  end
+
+  target   = SDL2::Video::Surface.new(4, 4, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+  renderer = SDL2::Video::Renderer.new(target)
+  a = loader_bmp('a', 3, 2)
+  b = loader_bmp('b', 2, 2)
+
+  assert('SDL2::Video::AssetLoader#pump uploads decoded files') do
+    loader = SDL2::Video::AssetLoader.new(renderer)
+    id = loader.load(a)
+    loader.wait
+    yielded = []
+    results = loader.pump { |*entry| yielded << entry }
+    texture = results[0][1]
+    loaded = results.size == 1 && results[0][0] == id && results[0][2].nil? &&
+      texture.width == 3 && texture.height == 2 && yielded == results
+    counts = loader.pending == 0 && loader.uploaded == 1 && loader.failed == 0
+    texture.destroy
+    loader.close
+    loaded && counts && loader.closed?
+  end
+
+  assert('SDL2::Video::AssetLoader#pump reports files that fail to load') do
+    loader = SDL2::Video::AssetLoader.new(renderer)
+    id = loader.load('/tmp/mruby_sdl2_loader_missing.bmp')
+    loader.wait
+    results = loader.pump
+    loader_failed = loader.failed
+    loader.close
+    results.size == 1 && results[0][0] == id && results[0][1].nil? &&
+      results[0][2].is_a?(String) && loader_failed == 1
+  end
+
+  assert('SDL2::Video::AssetLoader#pump stops at the byte budget') do
+    loader = SDL2::Video::AssetLoader.new(renderer, 1)
+    ids = [loader.load(a), loader.load(b)]
+    loader.wait
+    first = loader.pump(1)
+    second = loader.pump(1)
+    (first + second).each { |entry| entry[1].destroy }
+    loader.close
+    first.size == 1 && second.size == 1 && (first + second).map { |entry| entry[0] }.sort == ids.sort
+  end
+
+  assert('SDL2::Video::AssetLoader raises on bad threads, destroyed renderers and closed loaders') do
+    bad_threads = begin SDL2::Video::AssetLoader.new(renderer, 0); false rescue ArgumentError; true end
+    s = SDL2::Video::Surface.new(1, 1, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+    r = SDL2::Video::Renderer.new(s)
+    loader = SDL2::Video::AssetLoader.new(r)
+    loader.load(a)
+    loader.wait
+    r.destroy
+    destroyed = begin loader.pump; false rescue RuntimeError; true end
+    kept = loader.pending == 1
+    loader.close
+    closed = begin loader.load(a); false rescue RuntimeError; true end
+    s.destroy
+    bad_threads && destroyed && kept && closed
+  end
+
+  renderer.destroy
+  target.destroy
+ensure
+  SDL2::quit
+end
@@ -0,0 +1,75 @@
+##
+# SDL2::Video::RenderQueue test
+
+SDL2::init
+begin
+  red_pixel   = 0xffff0000
+  green_pixel = 0xff00ff00
+  blue_pixel  = 0xff0000ff
+
+  def queue_surface(*pixels)
+    s = SDL2::Video::Surface.new(pixels.size, 1, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+    pixels.each_with_index { |p, x| s.set_pixel(x, 0, p) }
+    s
+  end
+
+  target   = queue_surface(0)
+  renderer = SDL2::Video::Renderer.new(target)
+  red      = SDL2::Video::Texture.new(renderer, queue_surface(red_pixel))
+  green    = SDL2::Video::Texture.new(renderer, queue_surface(green_pixel))
+  blue     = SDL2::Video::Texture.new(renderer, queue_surface(blue_pixel))
+  strip    = SDL2::Video::Texture.new(renderer, queue_surface(red_pixel, green_pixel))
+  dst      = SDL2::Rect.new(0, 0, 1, 1)
+
+  # draws the queue and returns the pixel left on the target
+  queue_result = lambda do |queue|
+    queue.draw(renderer)
+    renderer.present
+    target.get_pixel(0, 0)
+  end
+
+  assert('SDL2::Video::RenderQueue#draw orders negative layers') do
+    q = SDL2::Video::RenderQueue.new
+    q.push(1,  red,   nil, dst)
+    q.push(-5, green, nil, dst)
+    q.push(-1, blue,  nil, dst)
+    top = queue_result.call(q)
+    q.push(-5, red,   nil, dst)
+    q.push(-1, blue,  nil, dst)
+    q.push(-3, green, nil, dst)
+    top == red_pixel && queue_result.call(q) == blue_pixel && q.size == 0
+  end
+
+  assert('SDL2::Video::RenderQueue#draw orders layers across the sign bit') do
+    q = SDL2::Video::RenderQueue.new
+    q.push(0x7fffffff,  green, nil, dst)
+    q.push(-0x80000000, red,   nil, dst)
+    q.push(0,           blue,  nil, dst)
+    queue_result.call(q) == green_pixel
+  end
+
+  assert('SDL2::Video::RenderQueue#draw keeps push order on ties') do
+    left  = SDL2::Rect.new(0, 0, 1, 1)
+    right = SDL2::Rect.new(1, 0, 1, 1)
+    q = SDL2::Video::RenderQueue.new
+    q.push(2, strip, left,  dst)
+    q.push(2, strip, right, dst)
+    first = queue_result.call(q)
+    q.push(2, strip, right, dst)
+    q.push(2, strip, left,  dst)
+    first == green_pixel && queue_result.call(q) == red_pixel
+  end
+
+  assert('SDL2::Video::RenderQueue#draw groups a layer by texture') do
+    q = SDL2::Video::RenderQueue.new
+    q.push(0, red,   nil, dst)
+    q.push(0, green, nil, dst)
+    q.push(0, red,   nil, dst)
+    queue_result.call(q) == green_pixel
+  end
+
+  renderer.destroy
+  target.destroy
+ensure
+  SDL2::quit
+end
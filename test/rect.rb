@@ -109,6 +109,42 @@ begin
     u = SDL2::Rect.new(0, 0, 100, 100).union(SDL2::Rect.new(-10, -10, 20, 20))
     u.x == -10 && u.y == -10 && u.w == 110 && u.h == 110
   end
+  assert('SDL2::RectArray.initialize') do
+    a = SDL2::RectArray.new(3)
+    a.size == 3 && a[2] == SDL2::Rect.new(0, 0, 0, 0)
+  end
+  assert('SDL2::RectArray.push') do
+    a = SDL2::RectArray.new
+    a.push(1, 2, 3, 4)
+    a.push(SDL2::Rect.new(5, 6, 7, 8))
+    a.size == 2 && a[0] == SDL2::Rect.new(1, 2, 3, 4) && a[-1] == SDL2::Rect.new(5, 6, 7, 8)
+  end
+  assert('SDL2::RectArray.set') do
+    a = SDL2::RectArray.new(2)
+    a.set(1, 1, 2, 3, 4)
+    a[0] = SDL2::Rect.new(5, 6, 7, 8)
+    a[0] == SDL2::Rect.new(5, 6, 7, 8) && a[1] == SDL2::Rect.new(1, 2, 3, 4)
+  end
+  assert('SDL2::RectArray.resize') do
+    a = SDL2::RectArray.new
+    100.times { |i| a.push(i, i, 1, 1) }
+    a.resize(10)
+    a.size == 10 && a[9] == SDL2::Rect.new(9, 9, 1, 1)
+  end
+  assert('SDL2::RectArray index out of bounds') do
+    assert_raise(IndexError) { SDL2::RectArray.new(1)[1] }
+  end
+  assert('SDL2::PointArray.push') do
+    a = SDL2::PointArray.new
+    a.push(1, 2)
+    a.push(SDL2::Point.new(3, 4))
+    a.size == 2 && a[0].x == 1 && a[0].y == 2 && a[1].x == 3 && a[1].y == 4
+  end
+  assert('SDL2::PointArray.set') do
+    a = SDL2::PointArray.new(2)
+    a.set(1, 5, 6)
+    a[1].x == 5 && a[1].y == 6 && a[0].x == 0 && a[0].y == 0
+  end
 ensure
   SDL2::quit
 end
@@ -0,0 +1,263 @@
+##
+# SDL2::Video::Renderer test
+
+SDL2::init
+begin
+  red_pixel   = 0xffff0000
+  green_pixel = 0xff00ff00
+  black_pixel = 0xff000000
+
+  def renderer_surface(*pixels)
+    s = SDL2::Video::Surface.new(pixels.size, 1, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+    pixels.each_with_index { |p, x| s.set_pixel(x, 0, p) }
+    s
+  end
+
+  def renderer_row(s)
+    (0...s.width).map { |x| s.get_pixel(x, 0) }
+  end
+
+  # int32 records for copy_batch, in native byte order
+  def int32_records(*values)
+    bytes = values.map do |v|
+      le = [0, 8, 16, 24].map { |shift| (v >> shift) & 0xff }
+      (SDL2::SDL_BYTEORDER == SDL2::SDL_LIL_ENDIAN) ? le : le.reverse
+    end
+    SDL2::ByteBuffer.new(bytes.flatten)
+  end
+
+  target   = renderer_surface(0, 0, 0, 0)
+  renderer = SDL2::Video::Renderer.new(target)
+  strip    = SDL2::Video::Texture.new(renderer, renderer_surface(red_pixel, green_pixel))
+
+  # one copy_ex_batch record with a NaN (middle of dst) center
+  def ex_record(src, dst, flip = 0.0, mod = [255.0, 255.0, 255.0, 255.0], angle = 0.0)
+    src + dst + [angle, 0.0 / 0.0, 0.0 / 0.0, flip] + mod
+  end
+
+  # clears the target to black, runs the draw and returns the target's pixels
+  drawn = lambda do |draw|
+    renderer.set_draw_color(0, 0, 0, 255)
+    renderer.clear
+    draw.call
+    renderer.present
+    renderer_row(target)
+  end
+
+  assert('SDL2::Video::Renderer#copy_batch draws each packed record') do
+    records = int32_records(0, 0, 1, 1, 3, 0, 1, 1,
+                            1, 0, 1, 1, 0, 0, 1, 1,
+                            0, 0, 0, 0, 1, 0, 2, 1)
+    drawn.call(lambda { renderer.copy_batch(strip, records) }) == [green_pixel, red_pixel, green_pixel, red_pixel]
+  end
+
+  assert('SDL2::Video::Renderer#copy_batch draws only count records') do
+    records = int32_records(0, 0, 1, 1, 0, 0, 1, 1,
+                            0, 0, 1, 1, 1, 0, 1, 1)
+    drawn.call(lambda { renderer.copy_batch(strip, records, 1) }) == [red_pixel, black_pixel, black_pixel, black_pixel]
+  end
+
+  assert('SDL2::Video::Renderer#copy_batch ignores a trailing partial record') do
+    records = int32_records(1, 0, 1, 1, 2, 0, 1, 1, 0, 0, 1)
+    drawn.call(lambda { renderer.copy_batch(strip, records) }) == [black_pixel, black_pixel, green_pixel, black_pixel]
+  end
+
+  assert('SDL2::Video::Renderer#copy_batch checks count') do
+    records = int32_records(0, 0, 1, 1, 0, 0, 1, 1)
+    too_many = begin renderer.copy_batch(strip, records, 2); false rescue ArgumentError; true end
+    negative = begin renderer.copy_batch(strip, records, -1); false rescue ArgumentError; true end
+    not_int  = begin renderer.copy_batch(strip, records, 1.5); false rescue TypeError; true end
+    too_many && negative && not_int
+  end
+
+  assert('SDL2::Video::Renderer#copy_ex_batch draws flipped and tinted records') do
+    records = SDL2::FloatBuffer.new(ex_record([0.0, 0.0, 1.0, 1.0], [0.0, 0.0, 1.0, 1.0]) +
+                                    ex_record([0.0, 0.0, 0.0, 0.0], [1.0, 0.0, 2.0, 1.0], 1.0) +
+                                    ex_record([0.0, 0.0, 1.0, 1.0], [3.0, 0.0, 1.0, 1.0], 0.0, [128.0, 255.0, 255.0, 255.0]))
+    row = drawn.call(lambda { renderer.copy_ex_batch(strip, records) })
+    # the texture's own modulation is put back afterwards
+    plain = drawn.call(lambda { renderer.copy(strip, SDL2::Rect.new(0, 0, 1, 1), SDL2::Rect.new(3, 0, 1, 1)) })
+    row == [red_pixel, green_pixel, red_pixel, 0xff800000] && plain[3] == red_pixel
+  end
+
+  assert('SDL2::Video::Renderer#copy_ex_batch checks count') do
+    records = SDL2::FloatBuffer.new(ex_record([0.0, 0.0, 1.0, 1.0], [0.0, 0.0, 1.0, 1.0]) +
+                                    ex_record([1.0, 0.0, 1.0, 1.0], [1.0, 0.0, 1.0, 1.0]))
+    first    = drawn.call(lambda { renderer.copy_ex_batch(strip, records, 1) })
+    too_many = begin renderer.copy_ex_batch(strip, records, 3); false rescue ArgumentError; true end
+    negative = begin renderer.copy_ex_batch(strip, records, -1); false rescue ArgumentError; true end
+    not_int  = begin renderer.copy_ex_batch(strip, records, 1.5); false rescue TypeError; true end
+    first == [red_pixel, black_pixel, black_pixel, black_pixel] && too_many && negative && not_int
+  end
+
+  assert('SDL2::Video::Renderer#copy_ex_batch rejects non-finite records before drawing') do
+    rejected = lambda do |record|
+      records = SDL2::FloatBuffer.new(ex_record([0.0, 0.0, 1.0, 1.0], [0.0, 0.0, 1.0, 1.0]) + record)
+      message = nil
+      row = drawn.call(lambda do
+        begin
+          renderer.copy_ex_batch(strip, records)
+        rescue ArgumentError => e
+          message = e.message
+        end
+      end)
+      message == 'record values must be finite.' && row == [black_pixel, black_pixel, black_pixel, black_pixel]
+    end
+    infinite_dst = rejected.call(ex_record([0.0, 0.0, 1.0, 1.0], [1.0 / 0.0, 0.0, 1.0, 1.0]))
+    nan_angle    = rejected.call(ex_record([0.0, 0.0, 1.0, 1.0], [0.0, 0.0, 1.0, 1.0], 0.0, [255.0, 255.0, 255.0, 255.0], 0.0 / 0.0))
+    infinite_dst && nan_angle
+  end
+
+  assert('SDL2::Video::Renderer#copy_ex_batch cannot be recorded') do
+    records = SDL2::FloatBuffer.new(ex_record([0.0, 0.0, 1.0, 1.0], [0.0, 0.0, 1.0, 1.0]))
+    begin
+      renderer.record { |r| r.copy_ex_batch(strip, records) }
+      false
+    rescue RuntimeError => e
+      e.message == 'copy_ex_batch cannot be recorded.'
+    end
+  end
+
+  assert('SDL2::Video::Texture modulation changes keep earlier deferred copies') do
+    white = SDL2::Video::Texture.new(renderer, renderer_surface(0xffffffff))
+    renderer.set_draw_color(0, 0, 0, 255)
+    renderer.clear
+    renderer.deferred = true
+    white.set_color_mod(255, 0, 0)
+    renderer.copy(white, nil, SDL2::Rect.new(0, 0, 1, 1))
+    white.set_color_mod(0, 255, 0)
+    renderer.copy(white, nil, SDL2::Rect.new(1, 0, 1, 1))
+    white.set_color_mod(255, 255, 255)
+    white.alpha_mod = 128
+    renderer.copy(white, nil, SDL2::Rect.new(2, 0, 1, 1))
+    white.alpha_mod = 255
+    renderer.copy(white, nil, SDL2::Rect.new(3, 0, 1, 1))
+    renderer.present
+    renderer.deferred = false
+    row = renderer_row(target)
+    white.destroy
+    half = (row[2] >> 8) & 0xff
+    row[0] == red_pixel && row[1] == green_pixel && row[3] == 0xffffffff && 126 <= half && half <= 129
+  end
+
+  # state_cache_stats counters grown by the block
+  elided = lambda do |r, set|
+    before = r.state_cache_stats
+    set.call
+    after = r.state_cache_stats
+    after.keys.inject({}) { |h, k| h[k] = after[k] - before[k]; h }
+  end
+
+  assert('SDL2::Video::Renderer skips redundant state changes') do
+    s = renderer_surface(0, 0)
+    r = SDL2::Video::Renderer.new(s)
+    rect = SDL2::Rect.new(0, 0, 2, 1)
+    r.set_draw_color(1, 2, 3)
+    r.draw_blend_mode = SDL2::Video::Surface::SDL_BLENDMODE_BLEND
+    r.target = nil
+    r.clip_rect = rect
+    r.view_port = rect
+    state_calls = r.stats[:state_calls]
+    counts = elided.call(r, lambda do
+      2.times do
+        r.set_draw_color(1, 2, 3)
+        r.draw_blend_mode = SDL2::Video::Surface::SDL_BLENDMODE_BLEND
+        r.target = nil
+        r.clip_rect = rect
+        r.view_port = rect
+      end
+    end)
+    changed = elided.call(r, lambda { r.set_draw_color(3, 2, 1) })
+    skipped_calls = r.stats[:state_calls] - state_calls
+    r.destroy
+    s.destroy
+    counts == { :draw_color => 2, :draw_blend_mode => 2, :target => 2, :clip_rect => 2, :view_port => 2 } &&
+      changed[:draw_color] == 0 && skipped_calls == 1
+  end
+
+  assert('SDL2::Video::Renderer#present forgets the cached view port') do
+    s = renderer_surface(0, 0)
+    r = SDL2::Video::Renderer.new(s)
+    rect = SDL2::Rect.new(0, 0, 1, 1)
+    r.view_port = rect
+    r.present
+    after_present = elided.call(r, lambda { r.view_port = rect })
+    again = elided.call(r, lambda { r.view_port = rect })
+    r.destroy
+    s.destroy
+    after_present[:view_port] == 0 && again[:view_port] == 1
+  end
+
+  assert('SDL2::Video::Renderer#stats counts draw calls, primitives and uploads') do
+    s = renderer_surface(0, 0, 0, 0)
+    r = SDL2::Video::Renderer.new(s)
+    t = SDL2::Video::Texture.new(r, renderer_surface(red_pixel, green_pixel))
+    other = SDL2::Video::Texture.new(r, renderer_surface(green_pixel))
+    rect = SDL2::Rect.new(0, 0, 1, 1)
+    points = [SDL2::Point.new(0, 0), SDL2::Point.new(1, 0), SDL2::Point.new(2, 0)]
+    r.present
+    r.set_draw_color(1, 2, 3)
+    r.clear
+    r.copy(t, nil, rect)
+    r.copy(t, nil, rect)
+    r.copy_ex(other, nil, rect)
+    r.draw_lines(*points)
+    r.draw_points(*points)
+    r.draw_rects(rect, rect)
+    r.fill_rects(rect, rect, rect)
+    t.update(renderer_surface(green_pixel, red_pixel))
+    stats = r.stats
+    stats.delete(:sdl_seconds)
+    r.present
+    frame = r.frame_stats
+    frame.delete(:sdl_seconds)
+    cleared = r.stats
+    cleared.delete(:sdl_seconds)
+    other.destroy
+    t.destroy
+    r.destroy
+    s.destroy
+    stats == {
+      :draw_calls => 8,
+      :calls => { :clear => 1, :copy => 2, :copy_ex => 1, :draw_lines => 1, :draw_points => 1, :draw_rects => 1, :fill_rects => 1 },
+      :primitives => 14, :texture_binds => 2, :state_calls => 1, :texture_updates => 1, :bytes_uploaded => 8
+    } && frame == stats && cleared[:draw_calls] == 0 && cleared[:primitives] == 0 &&
+      cleared[:calls].values.all? { |n| n == 0 } && cleared[:texture_updates] == 0 && cleared[:bytes_uploaded] == 0
+  end
+
+  assert('SDL2::Video::Renderer#record captures copies for DisplayList#replay') do
+    left = SDL2::Rect.new(0, 0, 1, 1)
+    list = nil
+    during = drawn.call(lambda do
+      list = renderer.record do |r|
+        r.clip_rect = SDL2::Rect.new(0, 0, 4, 1)
+        r.copy(strip, left, SDL2::Rect.new(1, 0, 1, 1))
+      end
+    end)
+    replayed = drawn.call(lambda { list.replay(renderer) })
+    during == [black_pixel, black_pixel, black_pixel, black_pixel] && list.size > 0 &&
+      replayed == [black_pixel, red_pixel, black_pixel, black_pixel]
+  end
+
+  assert('SDL2::Video::Renderer#record refuses draws it cannot capture') do
+    q = SDL2::Video::RenderQueue.new
+    q.push(0, strip, SDL2::Rect.new(0, 0, 1, 1), SDL2::Rect.new(0, 0, 1, 1))
+    compositor = SDL2::Video::Compositor.new(renderer)
+    refused = [lambda { q.draw(renderer) }, lambda { compositor.draw }].map do |draw|
+      begin
+        renderer.record { |r| draw.call }
+        false
+      rescue RuntimeError => e
+        e.message.end_with?('cannot be recorded.')
+      end
+    end
+    # the queue is kept and still draws once recording is over
+    after = drawn.call(lambda { q.draw(renderer) })
+    refused == [true, true] && after == [red_pixel, black_pixel, black_pixel, black_pixel]
+  end
+
+  renderer.destroy
+  target.destroy
+ensure
+  SDL2::quit
+end
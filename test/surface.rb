@@ -0,0 +1,269 @@
+##
+# SDL2::Video::Surface test
+
+SDL2::init
+begin
+  def argb_surface(w, h)
+    SDL2::Video::Surface.new(w, h, 32, SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888)
+  end
+
+  def argb_row(s, y)
+    (0...s.width).map { |x| s.get_pixel(x, y) }
+  end
+
+  def pixops_surface(format, depth, colors)
+    s = SDL2::Video::Surface.new(colors.size, 1, depth, format)
+    colors.each_with_index { |c, x| s.set_pixel(x, 0, s.format.mapRGBA(*c)) }
+    s
+  end
+
+  def pixops_colors(s)
+    (0...s.width).map { |x| s.format.get_rgba(s.get_pixel(x, 0)) }
+  end
+
+  def pixops_div255(x)
+    x += 128
+    (x + (x >> 8)) >> 8
+  end
+
+  # the reference formulas from sdl2_surface_pixops.c
+  def pixops_reference(op, args, c)
+    r, g, b, a = c
+    case op
+    when :grayscale, :threshold
+      y = (77 * r + 150 * g + 29 * b + 128) >> 8
+      y = (y >= (args[0] || 128)) ? 255 : 0 if op == :threshold
+      [y, y, y, a]
+    when :invert
+      [255 - r, 255 - g, 255 - b, a]
+    when :tint
+      f = args + [255]
+      [0, 1, 2, 3].map { |i| pixops_div255(c[i] * f[i]) }
+    when :brightness
+      [r, g, b].map { |v| [[v + args[0], 0].max, 255].min } + [a]
+    end
+  end
+
+  # 19 pixels: one AVX2 block, one SSE2 block, a NEON block and a tail
+  pixops_input = (0...19).map do |i|
+    [(i * 97 + 13) & 255, (i * 59 + 200) & 255, (i * 31 + 7) & 255, (i * 113 + 40) & 255]
+  end
+  pixops_input[0] = [0, 0, 0, 0]
+  pixops_input[1] = [255, 255, 255, 255]
+  pixops_cases = [
+    [:grayscale, []], [:invert, []], [:tint, [255, 128, 0, 77]], [:tint, [10, 20, 30]],
+    [:brightness, [40]], [:brightness, [-90]], [:threshold, []], [:threshold, [0]], [:threshold, [200]]
+  ]
+
+  assert('SDL2::Video::Surface#gradient_fill_rect horizontal endpoints') do
+    s = argb_surface(4, 2)
+    s.gradient_fill_rect(0, 0, 0, 255, 255, 0, 0, 255, SDL2::Rect.new(0, 0, 4, 2), false)
+    # the end color is approached, not reached: c1 + (c2 - c1) * i / w
+    expected = [0, 63, 127, 191].map { |r| 0xff000000 | (r << 16) }
+    argb_row(s, 0) == expected && argb_row(s, 1) == expected
+  end
+
+  assert('SDL2::Video::Surface#gradient_fill_rect vertical endpoints on a wide span') do
+    s = argb_surface(20, 4)
+    s.gradient_fill_rect(0, 0, 255, 255, 0, 0, 0, 0, SDL2::Rect.new(0, 0, 20, 4), true)
+    ok = true
+    [255, 191, 127, 63].each_with_index do |v, y|
+      ok &&= argb_row(s, y).all? { |p| p == ((v << 24) | v) }
+    end
+    ok
+  end
+
+  assert('SDL2::Video::Surface#gradient_fill_rect clips to the clip rect') do
+    s = argb_surface(8, 2)
+    s.set_clip_rect(SDL2::Rect.new(2, 1, 3, 1))
+    s.gradient_fill_rect(0, 0, 0, 255, 255, 0, 0, 255, SDL2::Rect.new(0, 0, 8, 2), false)
+    # colors follow the unclipped rect
+    inside = [63, 95, 127].map { |r| 0xff000000 | (r << 16) }
+    argb_row(s, 0) == [0] * 8 && argb_row(s, 1) == [0, 0] + inside + [0, 0, 0]
+  end
+
+  assert('SDL2::Video::Surface#pixels_view covers pitch * height bytes') do
+    s = argb_surface(3, 2)
+    v = s.pixels_view
+    v.size == s.pitch * 2 && s.pixels_view.equal?(v)
+  end
+
+  assert('SDL2::Video::Surface#read_region and #write_region round trip a sub rect') do
+    s = argb_surface(3, 2)
+    6.times { |i| s.set_pixel(i % 3, i / 3, 0xff000000 | (i * 0x101010)) }
+    data = s.read_region(SDL2::Rect.new(1, 0, 2, 2))
+    into = ''
+    s.read_region(SDL2::Rect.new(1, 0, 2, 2), into)
+    d = argb_surface(2, 2)
+    d.write_region(nil, data)
+    data.size == 16 && into == data &&
+      argb_row(d, 0) == argb_row(s, 0)[1, 2] && argb_row(d, 1) == argb_row(s, 1)[1, 2]
+  end
+
+  assert('SDL2::Video::Surface#write_region skips to the next row by pitch') do
+    s = argb_surface(3, 2)
+    6.times { |i| s.set_pixel(i % 3, i / 3, 0xff000000 | i) }
+    d = argb_surface(3, 2)
+    # rows of the whole 3 pixel wide surface, written into a 2 pixel wide rect
+    d.write_region(SDL2::Rect.new(1, 0, 2, 2), s.read_region, 12)
+    argb_row(d, 0) == [0, 0xff000000, 0xff000001] && argb_row(d, 1) == [0, 0xff000003, 0xff000004]
+  end
+
+  assert('SDL2::Video::Surface#read_region and #write_region reject rects outside the surface') do
+    s = argb_surface(3, 2)
+    data = "\0" * 48
+    outside = [SDL2::Rect.new(2, 0, 2, 1), SDL2::Rect.new(-1, 0, 1, 1), SDL2::Rect.new(0, 1, 1, 2), SDL2::Rect.new(0, 0, -1, 1)]
+    read  = outside.all? { |r| begin s.read_region(r); false rescue IndexError; true end }
+    write = outside.all? { |r| begin s.write_region(r, data); false rescue IndexError; true end }
+    read && write
+  end
+
+  assert('SDL2::Video::Surface#read_region and #write_region check sizes and pitch') do
+    s = argb_surface(3, 2)
+    rect = SDL2::Rect.new(0, 0, 2, 2)
+    message = lambda do |call|
+      begin
+        call.call
+        nil
+      rescue ArgumentError => e
+        e.message
+      end
+    end
+    message.call(lambda { s.write_region(rect, "\0" * 16, 7) }) == 'pitch is out of range.' &&
+      message.call(lambda { s.write_region(rect, "\0" * 15) }) == 'data is too small for the region.' &&
+      message.call(lambda { s.write_region(rect, "\0" * 19, 12) }) == 'data is too small for the region.' &&
+      message.call(lambda { s.read_region(rect, SDL2::ByteBuffer.new(15)) }) == 'buffer is too small for the region.'
+  end
+
+  assert('SDL2::Video::Surface#rle detaches the pixels view') do
+    s = argb_surface(3, 2)
+    v = s.pixels_view
+    s.rle(true)
+    v.size == 0
+  end
+
+  assert('SDL2::Video::Surface#destroy detaches the pixels view') do
+    s = argb_surface(3, 2)
+    v = s.pixels_view
+    s.destroy
+    v.size == 0
+  end
+
+  assert('SDL2::Video::Surface#apply! matches the reference on 32-bit layouts') do
+    ok = true
+    [SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888, SDL2::Pixels::SDL_PIXELFORMAT_ABGR8888,
+     SDL2::Pixels::SDL_PIXELFORMAT_RGB888].each do |format|
+      pixops_cases.each do |op, args|
+        s = pixops_surface(format, 32, pixops_input)
+        expected = pixops_colors(s).map { |c| pixops_reference(op, args, c) }
+        expected.each { |c| c[3] = 255 } if s.format.Amask == 0
+        s.apply!(op, *args)
+        ok &&= pixops_colors(s) == expected
+        s.destroy
+      end
+    end
+    ok
+  end
+
+  assert('SDL2::Video::Surface#apply! on 16 and 24-bit surfaces matches 32-bit') do
+    ok = true
+    [[SDL2::Pixels::SDL_PIXELFORMAT_RGB565, 16], [SDL2::Pixels::SDL_PIXELFORMAT_RGB24, 24]].each do |format, depth|
+      pixops_cases.each do |op, args|
+        s = pixops_surface(format, depth, pixops_input)
+        # feed the 32-bit kernels the colors the narrow format can hold
+        wide = pixops_surface(SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888, 32, pixops_colors(s))
+        s.apply!(op, *args)
+        wide.apply!(op, *args)
+        expected = pixops_colors(wide).map { |c| s.format.get_rgba(s.format.mapRGBA(*c)) }
+        ok &&= pixops_colors(s) == expected
+        s.destroy
+        wide.destroy
+      end
+    end
+    ok
+  end
+
+  assert('SDL2::Video::Surface#convolve! on a single bright pixel') do
+    ok = true
+    [[SDL2::Pixels::SDL_PIXELFORMAT_ARGB8888, 0xff000000], [SDL2::Pixels::SDL_PIXELFORMAT_RGB888, 0]].each do |format, base|
+      s = SDL2::Video::Surface.new(5, 1, 32, format)
+      5.times { |x| s.set_pixel(x, 0, base) }
+      s.set_pixel(2, 0, base | 0x906030)
+      s.convolve!([0.25, 0.5, 0.25], [1])
+      ok &&= argb_row(s, 0) == [0, 0x24180c, 0x483018, 0x24180c, 0].map { |p| base | p }
+    end
+    ok
+  end
+
+  assert('SDL2::Video::Surface#convolve! keeps negative lobes between the passes') do
+    s = argb_surface(3, 3)
+    3.times { |y| 3.times { |x| s.set_pixel(x, y, 0xff000000) } }
+    s.set_pixel(1, 1, 0xff646464)
+    s.convolve!([-1, 3, -1])
+    # the horizontal pass leaves -100 beside the centre, which the vertical pass turns into 100
+    corner = 0xff646464
+    argb_row(s, 0) == [corner, 0xff000000, corner] && argb_row(s, 1) == [0xff000000, 0xffffffff, 0xff000000] &&
+      argb_row(s, 2) == [corner, 0xff000000, corner]
+  end
+
+  assert('SDL2::Video::Surface#box_blur does not bleed transparent color') do
+    s = argb_surface(3, 1)
+    s.set_pixel(0, 0, 0xffff0000)
+    s.set_pixel(1, 0, 0x0000ff00)
+    s.set_pixel(2, 0, 0xffff0000)
+    blurred = s.box_blur(1)
+    # premultiplied: green has no weight, red coverage drops to 2/3
+    argb_row(blurred, 0) == [0xaaff0000] * 3 && argb_row(s, 0)[1] == 0x0000ff00
+  end
+
+  assert('SDL2::Video::Surface#gaussian_blur! keeps a flat image flat') do
+    s = argb_surface(9, 5)
+    5.times { |y| 9.times { |x| s.set_pixel(x, y, 0x33c85014) } }
+    s.gaussian_blur!(1.5)
+    (0...5).all? { |y| argb_row(s, y) == [0x33c85014] * 9 }
+  end
+
+  assert('SDL2::Video::Surface#scale to the same size is the identity') do
+    s = argb_surface(4, 3)
+    12.times { |i| s.set_pixel(i % 4, i / 4, 0xff000000 | (i * 0x135791) & 0xffffff) }
+    s.set_pixel(1, 1, 0)
+    [:bilinear, :bicubic, :box].all? do |filter|
+      t = s.scale(4, 3, filter)
+      (0...3).all? { |y| argb_row(t, y) == argb_row(s, y) }
+    end
+  end
+
+  assert('SDL2::Video::Surface#scale keeps the edge pixels when enlarging') do
+    s = argb_surface(2, 1)
+    s.set_pixel(0, 0, 0xff000000)
+    s.set_pixel(1, 0, 0xffffffff)
+    argb_row(s.scale(4, 1), 0) == [0xff000000, 0xff404040, 0xffbfbfbf, 0xffffffff]
+  end
+
+  assert('SDL2::Video::Surface#scale :box averages each covered area') do
+    s = argb_surface(4, 2)
+    [[0, 40, 10, 20], [80, 120, 30, 44]].each_with_index do |row, y|
+      row.each_with_index { |v, x| s.set_pixel(x, y, 0xff000000 | (v * 0x010101)) }
+    end
+    argb_row(s.scale(2, 1, :box), 0) == [0xff3c3c3c, 0xff1a1a1a]
+  end
+
+  assert('SDL2::Video::Surface#scale does not bleed transparent color') do
+    s = argb_surface(2, 1)
+    s.set_pixel(0, 0, 0xffff0000)
+    s.set_pixel(1, 0, 0x0000ff00)
+    argb_row(s.scale(1, 1, :box), 0) == [0x80ff0000]
+  end
+
+  assert('SDL2::Video::Surface#scale :bicubic keeps overshoot between the passes') do
+    # a bright quadrant with sharp edges, symmetric about the diagonal
+    s = argb_surface(4, 4)
+    4.times { |y| 4.times { |x| s.set_pixel(x, y, (x >= 2 && y >= 2) ? 0xffffffff : 0xff000000) } }
+    d = s.scale(8, 8, :bicubic)
+    levels = (0...8).map { |y| argb_row(d, y).map { |p| p & 0xff } }
+    # the ringing next to the horizontal edge survives into the vertical pass
+    levels == levels.transpose && levels[4] == [0, 0, 0, 0x29, 0xa2, 0xd9, 0xd0, 0xcb]
+  end
+ensure
+  SDL2::quit
+end